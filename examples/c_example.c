@@ -6,8 +6,9 @@
 #define checkometoda() printf("%i:%s\n", __LINE__, chima_error_string(res)); assert(!res)
 
 static void print_sprite_transf(chima_sprite const* sprite, chima_u32 w, chima_u32 h) {
-  chima_uv_transf transf = chima_calc_uv_transform(w, h,
-                                                   sprite->rect, CHIMA_UV_FLAG_FLIP_Y);
+  const chima_bitfield flags =
+    CHIMA_UV_FLAG_FLIP_Y | (sprite->rotated ? CHIMA_UV_FLAG_ROTATED : CHIMA_UV_FLAG_NONE);
+  chima_uv_transf transf = chima_calc_uv_transform(w, h, sprite->rect, flags);
   printf("(x: %d, w: %d) -> (%f %f)\n", sprite->rect.x, sprite->rect.width,
          transf.x_lin, transf.x_con);
   printf("(y: %d, h: %d) -> (%f %f)\n", sprite->rect.y, sprite->rect.height,
@@ -53,9 +54,13 @@ int main() {
   res = chima_gen_spritesheet(chima, &sheet, data, 0, col);
   checkometoda();
 
-  printf("sz: (w: %d, h: %d)\n", sheet.atlas.extent.width, sheet.atlas.extent.height);
+  printf("pages: %zu\n", sheet.page_count);
+  for (size_t i = 0; i < sheet.page_count; ++i) {
+    printf("sz: (w: %d, h: %d)\n", sheet.pages[i].extent.width, sheet.pages[i].extent.height);
+  }
   for (size_t i = 0; i < sheet.sprite_count; ++i) {
-    print_sprite_transf(&sheet.sprites[i], sheet.atlas.extent.width, sheet.atlas.extent.height);
+    const chima_image* page = &sheet.pages[sheet.sprites[i].page];
+    print_sprite_transf(&sheet.sprites[i], page->extent.width, page->extent.height);
     printf("\n");
   }
 
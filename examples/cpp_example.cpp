@@ -36,7 +36,7 @@ void run_thing() {
   chima::scoped_resource spritesheet_scope(chima, spritesheet);
 
 #ifdef CHIMA_NO_DOWNCASTING
-  const auto& atlas = spritesheet.get().atlas;
+  const auto& atlas = spritesheet.atlas();
   const auto res =
     chima_write_image(chima, &atlas, CHIMA_FILE_FORMAT_PNG, "./examples/data/test_sheet.png");
   if (res != CHIMA_NO_ERROR) {
@@ -108,7 +108,7 @@ void run_thing_noexcept() noexcept {
   chima::scoped_resource spritesheet_scope(*chima, *spritesheet);
 
 #ifdef CHIMA_NO_DOWNCASTING
-  const auto& atlas = spritesheet->get().atlas;
+  const auto& atlas = spritesheet->atlas();
   const auto res =
     chima_write_image(*chima, &atlas, CHIMA_FILE_FORMAT_PNG, "./examples/data/test_sheet.png");
   if (res != CHIMA_NO_ERROR) {
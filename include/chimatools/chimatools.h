@@ -122,7 +122,8 @@ typedef chima_u32 chima_bitfield;
  *  The returned memory should be valid at least until it is deallocated
  *
  *  @thread_safety Does not need to be thread safe as long as you use your
- *  `chima_context` on a single thread.
+ *  `chima_context` on a single thread, and don't use best of N packing with more than one
+ *  thread (see `chima_set_atlas_best_of`).
  *
  *  @param[in] user User-defined pointer
  *  @param[in] size Minimum allocation size required
@@ -143,7 +144,8 @@ typedef void* (*PFN_chima_malloc)(void* user, size_t size);
  *  The returned memory should be valid at least until it is deallocated
  *
  *  @thread_safety Does not need to be thread safe as long as you use your
- *  `chima_context` on a single thread.
+ *  `chima_context` on a single thread, and don't use best of N packing with more than one
+ *  thread (see `chima_set_atlas_best_of`).
  *
  *  @param[in] user User-defined pointer
  *  @param[in] ptr Memory block to reallocate
@@ -159,7 +161,8 @@ typedef void* (*PFN_chima_realloc)(void* user, void* ptr, size_t oldsz, size_t n
 /*! @brief Function pointer used for freeing internal allocations.
  *
  *  @thread_safety Does not need to be thread safe as long as you use your
- *  `chima_context` on a single thread.
+ *  `chima_context` on a single thread, and don't use best of N packing with more than one
+ *  thread (see `chima_set_atlas_best_of`).
  *
  *  @param[in] user User-defined pointer
  *  @param[in] ptr Memory block to free generated from `PFN_chima_malloc` or
@@ -327,16 +330,17 @@ CHIMA_API const char* chima_error_string(chima_result ret);
  */
 CHIMA_API chima_result chima_create_context(chima_context* chima, const chima_alloc* alloc);
 
-/*! @brief Sets the atlas initial size. Context local.
+/*! @brief Sets the atlas minimum size. Context local.
  *
- *  `chima_create_atlas_image` uses this value as the initial size
- *  to create an image atlas.
+ *  `chima_gen_atlas_image` never creates an atlas smaller than this value. The search for the
+ *  atlas size starts at the larger of this value and the bound given by the total sprite area
+ *  and the biggest sprite side.
  *
- *  @note The default context initial size is `512`
+ *  @note The default context minimum size is `1`
  *
  *  @param[in] chima Chima context. Must not be `NULL`.
- *  @param[in] initial Initial size. Must be >= 0.
- *  @return The previous initial size.
+ *  @param[in] initial Minimum size. Must be > 0.
+ *  @return The previous minimum size.
  *
  *  @ingroup image
  */
@@ -344,9 +348,10 @@ CHIMA_API chima_u32 chima_set_atlas_initial(chima_context chima, chima_u32 initi
 
 /*! @brief Sets the atlas grow factor. Context local.
  *
- *  When you create an atlas image using `chima_create_atlas_image`, the value
- *  defined by `chima_set_atlas_initial` is multiplied by this factor each time
- *  the atlas image needs to be recalculated.
+ *  When the sprites don't fit at the current try, `chima_gen_atlas_image` grows the atlas size
+ *  until they do, starting with small steps that double on every failure. This factor is the
+ *  biggest growth allowed between two tries. The smallest size that fits is then binary searched
+ *  between the last two tries.
  *
  *  @note The default context factor is `2.0f`
  *
@@ -358,6 +363,349 @@ CHIMA_API chima_u32 chima_set_atlas_initial(chima_context chima, chima_u32 initi
  */
 CHIMA_API chima_f32 chima_set_atlas_factor(chima_context chima, chima_f32 factor);
 
+/*! @brief Restricts the atlas size to powers of two. Context local.
+ *
+ *  Takes precedence over `chima_set_atlas_multiple`.
+ *
+ *  @note The default value is `CHIMA_FALSE`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] pow2 Boolean flag
+ *  @return The previous flag state
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_bool chima_set_atlas_pow2(chima_context chima, chima_bool pow2);
+
+/*! @brief Allows non square atlases. Context local.
+ *
+ *  When set, `chima_gen_atlas_image` also tries atlases wider than they are tall and keeps the
+ *  one with the smallest area. The size rules apply to both sides.
+ *
+ *  @note The default value is `CHIMA_FALSE`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] non_square Boolean flag
+ *  @return The previous flag state
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_bool chima_set_atlas_non_square(chima_context chima, chima_bool non_square);
+
+/*! @brief Restricts the atlas size to multiples of a value. Context local.
+ *
+ *  @note The default multiple is `1`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] multiple Size multiple. Must be > 0.
+ *  @return The previous multiple.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_u32 chima_set_atlas_multiple(chima_context chima, chima_u32 multiple);
+
+/*! @brief Sets the maximum atlas size, on both sides. Context local.
+ *
+ *  `chima_gen_atlas_image` fails with `CHIMA_PACKING_FAILED` if the images don't fit in an atlas
+ *  of this size. `chima_gen_spritesheet` splits them in several pages instead. Useful to match
+ *  the texture size limit of a GPU.
+ *
+ *  @note The default maximum size is `16384`, values above it are clamped.
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] size Maximum size. Must be > 0.
+ *  @return The previous maximum size.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_u32 chima_set_atlas_max_size(chima_context chima, chima_u32 size);
+
+/*! @brief Sets the number of threads used by the context. Context local.
+ *
+ *  These operations split their work between the threads, the calling thread being one of them:
+ *  - Atlas compositing in `chima_gen_atlas_image` and `chima_gen_spritesheet`, one row band of
+ *  the atlas per job.
+ *  - The atlas size search, one packer per job when several are tried (see
+ *  `chima_set_atlas_best_of`).
+ *  - GIF frame decoding in `chima_load_image_anim`, one frame per job.
+ *  - Duplicate sprite hashing in `chima_gen_spritesheet`, one image per job.
+ *  - Sprite trimming in `chima_gen_spritesheet` (see `chima_set_sprite_trim`), one image per job.
+ *
+ *  The other threads are started the first time they are needed and kept by the context until
+ *  it is destroyed or the thread count changes.
+ *
+ *  @note The default thread count is `1`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] count Thread count. `0` uses one thread per hardware thread.
+ *  @return The previous thread count.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_u32 chima_set_thread_count(chima_context chima, chima_u32 count);
+
+/*! @brief Rect packing algorithms used by `chima_gen_atlas_image`.
+ *
+ *  @ingroup image
+ */
+typedef enum chima_packer_type {
+  /*! Skyline bottom-left (stb_rect_pack). Fast, good for iteration builds.
+   */
+  CHIMA_PACKER_SKYLINE_BL = 0,
+  /*! MaxRects, best short side fit. Usually the tightest atlas, but the slowest packer.
+   */
+  CHIMA_PACKER_MAXRECTS_BSSF,
+  /*! MaxRects, best area fit.
+   */
+  CHIMA_PACKER_MAXRECTS_BAF,
+  /*! Guillotine, best area fit with a shorter leftover axis split.
+   */
+  CHIMA_PACKER_GUILLOTINE,
+  /*! User provided packer. See `chima_set_custom_packer`.
+   */
+  CHIMA_PACKER_CUSTOM,
+
+  _CHIMA_PACKER_COUNT,
+  _CHIMA_PACKER_FORCE_32BIT = 0x7FFFFFFF,
+} chima_packer_type;
+
+/*! @brief Function pointer used for custom rect packing.
+ *
+ *  Has to place every rect inside of a `width` x `height` area without overlaps. The rect
+ *  sizes are inputs, the positions are outputs. It's called once for every atlas size tried.
+ *  If rotation is enabled (see `chima_set_atlas_rotation`), a rect may be rotated by swapping
+ *  its width and height. A layout with a rect outside of the area or with any other size change
+ *  is treated as a failure to pack at that size.
+ *
+ *  @param[in] user User-defined pointer
+ *  @param[in] width Available width
+ *  @param[in] height Available height
+ *  @param[in,out] rects Rects to place
+ *  @param[in] rect_count Number of rects
+ *  @return `CHIMA_TRUE` if every rect was placed, `CHIMA_FALSE` otherwise.
+ *
+ *  @ingroup image
+ */
+typedef chima_bool (*PFN_chima_pack_rects)(void* user, chima_u32 width, chima_u32 height,
+                                           chima_rect* rects, chima_size rect_count);
+
+/*! @brief User provided rect packer.
+ *
+ *  @ingroup image
+ */
+typedef struct chima_packer {
+  /*! User-defined pointer. Optional.
+   */
+  void* user;
+  /*! Packing function. See `PFN_chima_pack_rects`.
+   */
+  PFN_chima_pack_rects pack;
+} chima_packer;
+
+/*! @brief Sets the rect packing algorithm. Context local.
+ *
+ *  @note The default packer is `CHIMA_PACKER_SKYLINE_BL`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] type Packer type. `CHIMA_PACKER_CUSTOM` uses the packer set with
+ *  `chima_set_custom_packer`.
+ *  @return The previous packer type.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_packer_type chima_set_atlas_packer(chima_context chima, chima_packer_type type);
+
+/*! @brief Sets the packer used with `CHIMA_PACKER_CUSTOM`. Context local.
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] packer Custom packer. Its `pack` function must not be `NULL` when it's used.
+ *  @return The previous custom packer.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_packer chima_set_custom_packer(chima_context chima, chima_packer packer);
+
+/*! @brief Packer flags for `chima_set_atlas_best_of`.
+ *
+ *  @ingroup image
+ */
+typedef enum chima_packer_flags {
+  CHIMA_PACKER_FLAG_NONE = 0x0000,
+  CHIMA_PACKER_FLAG_SKYLINE_BL = 0x0001,
+  CHIMA_PACKER_FLAG_MAXRECTS_BSSF = 0x0002,
+  CHIMA_PACKER_FLAG_MAXRECTS_BAF = 0x0004,
+  CHIMA_PACKER_FLAG_GUILLOTINE = 0x0008,
+  CHIMA_PACKER_FLAG_CUSTOM = 0x0010,
+  CHIMA_PACKER_FLAG_ALL = 0x000F,
+
+  _CHIMA_PACKER_FLAG_FORCE_32BIT = 0x7FFFFFFF
+} chima_packer_flags;
+
+/*! @brief Enables best of N atlas packing. Context local.
+ *
+ *  When set, `chima_gen_atlas_image` runs a full atlas size search for every packer in
+ *  `packers` (and for a few sort orders with the MaxRects and Guillotine packers), and keeps
+ *  the layout with the smallest area. The searches run concurrently on the context threads (see
+ *  `chima_set_thread_count`), so with enough threads it takes about as long as the slowest one.
+ *  The result doesn't depend on the thread count.
+ *
+ *  @note The default value is `CHIMA_PACKER_FLAG_NONE`, only the packer set with
+ *  `chima_set_atlas_packer` is used.
+ *
+ *  @thread_safety The packers allocate from worker threads, so a user allocator must be thread
+ *  safe when the thread count is not `1`. The custom packer only runs on one thread at a time.
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] packers Bitwise OR of `chima_packer_flags`. `CHIMA_PACKER_FLAG_ALL` doesn't
+ *  include the custom packer.
+ *  @return The previous packer flags.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_bitfield chima_set_atlas_best_of(chima_context chima, chima_bitfield packers);
+
+/*! @brief Statistics of the last atlas generated with a context.
+ *
+ *  @ingroup image
+ */
+typedef struct chima_atlas_stats {
+  /*! Atlas size. The size of the first page for multi page spritesheets.
+   */
+  chima_extent2d extent;
+  /*! Sprite area over the atlas area of every page, in range [0.0, 1.0]. Padding is not
+   *  counted.
+   */
+  chima_f32 occupancy;
+  /*! Number of packs tried by the atlas size search, for all packers.
+   */
+  chima_u32 pack_count;
+  /*! Time spent searching the atlas size, in milliseconds. Wall clock time with best of N
+   * packing.
+   */
+  chima_f32 pack_time;
+  /*! Number of atlas pages. Always `1` for `chima_gen_atlas_image`.
+   */
+  chima_u32 page_count;
+} chima_atlas_stats;
+
+/*! @brief Gets the statistics of the last atlas generated with a context.
+ *
+ *  Updated by every successful `chima_gen_atlas_image` and `chima_gen_spritesheet` call.
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[out] stats Statistics output. Zeroed if no atlas was generated yet.
+ *  @return `CHIMA_NO_ERROR` on success, `CHIMA_INVALID_VALUE` on invalid parameters.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_get_atlas_stats(chima_context chima, chima_atlas_stats* stats);
+
+/*! @brief Trims the transparent borders of the spritesheet images. Context local.
+ *
+ *  When set, `chima_gen_spritesheet` packs only the bounding box of the texels with a non zero
+ *  alpha of each image. The size of the untrimmed image and the position of the bounding box
+ *  inside of it are stored in each `chima_sprite`. Fully transparent images get an empty rect.
+ *  Images without an alpha channel are not trimmed.
+ *
+ *  @note The default value is `CHIMA_FALSE`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] trim Boolean flag
+ *  @return The previous flag state
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_bool chima_set_sprite_trim(chima_context chima, chima_bool trim);
+
+/*! @brief Packs the frames of each spritesheet animation next to each other. Context local.
+ *
+ *  When set, `chima_gen_spritesheet` lays out the frames of every animation in rows, in frame
+ *  order, and packs the whole layout as a single rect, so playing the animation samples a
+ *  compact area of the atlas. The animation also stays on a single page, unless its frames
+ *  don't fit in one. Frames shared with an earlier sprite are not moved. Packing is usually a
+ *  bit looser, since the packers can't fill the gaps between the rows with other sprites.
+ *
+ *  @note The default value is `CHIMA_FALSE`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] group Boolean flag
+ *  @return The previous flag state
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_bool chima_set_atlas_group_anims(chima_context chima, chima_bool group);
+
+/*! @brief Allows rotating sprites by 90 degrees when packing atlases. Context local.
+ *
+ *  When set, the packers may place a sprite on its side if that packs tighter. Every packer also
+ *  searches a layout without rotation, and the smallest one is kept. Rotated sprites are copied
+ *  turned 90 degrees clockwise, so their atlas rect has the width and height of the image
+ *  swapped. Square sprites are never rotated.
+ *
+ *  @note The default value is `CHIMA_FALSE`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] rotate Boolean flag
+ *  @return The previous flag state
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_bool chima_set_atlas_rotation(chima_context chima, chima_bool rotate);
+
+/*! @brief Sets how many edge texels are duplicated around each atlas sprite. Context local.
+ *
+ *  Every sprite packed by `chima_gen_atlas_image` and `chima_gen_spritesheet` gets its border
+ *  rows and columns repeated `extrude` times on each side, so bilinear sampling at the edge of
+ *  the sprite rect reads the sprite itself. The extruded texels are written by the same pass
+ *  that copies the sprite, and are not part of the sprite rects. The padding is added after
+ *  them.
+ *
+ *  @note The default value is `0`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] extrude Extruded texels on each side.
+ *  @return The previous value
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_u32 chima_set_atlas_extrude(chima_context chima, chima_u32 extrude);
+
+/*! @brief Aligns the atlas sprites to texel blocks. Context local.
+ *
+ *  The area of every sprite, extruded texels and padding included, starts and ends on a
+ *  multiple of `block`, so sprites never share a block of a GPU compressed format (`4` for
+ *  BCn and ETC2). Atlas sizes are also kept to multiples of `block`, unless they are restricted
+ *  to powers of two. A custom packer placing a rect outside of a block boundary makes the atlas
+ *  generation fail with `CHIMA_PACKING_FAILED`.
+ *
+ *  @note The default value is `1`, no alignment
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] block Block size in texels. Must be > 0.
+ *  @return The previous value
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_u32 chima_set_atlas_block_size(chima_context chima, chima_u32 block);
+
+/*! @brief Spreads the sprite colors into their transparent texels. Context local.
+ *
+ *  Every fully transparent texel of an atlas sprite takes the average color of the closest
+ *  texels with a non zero alpha, up to `radius` texels away, keeping its alpha. Filtering then
+ *  blends the sprite edges with their own colors instead of the background. Done while the
+ *  sprite is copied, so it costs no extra pass over the atlas. Images without an alpha channel
+ *  are left as is.
+ *
+ *  @note The default value is `0`, no bleeding
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] radius Search distance in texels, clamped to [0, 16].
+ *  @return The previous value
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_u32 chima_set_atlas_bleed(chima_context chima, chima_u32 radius);
+
 /*! @brief Sets the image loader flip flag.
  *
  *  Used by image and image animation loading functions.
@@ -375,6 +723,41 @@ CHIMA_API chima_f32 chima_set_atlas_factor(chima_context chima, chima_f32 factor
  */
 CHIMA_API chima_bool chima_set_flip_y(chima_context chima, chima_bool flip_y);
 
+/*! @brief Merges identical consecutive frames when loading animations. Context local.
+ *
+ *  Used by `chima_load_image_anim` and `chima_load_image_anim_file`. If this flag is set, a frame
+ *  with the exact same texels as the previous one is dropped, and its frametime added to the
+ *  previous frame. Animations holding a pose over repeated frames then take less memory and
+ *  atlas space, and play the same. The streaming decoder is not affected.
+ *
+ *  @note The default value is `CHIMA_FALSE`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] merge Boolean flag
+ *  @return The previous flag state
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_bool chima_set_anim_merge_frames(chima_context chima, chima_bool merge);
+
+/*! @brief Maps spritesheet files in memory instead of reading them. Context local.
+ *
+ *  Used by `chima_load_spritesheet`. If this flag is set, the file is mapped copy on write and
+ *  its tables are parsed in place. The pages of RAW spritesheets are used straight from the
+ *  mapping, so loading them doesn't read or copy the texels up front, and processes loading the
+ *  same file share its memory until they write to the pages. Encoded pages are decoded from the
+ *  mapping, which is then released right away.
+ *
+ *  @note The default value is `CHIMA_FALSE`
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[in] map Boolean flag
+ *  @return The previous flag state
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_bool chima_set_sheet_map_file(chima_context chima, chima_bool map);
+
 /*! @brief Destroy and deallocate a `chima_context` handle.
  *
  *  Does NOT destroy any previously allocated chimatools objects. It is the
@@ -415,6 +798,16 @@ typedef enum chima_image_depth {
   _CHIMA_DEPTH_FORCE_32BIT = 0x7FFFFFFF,
 } chima_image_depth;
 
+/*! @brief Opaque handle for the dirty region tracker of an image.
+ *
+ *  Records the regions of an image written since the last flush. Writes that take a tracker
+ *  (`chima_composite_image_ex`, `chima_fill_image`) mark the rects they touch in it, other
+ *  writes have to be reported with `chima_dirty_tracker_mark`.
+ *
+ *  @ingroup image
+ */
+typedef struct chima_dirty_tracker_* chima_dirty_tracker;
+
 typedef struct chima_image {
   chima_extent2d extent;
   chima_u32 channels;
@@ -427,6 +820,66 @@ CHIMA_API chima_result chima_gen_blank_image(chima_context chima, chima_image* i
                                              chima_image_depth depth,
                                              chima_color background_color);
 
+/*! @brief How `chima_gen_blank_image_ex` initializes the image texels.
+ *
+ *  @ingroup image
+ */
+typedef enum chima_fill_mode {
+  /*! Fill every pixel with the background color.
+   */
+  CHIMA_FILL_COLOR = 0,
+  /*! Leave the texels uninitialized. Useful when every pixel is going to be overwritten.
+   */
+  CHIMA_FILL_NONE,
+
+  _CHIMA_FILL_COUNT,
+  _CHIMA_FILL_FORCE_32BIT = 0x7FFFFFFF,
+} chima_fill_mode;
+
+/*! @brief Allocate a blank image, choosing how its texels are initialized.
+ *
+ *  Same as `chima_gen_blank_image`. With `CHIMA_FILL_COLOR`, a color that converts to zero
+ *  texels is allocated already cleared, any other color is broadcast using SIMD stores.
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[out] image Output image. Must not be `NULL`.
+ *  @param[in] width Image width. Must be > 0.
+ *  @param[in] height Image height. Must be > 0.
+ *  @param[in] channels Channel count, clamped to [1, 4].
+ *  @param[in] depth Image depth.
+ *  @param[in] background_color Fill color, clamped to [0, 1]. Ignored with `CHIMA_FILL_NONE`.
+ *  @param[in] mode Texel initialization.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_ALLOC_FAILURE` on allocation failure.
+ *  `CHIMA_INVALID_VALUE` on invalid parameters.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_gen_blank_image_ex(chima_context chima, chima_image* image,
+                                                chima_u32 width, chima_u32 height,
+                                                chima_u32 channels, chima_image_depth depth,
+                                                chima_color background_color,
+                                                chima_fill_mode mode);
+
+/*! @brief Fill every pixel of an image with a color.
+ *
+ *  @param[in] image Image to fill. Must not be `NULL`.
+ *  @param[in] color Fill color, clamped to [0, 1].
+ *  @param[in] dirty Tracker of `image`, marked with the whole image. Can be `NULL`.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_INVALID_VALUE` on invalid images.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_fill_image(chima_image* image, chima_color color,
+                                        chima_dirty_tracker dirty);
+
+/*! @brief Packs a list of images in a new atlas image.
+ *
+ *  All images must have the same channel count and depth. The atlas rect of each image is
+ *  written to `sprites`. With rotation enabled (see `chima_set_atlas_rotation`), a rect with the
+ *  width and height of its image swapped holds the image rotated 90 degrees clockwise.
+ *
+ *  @ingroup image
+ */
 CHIMA_API chima_result chima_gen_atlas_image(chima_context chima, chima_image* atlas,
                                              chima_rect* sprites, chima_u32 padding,
                                              chima_color background_color,
@@ -445,11 +898,262 @@ CHIMA_API chima_result chima_load_image_mem(chima_context chima, chima_image* im
 CHIMA_API chima_result chima_write_image(chima_context chima, const chima_image* image,
                                          chima_image_format format, const char* path);
 
+/*! @brief Pixel operators used when compositing images.
+ *
+ *  @ingroup image
+ */
+typedef enum chima_blend_mode {
+  /*! Overwrite the destination pixels.
+   */
+  CHIMA_BLEND_REPLACE = 0,
+  /*! Straight (non premultiplied) alpha "over" operator.
+   */
+  CHIMA_BLEND_OVER,
+  /*! "over" operator for images with premultiplied alpha.
+   */
+  CHIMA_BLEND_PREMUL_OVER,
+  /*! Add the source color scaled by its alpha. Saturates.
+   */
+  CHIMA_BLEND_ADD,
+
+  _CHIMA_BLEND_COUNT,
+  _CHIMA_BLEND_FORCE_32BIT = 0x7FFFFFFF,
+} chima_blend_mode;
+
+/*! @brief Draw an image on top of another using straight alpha "over" blending.
+ *
+ *  Any pairing of 1 to 4 channels is accepted. Gray images are expanded to RGB and images
+ *  without an alpha channel (1 and 3 channels) are considered opaque. The part of `src` that
+ *  falls outside of `dst` is clipped. Both images must have the same depth.
+ *
+ *  8U images are blended in fixed point using SSE2 or AVX2 when the CPU supports them. 16U and
+ *  32F images are blended as floats, 32F values are not clamped so HDR images keep their range.
+ *
+ *  @param[in] dst Destination image. Must not be `NULL`.
+ *  @param[in] src Source image. Must not be `NULL`.
+ *  @param[in] xpos Horizontal position of `src` inside `dst`.
+ *  @param[in] ypos Vertical position of `src` inside `dst`.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_INVALID_VALUE` on invalid images.
+ *  `CHIMA_UNSUPPORTED_FORMAT` if the image depths differ.
+ *
+ *  @ingroup image
+ */
 CHIMA_API chima_result chima_composite_image(chima_image* dst, const chima_image* src,
                                              chima_u32 xpos, chima_u32 ypos);
 
+/*! @brief Draw an image on top of another using the provided blend mode.
+ *
+ *  Same as `chima_composite_image`, but with a choice of pixel operator. When both images have
+ *  the same channel count, `CHIMA_BLEND_REPLACE` is a plain row copy.
+ *
+ *  @param[in] dst Destination image. Must not be `NULL`.
+ *  @param[in] src Source image. Must not be `NULL`.
+ *  @param[in] xpos Horizontal position of `src` inside `dst`.
+ *  @param[in] ypos Vertical position of `src` inside `dst`.
+ *  @param[in] mode Pixel operator.
+ *  @param[in] dirty Tracker of `dst`, marked with the rect written to. Can be `NULL`.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_INVALID_VALUE` on invalid images or blend mode.
+ *  `CHIMA_UNSUPPORTED_FORMAT` if the image depths differ.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_composite_image_ex(chima_image* dst, const chima_image* src,
+                                                chima_u32 xpos, chima_u32 ypos,
+                                                chima_blend_mode mode,
+                                                chima_dirty_tracker dirty);
+
 CHIMA_API void chima_destroy_image(chima_context chima, chima_image* image);
 
+/*! @brief Creates a dirty region tracker for an image.
+ *
+ *  The tracker only keeps the extent of the image, it can be destroyed at any time and is not
+ *  affected by copies of the image struct. It starts with an empty region.
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[out] tracker Created tracker. Must not be `NULL`.
+ *  @param[in] image Tracked image, marks are clipped to its extent. Must not be `NULL`.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_ALLOC_FAILURE` on allocation failure.
+ *  `CHIMA_INVALID_VALUE` on invalid parameters.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_create_dirty_tracker(chima_context chima,
+                                                  chima_dirty_tracker* tracker,
+                                                  const chima_image* image);
+
+/*! @brief Adds a rect to a dirty region. Clipped to the tracked image.
+ *
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_INVALID_VALUE` if the tracker is `NULL`.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_dirty_tracker_mark(chima_dirty_tracker tracker, chima_rect rect);
+
+/*! @brief Retrieves a dirty region and resets it.
+ *
+ *  The region is returned as a short list of rects covering every texel written since the last
+ *  flush, possibly a few more. Nearby rects are merged when uploading their bounds costs less
+ *  than uploading them one by one.
+ *
+ *  @param[in] tracker Dirty region tracker. Must not be `NULL`.
+ *  @param[out] rects Dirty rects, owned by the tracker. Valid until the next flush, or until the
+ *  tracker is destroyed.
+ *  @param[out] rect_count Number of dirty rects. Zero if nothing changed.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_INVALID_VALUE` on invalid parameters.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_dirty_tracker_flush(chima_dirty_tracker tracker,
+                                                 const chima_rect** rects,
+                                                 chima_size* rect_count);
+
+/*! @brief Destroys a dirty region tracker.
+ *
+ *  @note This function does nothing if the argument is `NULL`.
+ *
+ *  @ingroup image
+ */
+CHIMA_API void chima_destroy_dirty_tracker(chima_dirty_tracker tracker);
+
+/*! @brief Opaque handle for a dynamic atlas.
+ *
+ *  A fixed size atlas image where sprites can be inserted and removed at any time, without
+ *  moving the other sprites. Meant for sprites streamed in and out at runtime, use
+ *  `chima_gen_atlas_image` or `chima_gen_spritesheet` for atlases built once.
+ *
+ *  @ingroup image
+ */
+typedef struct chima_dyn_atlas_* chima_dyn_atlas;
+
+/*! @brief Handle of a sprite in a dynamic atlas. Never 0.
+ *
+ *  Handles of removed sprites stay invalid, until their slot is reused 4096 times.
+ *
+ *  @ingroup image
+ */
+typedef chima_u32 chima_dyn_sprite;
+
+/*! @brief Function pointer called for every sprite evicted from a dynamic atlas.
+ *
+ *  @param[in] user User-defined pointer
+ *  @param[in] sprite Evicted sprite, already invalid.
+ *  @param[in] rect Rect the sprite used to have in the atlas.
+ *
+ *  @ingroup image
+ */
+typedef void (*PFN_chima_dyn_evict)(void* user, chima_dyn_sprite sprite, const chima_rect* rect);
+
+/*! @brief Creates a new empty dynamic atlas.
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[out] atlas Output atlas handle. Must not be `NULL`.
+ *  @param[in] width Atlas width. Must be in [1, 16384].
+ *  @param[in] height Atlas height. Must be in [1, 16384].
+ *  @param[in] channels Channel count, clamped to [1, 4].
+ *  @param[in] depth Image depth. Inserted images must have the same depth.
+ *  @param[in] padding Space left to the right and below each sprite.
+ *  @param[in] background_color Color of the free space.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_ALLOC_FAILURE` on allocation failure.
+ *  `CHIMA_INVALID_VALUE` on invalid parameters.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_create_dyn_atlas(chima_context chima, chima_dyn_atlas* atlas,
+                                              chima_u32 width, chima_u32 height,
+                                              chima_u32 channels, chima_image_depth depth,
+                                              chima_u32 padding, chima_color background_color);
+
+/*! @brief Copies an image to a free place of a dynamic atlas.
+ *
+ *  Space is taken from a shelf allocator, so an insertion only looks at the free spans of the
+ *  atlas and never moves other sprites. The sprite rect stays the same until it is removed.
+ *
+ *  If the image doesn't fit and `evict` is `CHIMA_TRUE`, the least recently used sprites are
+ *  removed until it does, calling the eviction callback for each one (see
+ *  `chima_dyn_atlas_set_evict_callback`).
+ *
+ *  @param[in] atlas Dynamic atlas. Must not be `NULL`.
+ *  @param[in] image Image to insert. Must not be `NULL`.
+ *  @param[in] evict Evict sprites to make room.
+ *  @param[out] sprite Handle of the new sprite. Must not be `NULL`.
+ *  @param[out] rect Rect of the sprite in the atlas image. Can be `NULL`.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_PACKING_FAILED` if the image doesn't fit.
+ *  `CHIMA_UNSUPPORTED_FORMAT` if the image depth differs from the atlas depth.
+ *  `CHIMA_ALLOC_FAILURE` on allocation failure. `CHIMA_INVALID_VALUE` on invalid parameters.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_dyn_atlas_insert(chima_dyn_atlas atlas, const chima_image* image,
+                                              chima_bool evict, chima_dyn_sprite* sprite,
+                                              chima_rect* rect);
+
+/*! @brief Removes a sprite from a dynamic atlas, clearing its texels to the background color.
+ *
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_INVALID_VALUE` if the sprite is not in the atlas.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_dyn_atlas_remove(chima_dyn_atlas atlas, chima_dyn_sprite sprite);
+
+/*! @brief Marks a sprite as the most recently used, the last one to be evicted.
+ *
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_INVALID_VALUE` if the sprite is not in the atlas.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_dyn_atlas_touch(chima_dyn_atlas atlas, chima_dyn_sprite sprite);
+
+/*! @brief Retrieves the rect of a sprite in the atlas image.
+ *
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_INVALID_VALUE` if the sprite is not in the atlas.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_dyn_atlas_get_rect(chima_dyn_atlas atlas, chima_dyn_sprite sprite,
+                                                chima_rect* rect);
+
+/*! @brief Number of sprites in a dynamic atlas.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_size chima_dyn_atlas_sprite_count(chima_dyn_atlas atlas);
+
+/*! @brief Atlas image of a dynamic atlas, owned by the atlas.
+ *
+ *  The texels change on every insertion and removal, the extent and format never do.
+ *
+ *  @ingroup image
+ */
+CHIMA_API const chima_image* chima_dyn_atlas_image(chima_dyn_atlas atlas);
+
+/*! @brief Dirty region tracker of a dynamic atlas image, owned by the atlas.
+ *
+ *  Every insertion and removal marks the rects it changes. `chima_dirty_tracker_flush` returns
+ *  the rects changed since the last flush.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_dirty_tracker chima_dyn_atlas_dirty_tracker(chima_dyn_atlas atlas);
+
+/*! @brief Sets the function called for every sprite evicted by `chima_dyn_atlas_insert`.
+ *
+ *  @param[in] atlas Dynamic atlas. Must not be `NULL`.
+ *  @param[in] callback Eviction callback. Can be `NULL`.
+ *  @param[in] user User-defined pointer passed to `callback`.
+ *
+ *  @ingroup image
+ */
+CHIMA_API void chima_dyn_atlas_set_evict_callback(chima_dyn_atlas atlas,
+                                                  PFN_chima_dyn_evict callback, void* user);
+
+/*! @brief Destroys a dynamic atlas and its image.
+ *
+ *  @note This function does nothing if the argument is `NULL`.
+ *
+ *  @ingroup image
+ */
+CHIMA_API void chima_destroy_dyn_atlas(chima_dyn_atlas atlas);
+
 typedef struct chima_image_anim {
   chima_image* images;
   chima_u32* frametimes;
@@ -462,8 +1166,107 @@ CHIMA_API chima_result chima_load_image_anim(chima_context chima, chima_image_an
 CHIMA_API chima_result chima_load_image_anim_file(chima_context chima, chima_image_anim* anim,
                                                   FILE* f);
 
+/*! @brief Destroys an animation loaded by chimatools.
+ *
+ *  Loaded animations are a single allocation starting at `images`, holding the frametimes and
+ *  the frame data as well. Only that block is freed.
+ *
+ *  @note This function does nothing if the argument is `NULL`.
+ *
+ *  @ingroup image
+ */
 CHIMA_API void chima_destroy_image_anim(chima_context chima, chima_image_anim* anim);
 
+/*! @brief Opaque handle for a streaming animation decoder.
+ *
+ *  Decodes the frames of a GIF one at a time, keeping only the last one in memory, so playing
+ *  an animation takes the same memory no matter how many frames it has. Use
+ *  `chima_load_image_anim` to get every frame at once.
+ *
+ *  @ingroup image
+ */
+typedef struct chima_anim_decoder_* chima_anim_decoder;
+
+/*! @brief Opens an animation for streaming decoding.
+ *
+ *  Seeking back decodes forward from the closest checkpoint before the target frame. A
+ *  checkpoint is a copy of the decoder state, about 9 bytes per canvas texel, taken while
+ *  decoding past the frames seen so far. They are spread evenly over those frames and never
+ *  take more than `memory_budget` bytes. With a budget of 0, seeking back always decodes from
+ *  the first frame.
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[out] decoder Output decoder handle. Must not be `NULL`.
+ *  @param[in] path GIF file path. Must not be `NULL`.
+ *  @param[in] memory_budget Maximum bytes used by checkpoints.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_FILE_OPEN_FAILURE` if the file can't be
+ *  opened. `CHIMA_UNSUPPORTED_FORMAT` if the file is not a GIF. `CHIMA_ALLOC_FAILURE` on
+ *  allocation failure. `CHIMA_INVALID_VALUE` on invalid parameters.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_create_anim_decoder(chima_context chima,
+                                                 chima_anim_decoder* decoder, const char* path,
+                                                 chima_size memory_budget);
+
+/*! @brief Opens an animation for streaming decoding from an open file.
+ *
+ *  Same as `chima_create_anim_decoder`, reading the GIF from the current position of `f`.
+ *  The file has to be seekable and stay open until the decoder is destroyed.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_create_anim_decoder_file(chima_context chima,
+                                                      chima_anim_decoder* decoder, FILE* f,
+                                                      chima_size memory_budget);
+
+/*! @brief Decodes the next frame of an animation.
+ *
+ *  @param[in] decoder Animation decoder. Must not be `NULL`.
+ *  @param[out] frame Decoded frame, owned by the decoder. Valid until the next call to
+ *  `chima_anim_decoder_next` or `chima_anim_decoder_seek`. Must not be `NULL`.
+ *  @param[out] frametime Frame time. Can be `NULL`.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_FILE_EOF` after the last frame.
+ *  `CHIMA_IMAGE_PARSE_FAILURE` on corrupt data. `CHIMA_ALLOC_FAILURE` on allocation failure.
+ *  `CHIMA_INVALID_VALUE` on invalid parameters.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_anim_decoder_next(chima_anim_decoder decoder,
+                                               const chima_image** frame, chima_u32* frametime);
+
+/*! @brief Moves an animation decoder, so the next decoded frame is `frame`.
+ *
+ *  @param[in] decoder Animation decoder. Must not be `NULL`.
+ *  @param[in] frame Index of the frame.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_INVALID_VALUE` if the animation has fewer
+ *  frames or on invalid parameters. `CHIMA_IMAGE_PARSE_FAILURE` on corrupt data.
+ *  `CHIMA_ALLOC_FAILURE` on allocation failure.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_result chima_anim_decoder_seek(chima_anim_decoder decoder, chima_size frame);
+
+/*! @brief Index of the frame `chima_anim_decoder_next` decodes next.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_size chima_anim_decoder_tell(chima_anim_decoder decoder);
+
+/*! @brief Frame count of an animation, or 0 until its last frame was decoded once.
+ *
+ *  @ingroup image
+ */
+CHIMA_API chima_size chima_anim_decoder_frame_count(chima_anim_decoder decoder);
+
+/*! @brief Destroys an animation decoder, closing its file if it opened it.
+ *
+ *  @note This function does nothing if the argument is `NULL`.
+ *
+ *  @ingroup image
+ */
+CHIMA_API void chima_destroy_anim_decoder(chima_anim_decoder decoder);
+
 typedef struct chima_sheet_data_* chima_sheet_data;
 
 CHIMA_API chima_result chima_create_sheet_data(chima_context chima, chima_sheet_data* data);
@@ -494,8 +1297,23 @@ CHIMA_API void chima_destroy_sheet_data(chima_sheet_data data);
 
 typedef struct chima_sprite {
   chima_string name;
+  /*! Sprite texels in the atlas. Only the opaque part of the image if it was trimmed.
+   */
   chima_rect rect;
   chima_u32 frametime;
+  /*! Size of the image before trimming.
+   */
+  chima_extent2d source_extent;
+  /*! Position of `rect` inside of the untrimmed image. Zero if it wasn't trimmed.
+   */
+  chima_u32 trim_x, trim_y;
+  /*! `CHIMA_TRUE` if the sprite is stored rotated 90 degrees clockwise. The width and height of
+   *  `rect` are then swapped, `source_extent` and the trim offsets are not.
+   */
+  chima_bool rotated;
+  /*! Index of the atlas page holding the sprite.
+   */
+  chima_u32 page;
 } chima_sprite;
 
 typedef struct chima_sprite_anim {
@@ -504,24 +1322,83 @@ typedef struct chima_sprite_anim {
   chima_size sprite_count;
 } chima_sprite_anim;
 
+/*! @brief Opaque handle for a file mapped in memory.
+ *
+ *  Owned by the spritesheet that holds it, and released by `chima_destroy_spritesheet`.
+ *
+ *  @ingroup image
+ */
+typedef struct chima_file_mapping_* chima_file_mapping;
+
 typedef struct chima_spritesheet {
-  chima_image atlas;
+  /*! Atlas pages, usually just one. See `chima_set_atlas_max_size`.
+   */
+  chima_image* pages;
+  chima_size page_count;
   chima_sprite* sprites;
   chima_size sprite_count;
   chima_sprite_anim* anims;
   chima_size anim_count;
+  /*! Buffer the pages point into, when `chima_load_spritesheet_mem` loaded RAW pages without
+   *  copying them. `NULL` if the sheet owns its pages.
+   */
+  const void* page_source;
+  /*! Mapping of the file the sheet was loaded from, when `chima_set_sheet_map_file` is set and
+   *  the pages point into it. `NULL` otherwise.
+   */
+  chima_file_mapping mapping;
 } chima_spritesheet;
 
+/*! @brief Packs the images of a sheet data object in a new spritesheet.
+ *
+ *  Images with identical pixel data (same size, channels, depth and texels) are packed once, and
+ *  their sprites share the same `rect`. When the images don't fit in an atlas of the maximum
+ *  size, they are split in several pages, in the order they were added.
+ *
+ *  @ingroup image
+ */
 CHIMA_API chima_result chima_gen_spritesheet(chima_context chima, chima_spritesheet* sheet,
                                              chima_sheet_data data, chima_u32 padding,
                                              chima_color background_color);
 
+/*! @brief Loads a spritesheet from a `.chima` file.
+ *
+ *  If `chima_set_sheet_map_file` is set, the file is mapped in memory and loaded as with
+ *  `chima_load_spritesheet_mem`. RAW pages then point into the mapping, which the sheet keeps
+ *  in `mapping` until it is destroyed.
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[out] sheet Loaded spritesheet. Must not be `NULL`.
+ *  @param[in] path Path of the file. Must not be `NULL`.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_FILE_OPEN_FAILURE` if the file can't be opened or
+ *  mapped. See `chima_load_spritesheet_file` and `chima_load_spritesheet_mem` for the other
+ *  errors.
+ *
+ *  @ingroup image
+ */
 CHIMA_API chima_result chima_load_spritesheet(chima_context chima, chima_spritesheet* sheet,
                                               const char* path);
 
 CHIMA_API chima_result chima_load_spritesheet_file(chima_context chima, chima_spritesheet* sheet,
                                                    FILE* f);
 
+/*! @brief Loads a spritesheet from a `.chima` file in memory.
+ *
+ *  The tables are read in place, and every offset and size in the file is checked against the
+ *  buffer. Encoded pages are decoded straight from the buffer. RAW pages point into the buffer
+ *  instead of being copied, if their data is aligned for the image depth; `page_source` is then
+ *  set, the buffer must outlive the sheet and the pages must not be written.
+ *
+ *  @param[in] chima Chima context. Must not be `NULL`.
+ *  @param[out] sheet Loaded spritesheet. Must not be `NULL`.
+ *  @param[in] buffer File contents. Must not be `NULL`.
+ *  @param[in] buffer_len Size of the file contents, in bytes.
+ *  @return `CHIMA_NO_ERROR` on success. `CHIMA_INVALID_FILE_FORMAT` if the file is not a
+ *  supported spritesheet or any of its offsets is out of bounds. `CHIMA_FILE_EOF` if the
+ *  buffer ends before the tables do.
+ *
+ *  @ingroup image
+ */
 CHIMA_API chima_result chima_load_spritesheet_mem(chima_context chima, chima_spritesheet* sheet,
                                                   const chima_u8* buffer, chima_size buffer_len);
 
@@ -539,10 +1416,28 @@ typedef enum chima_uv_flags {
   CHIMA_UV_FLAG_NONE = 0x0000,
   CHIMA_UV_FLAG_FLIP_Y = 0x0001,
   CHIMA_UV_FLAG_FLIP_X = 0x0002,
+  /*! The rect holds a sprite rotated 90 degrees clockwise. The x terms of the transform then
+   *  take the sprite v coordinate, and the y terms the sprite u coordinate.
+   */
+  CHIMA_UV_FLAG_ROTATED = 0x0004,
 
   _CHIMA_UV_FLAG_FORCE_32BIT = 0x7FFFFFFF
 } chima_uv_flags;
 
+/*! @brief Computes the transform from sprite UVs to atlas UVs.
+ *
+ *  Atlas UVs are `u = x_lin * su + x_con` and `v = y_lin * sv + y_con` for sprite UVs
+ *  (`su`, `sv`) in [0, 1]. With `CHIMA_UV_FLAG_ROTATED` the sprite UVs are swapped, `u = x_lin *
+ *  sv + x_con` and `v = y_lin * su + y_con`. The flip flags mirror the atlas UVs.
+ *
+ *  @param[in] image_width Atlas width
+ *  @param[in] image_height Atlas height
+ *  @param[in] rect Sprite rect in the atlas
+ *  @param[in] flags `chima_uv_flags` bitfield
+ *  @return The UV transform
+ *
+ *  @ingroup image
+ */
 CHIMA_API chima_uv_transf chima_calc_uv_transform(chima_u32 image_width, chima_u32 image_height,
                                                   chima_rect rect, chima_bitfield flags);
 
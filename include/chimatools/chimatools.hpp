@@ -163,6 +163,18 @@ public:
     return static_cast<Derived&>(*this);
   }
 
+  Derived& set_anim_merge_frames(chima_bool flag) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_anim_merge_frames(_chima, flag);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_sheet_map_file(chima_bool flag) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_sheet_map_file(_chima, flag);
+    return static_cast<Derived&>(*this);
+  }
+
   Derived& set_atlas_factor(chima_f32 fac) {
     CHIMA_ASSERT(!_is_empty(_chima));
     chima_set_atlas_factor(_chima, fac);
@@ -175,6 +187,98 @@ public:
     return static_cast<Derived&>(*this);
   }
 
+  Derived& set_atlas_pow2(chima_bool flag) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_pow2(_chima, flag);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_atlas_non_square(chima_bool flag) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_non_square(_chima, flag);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_atlas_multiple(chima_u32 multiple) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_multiple(_chima, multiple);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_thread_count(chima_u32 count) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_thread_count(_chima, count);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_atlas_packer(chima_packer_type type) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_packer(_chima, type);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_custom_packer(chima_packer packer) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_custom_packer(_chima, packer);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_sprite_trim(chima_bool flag) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_sprite_trim(_chima, flag);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_atlas_max_size(chima_u32 size) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_max_size(_chima, size);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_atlas_rotation(chima_bool flag) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_rotation(_chima, flag);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_atlas_group_anims(chima_bool flag) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_group_anims(_chima, flag);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_atlas_extrude(chima_u32 extrude) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_extrude(_chima, extrude);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_atlas_block_size(chima_u32 block) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_block_size(_chima, block);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_atlas_bleed(chima_u32 radius) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_bleed(_chima, radius);
+    return static_cast<Derived&>(*this);
+  }
+
+  Derived& set_atlas_best_of(chima_bitfield packers) {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_set_atlas_best_of(_chima, packers);
+    return static_cast<Derived&>(*this);
+  }
+
+public:
+  chima_atlas_stats atlas_stats() const {
+    CHIMA_ASSERT(!_is_empty(_chima));
+    chima_atlas_stats stats;
+    chima_get_atlas_stats(_chima, &stats);
+    return stats;
+  }
+
 public:
   chima_context get() const {
     CHIMA_ASSERT(!_is_empty(_chima));
@@ -263,6 +367,18 @@ CHIMA_DEFINE_DELETER(chima_sheet_data, data) {
   chima_destroy_sheet_data(data);
 }
 
+CHIMA_DEFINE_DELETER(chima_dyn_atlas, atlas) {
+  chima_destroy_dyn_atlas(atlas);
+}
+
+CHIMA_DEFINE_DELETER(chima_anim_decoder, decoder) {
+  chima_destroy_anim_decoder(decoder);
+}
+
+CHIMA_DEFINE_DELETER(chima_dirty_tracker, tracker) {
+  chima_destroy_dirty_tracker(tracker);
+}
+
 // Non owning `chima_context`
 class context_view : public impl::context_base<context_view> {
 private:
@@ -459,6 +575,26 @@ public:
     return std::optional<::chima::image>{std::in_place, create_t{}, std::move(image)};
   }
 
+  static std::optional<::chima::image> make_blank(chima_context chima, chima_u32 width,
+                                                  chima_u32 height, chima_u32 channels,
+                                                  chima_image_depth depth,
+                                                  const chima_color& color, chima_fill_mode mode,
+                                                  ::chima::error* err = nullptr) noexcept {
+    if (!chima) {
+      return std::nullopt;
+    }
+    chima_image image;
+    const auto res =
+      chima_gen_blank_image_ex(chima, &image, width, height, channels, depth, color, mode);
+    if (res != CHIMA_NO_ERROR) {
+      if (err) {
+        *err = res;
+      }
+      return std::nullopt;
+    }
+    return std::optional<::chima::image>{std::in_place, create_t{}, std::move(image)};
+  }
+
   static std::optional<::chima::image> make_blank(chima_context chima, chima_extent2d extent,
                                                   chima_u32 channels, chima_image_depth depth,
                                                   const chima_color& color,
@@ -497,6 +633,12 @@ public:
     CHIMA_FILL_ERR_OR_THROW(err, res);
   }
 
+  void fill(const chima_color& color, chima_dirty_tracker dirty = nullptr,
+            ::chima::error* err = nullptr) {
+    const auto res = chima_fill_image(&get(), color, dirty);
+    CHIMA_FILL_ERR_OR_THROW(err, res);
+  }
+
   void composite(const chima_image& src, chima_u32 xpos, chima_u32 ypos,
                  ::chima::error* err = nullptr) {
     const auto res = chima_composite_image(&get(), &src, xpos, ypos);
@@ -507,12 +649,103 @@ public:
     const auto res = chima_composite_image(&get(), &src.get(), xpos, ypos);
     CHIMA_FILL_ERR_OR_THROW(err, res);
   }
+
+  void composite(const chima_image& src, chima_u32 xpos, chima_u32 ypos, chima_blend_mode mode,
+                 chima_dirty_tracker dirty = nullptr, ::chima::error* err = nullptr) {
+    const auto res = chima_composite_image_ex(&get(), &src, xpos, ypos, mode, dirty);
+    CHIMA_FILL_ERR_OR_THROW(err, res);
+  }
+
+  void composite(const image& src, chima_u32 xpos, chima_u32 ypos, chima_blend_mode mode,
+                 chima_dirty_tracker dirty = nullptr, ::chima::error* err = nullptr) {
+    const auto res = chima_composite_image_ex(&get(), &src.get(), xpos, ypos, mode, dirty);
+    CHIMA_FILL_ERR_OR_THROW(err, res);
+  }
 };
 
 CHIMA_DEFINE_DELETER(::chima::image, image) {
   ::chima::image::destroy(_chima, image);
 }
 
+class dirty_tracker {
+private:
+  struct create_t {};
+
+public:
+  using deleter_type = ::chima::chima_deleter<::chima::dirty_tracker>;
+
+public:
+  dirty_tracker(create_t, chima_dirty_tracker tracker) noexcept : _tracker(tracker) {}
+
+  explicit dirty_tracker(chima_dirty_tracker tracker) : _tracker(tracker) {
+    CHIMA_ASSERT(tracker != nullptr);
+  }
+
+  dirty_tracker(chima_context chima, const chima_image& image) {
+    CHIMA_THROW_IF(!chima, ::chima::error(CHIMA_INVALID_VALUE));
+    chima_dirty_tracker tracker;
+    const auto res = chima_create_dirty_tracker(chima, &tracker, &image);
+    CHIMA_THROW_IF(res != CHIMA_NO_ERROR, ::chima::error(res));
+    _tracker = tracker;
+  }
+
+public:
+  static std::optional<::chima::dirty_tracker> create(chima_context chima,
+                                                      const chima_image& image,
+                                                      ::chima::error* err = nullptr) noexcept {
+    if (!chima) {
+      return std::nullopt;
+    }
+    chima_dirty_tracker tracker;
+    const auto res = chima_create_dirty_tracker(chima, &tracker, &image);
+    if (res != CHIMA_NO_ERROR) {
+      if (err) {
+        *err = res;
+      }
+      return std::nullopt;
+    }
+    return std::optional<::chima::dirty_tracker>{std::in_place, create_t{}, tracker};
+  }
+
+public:
+  static void destroy(chima_context, ::chima::dirty_tracker& tracker) {
+    chima_destroy_dirty_tracker(tracker.get());
+    tracker._tracker = nullptr;
+  }
+
+public:
+  dirty_tracker& mark(const chima_rect& rect, ::chima::error* err = nullptr) {
+    const auto res = chima_dirty_tracker_mark(get(), rect);
+    CHIMA_FILL_ERR_OR_THROW(err, res);
+    return *this;
+  }
+
+  // Returns the number of dirty rects, `rects` points to them until the next flush
+  chima_size flush(const chima_rect*& rects, ::chima::error* err = nullptr) {
+    chima_size count = 0;
+    rects = nullptr;
+    const auto res = chima_dirty_tracker_flush(get(), &rects, &count);
+    CHIMA_FILL_ERR_OR_THROW(err, res);
+    return count;
+  }
+
+public:
+  chima_dirty_tracker get() const noexcept {
+    CHIMA_ASSERT(_tracker);
+    return _tracker;
+  }
+
+public:
+  operator chima_dirty_tracker() const noexcept { return get(); }
+
+private:
+  chima_dirty_tracker _tracker;
+};
+
+CHIMA_DEFINE_DELETER(::chima::dirty_tracker, tracker) {
+  ::chima::dirty_tracker::destroy(_chima, tracker);
+}
+
 class image_anim : private ::chima_image_anim {
 private:
   struct create_t {};
@@ -845,6 +1078,207 @@ CHIMA_DEFINE_DELETER(::chima::sheet_data, data) {
   ::chima::sheet_data::destroy(_chima, data);
 }
 
+class dyn_atlas {
+private:
+  struct create_t {};
+
+public:
+  using deleter_type = ::chima::chima_deleter<::chima::dyn_atlas>;
+
+public:
+  dyn_atlas(create_t, chima_dyn_atlas atlas) noexcept : _atlas(atlas) {}
+
+  explicit dyn_atlas(chima_dyn_atlas atlas) : _atlas(atlas) { CHIMA_ASSERT(atlas != nullptr); }
+
+  dyn_atlas(chima_context chima, chima_u32 width, chima_u32 height, chima_u32 channels,
+            chima_image_depth depth, chima_u32 padding, const chima_color& background_color) {
+    CHIMA_THROW_IF(!chima, ::chima::error(CHIMA_INVALID_VALUE));
+    chima_dyn_atlas atlas;
+    const auto res = chima_create_dyn_atlas(chima, &atlas, width, height, channels, depth,
+                                            padding, background_color);
+    CHIMA_THROW_IF(res != CHIMA_NO_ERROR, ::chima::error(res));
+    _atlas = atlas;
+  }
+
+public:
+  static std::optional<::chima::dyn_atlas>
+  create(chima_context chima, chima_u32 width, chima_u32 height, chima_u32 channels,
+         chima_image_depth depth, chima_u32 padding, const chima_color& background_color,
+         ::chima::error* err = nullptr) noexcept {
+    if (!chima) {
+      return std::nullopt;
+    }
+    chima_dyn_atlas atlas;
+    const auto res = chima_create_dyn_atlas(chima, &atlas, width, height, channels, depth,
+                                            padding, background_color);
+    if (res != CHIMA_NO_ERROR) {
+      if (err) {
+        *err = res;
+      }
+      return std::nullopt;
+    }
+    return std::optional<::chima::dyn_atlas>{std::in_place, create_t{}, atlas};
+  }
+
+public:
+  static void destroy(chima_context, ::chima::dyn_atlas& atlas) {
+    chima_destroy_dyn_atlas(atlas.get());
+    atlas._atlas = nullptr;
+  }
+
+public:
+  // Returns 0 if the image was not inserted
+  chima_dyn_sprite insert(const chima_image& image, bool evict = false,
+                          ::chima::rect* rect = nullptr, ::chima::error* err = nullptr) {
+    chima_dyn_sprite sprite = 0;
+    const auto res = chima_dyn_atlas_insert(get(), &image, evict, &sprite, rect);
+    CHIMA_FILL_ERR_OR_THROW(err, res);
+    return res == CHIMA_NO_ERROR ? sprite : 0;
+  }
+
+  chima_dyn_sprite insert(const ::chima::image& image, bool evict = false,
+                          ::chima::rect* rect = nullptr, ::chima::error* err = nullptr) {
+    return insert(image.get(), evict, rect, err);
+  }
+
+  dyn_atlas& remove(chima_dyn_sprite sprite, ::chima::error* err = nullptr) {
+    const auto res = chima_dyn_atlas_remove(get(), sprite);
+    CHIMA_FILL_ERR_OR_THROW(err, res);
+    return *this;
+  }
+
+  dyn_atlas& touch(chima_dyn_sprite sprite, ::chima::error* err = nullptr) {
+    const auto res = chima_dyn_atlas_touch(get(), sprite);
+    CHIMA_FILL_ERR_OR_THROW(err, res);
+    return *this;
+  }
+
+  std::optional<::chima::rect> sprite_rect(chima_dyn_sprite sprite) const noexcept {
+    ::chima::rect rect;
+    if (chima_dyn_atlas_get_rect(get(), sprite, &rect) != CHIMA_NO_ERROR) {
+      return std::nullopt;
+    }
+    return rect;
+  }
+
+  bool contains(chima_dyn_sprite sprite) const noexcept { return sprite_rect(sprite).has_value(); }
+
+  dyn_atlas& set_evict_callback(PFN_chima_dyn_evict callback, void* user = nullptr) noexcept {
+    chima_dyn_atlas_set_evict_callback(get(), callback, user);
+    return *this;
+  }
+
+public:
+  chima_size sprite_count() const noexcept { return chima_dyn_atlas_sprite_count(get()); }
+
+  const chima_image& image() const noexcept { return *chima_dyn_atlas_image(get()); }
+
+  // Owned by the atlas, don't destroy it
+  chima_dirty_tracker dirty_tracker() const noexcept {
+    return chima_dyn_atlas_dirty_tracker(get());
+  }
+
+  chima_dyn_atlas get() const noexcept {
+    CHIMA_ASSERT(_atlas);
+    return _atlas;
+  }
+
+public:
+  operator chima_dyn_atlas() const noexcept { return get(); }
+
+private:
+  chima_dyn_atlas _atlas;
+};
+
+CHIMA_DEFINE_DELETER(::chima::dyn_atlas, atlas) {
+  ::chima::dyn_atlas::destroy(_chima, atlas);
+}
+
+class anim_decoder {
+private:
+  struct create_t {};
+
+public:
+  using deleter_type = ::chima::chima_deleter<::chima::anim_decoder>;
+
+public:
+  anim_decoder(create_t, chima_anim_decoder decoder) noexcept : _decoder(decoder) {}
+
+  explicit anim_decoder(chima_anim_decoder decoder) : _decoder(decoder) {
+    CHIMA_ASSERT(decoder != nullptr);
+  }
+
+  anim_decoder(chima_context chima, const char* path, chima_size memory_budget) {
+    CHIMA_THROW_IF(!chima, ::chima::error(CHIMA_INVALID_VALUE));
+    chima_anim_decoder decoder;
+    const auto res = chima_create_anim_decoder(chima, &decoder, path, memory_budget);
+    CHIMA_THROW_IF(res != CHIMA_NO_ERROR, ::chima::error(res));
+    _decoder = decoder;
+  }
+
+public:
+  static std::optional<::chima::anim_decoder> create(chima_context chima, const char* path,
+                                                     chima_size memory_budget,
+                                                     ::chima::error* err = nullptr) noexcept {
+    if (!chima) {
+      return std::nullopt;
+    }
+    chima_anim_decoder decoder;
+    const auto res = chima_create_anim_decoder(chima, &decoder, path, memory_budget);
+    if (res != CHIMA_NO_ERROR) {
+      if (err) {
+        *err = res;
+      }
+      return std::nullopt;
+    }
+    return std::optional<::chima::anim_decoder>{std::in_place, create_t{}, decoder};
+  }
+
+public:
+  static void destroy(chima_context, ::chima::anim_decoder& decoder) {
+    chima_destroy_anim_decoder(decoder.get());
+    decoder._decoder = nullptr;
+  }
+
+public:
+  // Returns `nullptr` after the last frame
+  const chima_image* next(chima_u32* frametime = nullptr, ::chima::error* err = nullptr) {
+    const chima_image* frame = nullptr;
+    const auto res = chima_anim_decoder_next(get(), &frame, frametime);
+    if (res == CHIMA_FILE_EOF) {
+      return nullptr;
+    }
+    CHIMA_FILL_ERR_OR_THROW(err, res);
+    return res == CHIMA_NO_ERROR ? frame : nullptr;
+  }
+
+  anim_decoder& seek(chima_size frame, ::chima::error* err = nullptr) {
+    const auto res = chima_anim_decoder_seek(get(), frame);
+    CHIMA_FILL_ERR_OR_THROW(err, res);
+    return *this;
+  }
+
+public:
+  chima_size tell() const noexcept { return chima_anim_decoder_tell(get()); }
+
+  chima_size frame_count() const noexcept { return chima_anim_decoder_frame_count(get()); }
+
+  chima_anim_decoder get() const noexcept {
+    CHIMA_ASSERT(_decoder);
+    return _decoder;
+  }
+
+public:
+  operator chima_anim_decoder() const noexcept { return get(); }
+
+private:
+  chima_anim_decoder _decoder;
+};
+
+CHIMA_DEFINE_DELETER(::chima::anim_decoder, decoder) {
+  ::chima::anim_decoder::destroy(_chima, decoder);
+}
+
 class spritesheet : private ::chima_spritesheet {
 private:
   struct create_t {};
@@ -859,7 +1293,7 @@ public:
     explicit sprite(chima_sprite spr) noexcept : chima_sprite(spr) {}
 
     sprite(chima_string name, chima_rect rect, chima_u32 frametime) noexcept :
-        chima_sprite{name, rect, frametime} {}
+        chima_sprite{name, rect, frametime, {rect.width, rect.height}, 0, 0, CHIMA_FALSE, 0} {}
 
   public:
     const chima_sprite& get() const noexcept { return static_cast<const chima_sprite&>(*this); }
@@ -872,6 +1306,16 @@ public:
     chima_rect rect() const noexcept { return get().rect; }
 
     chima_u32 frametime() const noexcept { return get().frametime; }
+
+    chima_extent2d source_extent() const noexcept { return get().source_extent; }
+
+    std::pair<chima_u32, chima_u32> trim_offset() const noexcept {
+      return std::make_pair(get().trim_x, get().trim_y);
+    }
+
+    bool rotated() const noexcept { return get().rotated; }
+
+    chima_u32 page() const noexcept { return get().page; }
   };
 
   struct sprite_anim : private ::chima_sprite_anim {
@@ -924,9 +1368,11 @@ public:
   explicit spritesheet(chima_spritesheet sheet) : chima_spritesheet(sheet) {
     CHIMA_ASSERT(sheet.sprites != nullptr);
     CHIMA_ASSERT(sheet.sprite_count > 0);
-    CHIMA_ASSERT(sheet.atlas.data != nullptr);
-    CHIMA_ASSERT(sheet.atlas.channels > 0 && sheet.atlas.channels <= 4);
-    CHIMA_ASSERT(::chima::image_bytes(sheet.atlas) > 0);
+    CHIMA_ASSERT(sheet.pages != nullptr);
+    CHIMA_ASSERT(sheet.page_count > 0);
+    CHIMA_ASSERT(sheet.pages[0].data != nullptr);
+    CHIMA_ASSERT(sheet.pages[0].channels > 0 && sheet.pages[0].channels <= 4);
+    CHIMA_ASSERT(::chima::image_bytes(sheet.pages[0]) > 0);
   }
 
   spritesheet(chima_context chima, chima_sheet_data data, chima_u32 padding,
@@ -1050,10 +1496,17 @@ public:
 
   chima_size anim_count() const noexcept { return get().anim_count; }
 
+  chima_size page_count() const noexcept { return get().page_count; }
+
 #ifdef CHIMA_NO_DOWNCASTING
-  const chima_image& atlas() const noexcept { return get().atlas; }
+  const chima_image& atlas(chima_size page = 0) const noexcept {
+    CHIMA_ASSERT(page < page_count());
+    return get().pages[page];
+  }
 
-  chima_image& atlas() noexcept { return const_cast<chima_image&>(std::as_const(*this).atlas()); }
+  chima_image& atlas(chima_size page = 0) noexcept {
+    return const_cast<chima_image&>(std::as_const(*this).atlas(page));
+  }
 
   const chima_sprite* sprites() const noexcept { return get().sprites; }
 
@@ -1079,16 +1532,17 @@ public:
   std::span<chima_sprite_anim> anim_span() noexcept { return {anims(), anim_count()}; }
 #endif
 #else
-  const ::chima::image& atlas() const noexcept {
+  const ::chima::image& atlas(chima_size page = 0) const noexcept {
     // Downcasting like this is probably violates strict aliasing
     // But it should be fine as long as they are the same size?
     static_assert(sizeof(::chima::image) == sizeof(::chima_image));
     static_assert(alignof(::chima::image) == alignof(::chima_image));
-    return *reinterpret_cast<const ::chima::image*>(&get().atlas);
+    CHIMA_ASSERT(page < page_count());
+    return reinterpret_cast<const ::chima::image*>(get().pages)[page];
   }
 
-  ::chima::image& atlas() noexcept {
-    return const_cast<::chima::image&>(std::as_const(*this).atlas());
+  ::chima::image& atlas(chima_size page = 0) noexcept {
+    return const_cast<::chima::image&>(std::as_const(*this).atlas(page));
   }
 
   const sprite* sprites() const noexcept {
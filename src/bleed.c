@@ -0,0 +1,105 @@
+#include "./internal.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Alpha bleeding.
+ *
+ * Fully transparent texels take the average color of the opaque texels in the closest ring
+ * around them that has any, searching up to the bleed radius. Bilinear filtering then blends
+ * sprite edges with their own colors instead of the background.
+ *
+ * The colors are read from the source image, never from the atlas, so every row of a sprite can
+ * be bled on its own by the band that copies it. Only transparent texels search, which is also
+ * where trimmed sprites have the fewest texels.
+ */
+
+static chima_f32 load_comp(const chima_u8* texel, chima_image_depth depth, chima_u32 comp) {
+  switch (depth) {
+    case CHIMA_DEPTH_8U: return (chima_f32)texel[comp];
+    case CHIMA_DEPTH_16U: {
+      chima_u16 value;
+      memcpy(&value, texel + comp * sizeof(value), sizeof(value));
+      return (chima_f32)value;
+    }
+    case CHIMA_DEPTH_32F: {
+      chima_f32 value;
+      memcpy(&value, texel + comp * sizeof(value), sizeof(value));
+      return value;
+    }
+    default: CHIMA_UNREACHABLE();
+  }
+}
+
+static void store_comp(chima_u8* texel, chima_image_depth depth, chima_u32 comp,
+                       chima_f32 value) {
+  switch (depth) {
+    case CHIMA_DEPTH_8U: texel[comp] = (chima_u8)lrintf(value); break;
+    case CHIMA_DEPTH_16U: {
+      const chima_u16 out = (chima_u16)lrintf(value);
+      memcpy(texel + comp * sizeof(out), &out, sizeof(out));
+    } break;
+    case CHIMA_DEPTH_32F: memcpy(texel + comp * sizeof(value), &value, sizeof(value)); break;
+    default: CHIMA_UNREACHABLE();
+  }
+}
+
+void chima__bleed_row(chima_u8* dst, const chima_image* src, const chima_rect* slice,
+                      chima_u32 row, chima_bool rotated, chima_u32 radius) {
+  const chima_u32 channels = src->channels;
+  if (!radius || (channels != 2 && channels != 4)) {
+    return; // Nothing to bleed without alpha
+  }
+  const chima_image_depth depth = src->depth;
+  const chima_u32 alpha = channels - 1;
+  const chima_size texel_size = channels * chima__depth_size(depth);
+  const chima_size src_stride = (chima_size)src->extent.width * texel_size;
+  const chima_u8* src_data = (const chima_u8*)src->data + slice->y * src_stride +
+                             slice->x * texel_size;
+  const int32_t width = (int32_t)slice->width, height = (int32_t)slice->height;
+  const chima_u32 texels = rotated ? slice->height : slice->width;
+
+  for (chima_u32 i = 0; i < texels; ++i) {
+    chima_u8* texel = dst + i * texel_size;
+    if (load_comp(texel, depth, alpha) > 0.f) {
+      continue;
+    }
+    // Rotated rows run up the source columns
+    const int32_t sx = rotated ? (int32_t)row : (int32_t)i;
+    const int32_t sy = rotated ? height - 1 - (int32_t)i : (int32_t)row;
+
+    chima_f32 sum[3] = {0.f, 0.f, 0.f};
+    chima_u32 count = 0;
+    for (int32_t d = 1; d <= (int32_t)radius && !count; ++d) {
+      for (int32_t dy = -d; dy <= d; ++dy) {
+        const int32_t y = sy + dy;
+        if (y < 0 || y >= height) {
+          continue;
+        }
+        // Whole row on the ring edges, only both ends in between
+        const int32_t step = (dy == -d || dy == d) ? 1 : 2 * d;
+        for (int32_t dx = -d; dx <= d; dx += step) {
+          const int32_t x = sx + dx;
+          if (x < 0 || x >= width) {
+            continue;
+          }
+          const chima_u8* near =
+            src_data + (chima_size)y * src_stride + (chima_size)x * texel_size;
+          if (load_comp(near, depth, alpha) > 0.f) {
+            for (chima_u32 c = 0; c < alpha; ++c) {
+              sum[c] += load_comp(near, depth, c);
+            }
+            ++count;
+          }
+        }
+      }
+    }
+    if (count) {
+      for (chima_u32 c = 0; c < alpha; ++c) {
+        store_comp(texel, depth, c, sum[c] / (chima_f32)count);
+      }
+    }
+  }
+}
@@ -0,0 +1,950 @@
+#include "./internal.h"
+
+#include <string.h>
+
+#ifdef CHIMA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/*
+ * Image compositing.
+ *
+ * Every 8U row is converted to RGBA8 (gray is expanded, a missing alpha channel is opaque), blended
+ * with the selected operator using fixed point math, and converted back to the destination
+ * channel count. The scalar kernels are the reference, the SIMD kernels produce the exact same
+ * bytes. `div255` is the exact rounding division by 255.
+ *
+ * Straight alpha "over":
+ *   t  = div255(da * (255 - sa))
+ *   oa = sa + t
+ *   oc = ((sc * sa + dc * t) * rcp(oa) + 0x8000) >> 16
+ *   Where `rcp(a) = round(0x10000 / a)` (clamped to 16 bits).
+ *
+ * Premultiplied "over" (saturated):
+ *   o = s + div255(d * (255 - sa))
+ *
+ * Additive (saturated):
+ *   oc = dc + div255(sc * sa)
+ *   oa = da + sa
+ *
+ * Replace just copies the converted source pixels.
+ *
+ * 16U and 32F rows are converted to RGBA floats instead, see `PFN_blend_rgbaf`.
+ */
+
+#define COMPOSITE_CHUNK 256 // Pixels converted per iteration when the row is not RGBA
+
+// `rcp(a)` splatted on both 16 bit halves, so SIMD kernels can broadcast it with a 32 bit load.
+static const chima_u32 blend_rcp_tab[256] = {
+  0x00000000, 0xFFFFFFFF, 0x80008000, 0x55555555, 0x40004000, 0x33333333,
+  0x2AAB2AAB, 0x24922492, 0x20002000, 0x1C721C72, 0x199A199A, 0x17461746,
+  0x15551555, 0x13B113B1, 0x12491249, 0x11111111, 0x10001000, 0x0F0F0F0F,
+  0x0E390E39, 0x0D790D79, 0x0CCD0CCD, 0x0C310C31, 0x0BA30BA3, 0x0B210B21,
+  0x0AAB0AAB, 0x0A3D0A3D, 0x09D909D9, 0x097B097B, 0x09250925, 0x08D408D4,
+  0x08890889, 0x08420842, 0x08000800, 0x07C207C2, 0x07880788, 0x07500750,
+  0x071C071C, 0x06EB06EB, 0x06BD06BD, 0x06900690, 0x06660666, 0x063E063E,
+  0x06180618, 0x05F405F4, 0x05D105D1, 0x05B005B0, 0x05910591, 0x05720572,
+  0x05550555, 0x05390539, 0x051F051F, 0x05050505, 0x04EC04EC, 0x04D504D5,
+  0x04BE04BE, 0x04A804A8, 0x04920492, 0x047E047E, 0x046A046A, 0x04570457,
+  0x04440444, 0x04320432, 0x04210421, 0x04100410, 0x04000400, 0x03F003F0,
+  0x03E103E1, 0x03D203D2, 0x03C403C4, 0x03B603B6, 0x03A803A8, 0x039B039B,
+  0x038E038E, 0x03820382, 0x03760376, 0x036A036A, 0x035E035E, 0x03530353,
+  0x03480348, 0x033E033E, 0x03330333, 0x03290329, 0x031F031F, 0x03160316,
+  0x030C030C, 0x03030303, 0x02FA02FA, 0x02F102F1, 0x02E902E9, 0x02E002E0,
+  0x02D802D8, 0x02D002D0, 0x02C802C8, 0x02C102C1, 0x02B902B9, 0x02B202B2,
+  0x02AB02AB, 0x02A402A4, 0x029D029D, 0x02960296, 0x028F028F, 0x02890289,
+  0x02830283, 0x027C027C, 0x02760276, 0x02700270, 0x026A026A, 0x02640264,
+  0x025F025F, 0x02590259, 0x02540254, 0x024E024E, 0x02490249, 0x02440244,
+  0x023F023F, 0x023A023A, 0x02350235, 0x02300230, 0x022B022B, 0x02270227,
+  0x02220222, 0x021E021E, 0x02190219, 0x02150215, 0x02110211, 0x020C020C,
+  0x02080208, 0x02040204, 0x02000200, 0x01FC01FC, 0x01F801F8, 0x01F401F4,
+  0x01F001F0, 0x01ED01ED, 0x01E901E9, 0x01E501E5, 0x01E201E2, 0x01DE01DE,
+  0x01DB01DB, 0x01D701D7, 0x01D401D4, 0x01D101D1, 0x01CE01CE, 0x01CA01CA,
+  0x01C701C7, 0x01C401C4, 0x01C101C1, 0x01BE01BE, 0x01BB01BB, 0x01B801B8,
+  0x01B501B5, 0x01B201B2, 0x01AF01AF, 0x01AC01AC, 0x01AA01AA, 0x01A701A7,
+  0x01A401A4, 0x01A101A1, 0x019F019F, 0x019C019C, 0x019A019A, 0x01970197,
+  0x01950195, 0x01920192, 0x01900190, 0x018D018D, 0x018B018B, 0x01880188,
+  0x01860186, 0x01840184, 0x01820182, 0x017F017F, 0x017D017D, 0x017B017B,
+  0x01790179, 0x01760176, 0x01740174, 0x01720172, 0x01700170, 0x016E016E,
+  0x016C016C, 0x016A016A, 0x01680168, 0x01660166, 0x01640164, 0x01620162,
+  0x01600160, 0x015E015E, 0x015D015D, 0x015B015B, 0x01590159, 0x01570157,
+  0x01550155, 0x01540154, 0x01520152, 0x01500150, 0x014E014E, 0x014D014D,
+  0x014B014B, 0x01490149, 0x01480148, 0x01460146, 0x01440144, 0x01430143,
+  0x01410141, 0x01400140, 0x013E013E, 0x013D013D, 0x013B013B, 0x013A013A,
+  0x01380138, 0x01370137, 0x01350135, 0x01340134, 0x01320132, 0x01310131,
+  0x012F012F, 0x012E012E, 0x012D012D, 0x012B012B, 0x012A012A, 0x01290129,
+  0x01270127, 0x01260126, 0x01250125, 0x01230123, 0x01220122, 0x01210121,
+  0x011F011F, 0x011E011E, 0x011D011D, 0x011C011C, 0x011A011A, 0x01190119,
+  0x01180118, 0x01170117, 0x01160116, 0x01150115, 0x01130113, 0x01120112,
+  0x01110111, 0x01100110, 0x010F010F, 0x010E010E, 0x010D010D, 0x010B010B,
+  0x010A010A, 0x01090109, 0x01080108, 0x01070107, 0x01060106, 0x01050105,
+  0x01040104, 0x01030103, 0x01020102, 0x01010101,
+};
+
+typedef void (*PFN_blend_rgba8)(chima_u8* dst, const chima_u8* src, chima_size count);
+
+static inline chima_u32 div255(chima_u32 x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+static void blend_over_rgba8_scalar(chima_u8* dst, const chima_u8* src, chima_size count) {
+  for (chima_size i = 0; i < count; ++i, dst += 4, src += 4) {
+    const chima_u32 sa = src[3];
+    const chima_u32 t = div255(dst[3] * (255 - sa));
+    const chima_u32 oa = sa + t;
+    const chima_u32 rcp = blend_rcp_tab[oa] & 0xFFFF;
+    for (chima_u32 c = 0; c < 3; ++c) {
+      const chima_u32 num = src[c] * sa + dst[c] * t;
+      dst[c] = (chima_u8)((num * rcp + 0x8000) >> 16);
+    }
+    dst[3] = (chima_u8)oa;
+  }
+}
+
+static void blend_premul_over_rgba8_scalar(chima_u8* dst, const chima_u8* src,
+                                           chima_size count) {
+  for (chima_size i = 0; i < count; ++i, dst += 4, src += 4) {
+    const chima_u32 isa = 255 - src[3];
+    for (chima_u32 c = 0; c < 4; ++c) {
+      const chima_u32 o = src[c] + div255(dst[c] * isa);
+      dst[c] = (chima_u8)(o > 255 ? 255 : o);
+    }
+  }
+}
+
+static void blend_add_rgba8_scalar(chima_u8* dst, const chima_u8* src, chima_size count) {
+  for (chima_size i = 0; i < count; ++i, dst += 4, src += 4) {
+    const chima_u32 sa = src[3];
+    for (chima_u32 c = 0; c < 3; ++c) {
+      const chima_u32 o = dst[c] + div255(src[c] * sa);
+      dst[c] = (chima_u8)(o > 255 ? 255 : o);
+    }
+    const chima_u32 oa = dst[3] + sa;
+    dst[3] = (chima_u8)(oa > 255 ? 255 : oa);
+  }
+}
+
+static void blend_replace_rgba8(chima_u8* dst, const chima_u8* src, chima_size count) {
+  memcpy(dst, src, count * 4);
+}
+
+#ifdef CHIMA_X86_SIMD
+// Blends two pixels stored as 16 bit lanes, `sa`, `t` and `rcp` are splatted per pixel.
+CHIMA_TARGET("sse2")
+static inline __m128i blend_lanes_sse2(__m128i s, __m128i d, __m128i sa, __m128i t, __m128i rcp) {
+  const __m128i num = _mm_add_epi16(_mm_mullo_epi16(s, sa), _mm_mullo_epi16(d, t));
+  return _mm_add_epi16(_mm_mulhi_epu16(num, rcp), _mm_srli_epi16(_mm_mullo_epi16(num, rcp), 15));
+}
+
+CHIMA_TARGET("sse2")
+static void blend_over_rgba8_sse2(chima_u8* dst, const chima_u8* src, chima_size count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i c128 = _mm_set1_epi32(128);
+  const __m128i c255 = _mm_set1_epi32(255);
+  const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+  chima_size i = 0;
+  for (; i + 4 <= count; i += 4, dst += 16, src += 16) {
+    const __m128i s = _mm_loadu_si128((const __m128i*)src);
+    const __m128i sa = _mm_srli_epi32(s, 24);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, c255)) == 0xFFFF) {
+      _mm_storeu_si128((__m128i*)dst, s); // Opaque source, "over" is a copy
+      continue;
+    }
+    const __m128i d = _mm_loadu_si128((const __m128i*)dst);
+    const __m128i da = _mm_srli_epi32(d, 24);
+
+    // Per pixel terms in 32 bit lanes. The products fit in 16 bits.
+    __m128i t = _mm_add_epi32(_mm_mullo_epi16(da, _mm_sub_epi32(c255, sa)), c128);
+    t = _mm_srli_epi32(_mm_add_epi32(t, _mm_srli_epi32(t, 8)), 8);
+    const __m128i oa = _mm_add_epi32(sa, t);
+
+    _Alignas(16) chima_u32 oa_idx[4];
+    _mm_store_si128((__m128i*)oa_idx, oa);
+    const __m128i rcp =
+      _mm_set_epi32((int)blend_rcp_tab[oa_idx[3]], (int)blend_rcp_tab[oa_idx[2]],
+                    (int)blend_rcp_tab[oa_idx[1]], (int)blend_rcp_tab[oa_idx[0]]);
+    const __m128i sa2 = _mm_or_si128(sa, _mm_slli_epi32(sa, 16));
+    const __m128i t2 = _mm_or_si128(t, _mm_slli_epi32(t, 16));
+
+    const __m128i lo = blend_lanes_sse2(
+      _mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(sa2, sa2),
+      _mm_unpacklo_epi32(t2, t2), _mm_unpacklo_epi32(rcp, rcp));
+    const __m128i hi = blend_lanes_sse2(
+      _mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(sa2, sa2),
+      _mm_unpackhi_epi32(t2, t2), _mm_unpackhi_epi32(rcp, rcp));
+
+    __m128i out = _mm_andnot_si128(alpha_mask, _mm_packus_epi16(lo, hi));
+    out = _mm_or_si128(out, _mm_slli_epi32(oa, 24));
+    _mm_storeu_si128((__m128i*)dst, out);
+  }
+  blend_over_rgba8_scalar(dst, src, count - i);
+}
+
+// Rounding division by 255 of 16 bit lanes holding values up to 255*255
+CHIMA_TARGET("sse2")
+static inline __m128i div255_sse2(__m128i x) {
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Broadcast the alpha of the two pixels stored in 16 bit lanes
+CHIMA_TARGET("sse2")
+static inline __m128i splat_alpha_sse2(__m128i px) {
+  return _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, 0xFF), 0xFF);
+}
+
+CHIMA_TARGET("sse2")
+static void blend_premul_over_rgba8_sse2(chima_u8* dst, const chima_u8* src, chima_size count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i c255 = _mm_set1_epi16(255);
+  chima_size i = 0;
+  for (; i + 4 <= count; i += 4, dst += 16, src += 16) {
+    const __m128i s = _mm_loadu_si128((const __m128i*)src);
+    const __m128i d = _mm_loadu_si128((const __m128i*)dst);
+    const __m128i isa_lo = _mm_sub_epi16(c255, splat_alpha_sse2(_mm_unpacklo_epi8(s, zero)));
+    const __m128i isa_hi = _mm_sub_epi16(c255, splat_alpha_sse2(_mm_unpackhi_epi8(s, zero)));
+    const __m128i lo = div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), isa_lo));
+    const __m128i hi = div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), isa_hi));
+    _mm_storeu_si128((__m128i*)dst, _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+  }
+  blend_premul_over_rgba8_scalar(dst, src, count - i);
+}
+
+CHIMA_TARGET("sse2")
+static void blend_add_rgba8_sse2(chima_u8* dst, const chima_u8* src, chima_size count) {
+  const __m128i zero = _mm_setzero_si128();
+  // The alpha lane is multiplied by 255, so it becomes a plain saturated add
+  const __m128i color_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+  const __m128i alpha_mul = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+  chima_size i = 0;
+  for (; i + 4 <= count; i += 4, dst += 16, src += 16) {
+    const __m128i s = _mm_loadu_si128((const __m128i*)src);
+    const __m128i d = _mm_loadu_si128((const __m128i*)dst);
+    const __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+    const __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+    const __m128i m_lo = _mm_or_si128(_mm_and_si128(splat_alpha_sse2(s_lo), color_mask), alpha_mul);
+    const __m128i m_hi = _mm_or_si128(_mm_and_si128(splat_alpha_sse2(s_hi), color_mask), alpha_mul);
+    const __m128i lo = div255_sse2(_mm_mullo_epi16(s_lo, m_lo));
+    const __m128i hi = div255_sse2(_mm_mullo_epi16(s_hi, m_hi));
+    _mm_storeu_si128((__m128i*)dst, _mm_adds_epu8(d, _mm_packus_epi16(lo, hi)));
+  }
+  blend_add_rgba8_scalar(dst, src, count - i);
+}
+
+CHIMA_TARGET("avx2")
+static inline __m256i blend_lanes_avx2(__m256i s, __m256i d, __m256i sa, __m256i t,
+                                       __m256i rcp) {
+  const __m256i num = _mm256_add_epi16(_mm256_mullo_epi16(s, sa), _mm256_mullo_epi16(d, t));
+  return _mm256_add_epi16(_mm256_mulhi_epu16(num, rcp),
+                          _mm256_srli_epi16(_mm256_mullo_epi16(num, rcp), 15));
+}
+
+CHIMA_TARGET("avx2")
+static void blend_over_rgba8_avx2(chima_u8* dst, const chima_u8* src, chima_size count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i c128 = _mm256_set1_epi32(128);
+  const __m256i c255 = _mm256_set1_epi32(255);
+  const __m256i alpha_mask = _mm256_set1_epi32((int)0xFF000000);
+  chima_size i = 0;
+  for (; i + 8 <= count; i += 8, dst += 32, src += 32) {
+    const __m256i s = _mm256_loadu_si256((const __m256i*)src);
+    const __m256i sa = _mm256_srli_epi32(s, 24);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, c255)) == -1) {
+      _mm256_storeu_si256((__m256i*)dst, s);
+      continue;
+    }
+    const __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+    const __m256i da = _mm256_srli_epi32(d, 24);
+
+    __m256i t = _mm256_add_epi32(_mm256_mullo_epi16(da, _mm256_sub_epi32(c255, sa)), c128);
+    t = _mm256_srli_epi32(_mm256_add_epi32(t, _mm256_srli_epi32(t, 8)), 8);
+    const __m256i oa = _mm256_add_epi32(sa, t);
+
+    const __m256i rcp = _mm256_i32gather_epi32((const int*)blend_rcp_tab, oa, 4);
+    const __m256i sa2 = _mm256_or_si256(sa, _mm256_slli_epi32(sa, 16));
+    const __m256i t2 = _mm256_or_si256(t, _mm256_slli_epi32(t, 16));
+
+    // Unpacks work per 128 bit lane, so the splatted terms line up with the unpacked pixels.
+    const __m256i lo =
+      blend_lanes_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero),
+                       _mm256_unpacklo_epi32(sa2, sa2), _mm256_unpacklo_epi32(t2, t2),
+                       _mm256_unpacklo_epi32(rcp, rcp));
+    const __m256i hi =
+      blend_lanes_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero),
+                       _mm256_unpackhi_epi32(sa2, sa2), _mm256_unpackhi_epi32(t2, t2),
+                       _mm256_unpackhi_epi32(rcp, rcp));
+
+    __m256i out = _mm256_andnot_si256(alpha_mask, _mm256_packus_epi16(lo, hi));
+    out = _mm256_or_si256(out, _mm256_slli_epi32(oa, 24));
+    _mm256_storeu_si256((__m256i*)dst, out);
+  }
+  blend_over_rgba8_sse2(dst, src, count - i);
+}
+
+CHIMA_TARGET("avx2")
+static inline __m256i div255_avx2(__m256i x) {
+  x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+CHIMA_TARGET("avx2")
+static inline __m256i splat_alpha_avx2(__m256i px) {
+  return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px, 0xFF), 0xFF);
+}
+
+CHIMA_TARGET("avx2")
+static void blend_premul_over_rgba8_avx2(chima_u8* dst, const chima_u8* src, chima_size count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i c255 = _mm256_set1_epi16(255);
+  chima_size i = 0;
+  for (; i + 8 <= count; i += 8, dst += 32, src += 32) {
+    const __m256i s = _mm256_loadu_si256((const __m256i*)src);
+    const __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+    const __m256i isa_lo =
+      _mm256_sub_epi16(c255, splat_alpha_avx2(_mm256_unpacklo_epi8(s, zero)));
+    const __m256i isa_hi =
+      _mm256_sub_epi16(c255, splat_alpha_avx2(_mm256_unpackhi_epi8(s, zero)));
+    const __m256i lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), isa_lo));
+    const __m256i hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), isa_hi));
+    _mm256_storeu_si256((__m256i*)dst, _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+  }
+  blend_premul_over_rgba8_sse2(dst, src, count - i);
+}
+
+CHIMA_TARGET("avx2")
+static void blend_add_rgba8_avx2(chima_u8* dst, const chima_u8* src, chima_size count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i color_mask =
+    _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+  const __m256i alpha_mul =
+    _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+  chima_size i = 0;
+  for (; i + 8 <= count; i += 8, dst += 32, src += 32) {
+    const __m256i s = _mm256_loadu_si256((const __m256i*)src);
+    const __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+    const __m256i s_lo = _mm256_unpacklo_epi8(s, zero);
+    const __m256i s_hi = _mm256_unpackhi_epi8(s, zero);
+    const __m256i m_lo =
+      _mm256_or_si256(_mm256_and_si256(splat_alpha_avx2(s_lo), color_mask), alpha_mul);
+    const __m256i m_hi =
+      _mm256_or_si256(_mm256_and_si256(splat_alpha_avx2(s_hi), color_mask), alpha_mul);
+    const __m256i lo = div255_avx2(_mm256_mullo_epi16(s_lo, m_lo));
+    const __m256i hi = div255_avx2(_mm256_mullo_epi16(s_hi, m_hi));
+    _mm256_storeu_si256((__m256i*)dst, _mm256_adds_epu8(d, _mm256_packus_epi16(lo, hi)));
+  }
+  blend_add_rgba8_sse2(dst, src, count - i);
+}
+#endif
+
+static PFN_blend_rgba8 select_blend_rgba8(chima_blend_mode mode) {
+  static const PFN_blend_rgba8 scalar[] = {
+    [CHIMA_BLEND_REPLACE] = &blend_replace_rgba8,
+    [CHIMA_BLEND_OVER] = &blend_over_rgba8_scalar,
+    [CHIMA_BLEND_PREMUL_OVER] = &blend_premul_over_rgba8_scalar,
+    [CHIMA_BLEND_ADD] = &blend_add_rgba8_scalar,
+  };
+  CHIMA_STATIC_ASSERT(CHIMA_ARRAY_SIZE(scalar) == _CHIMA_BLEND_COUNT);
+#ifdef CHIMA_X86_SIMD
+  static const PFN_blend_rgba8 sse2[] = {
+    [CHIMA_BLEND_REPLACE] = &blend_replace_rgba8,
+    [CHIMA_BLEND_OVER] = &blend_over_rgba8_sse2,
+    [CHIMA_BLEND_PREMUL_OVER] = &blend_premul_over_rgba8_sse2,
+    [CHIMA_BLEND_ADD] = &blend_add_rgba8_sse2,
+  };
+  static const PFN_blend_rgba8 avx2[] = {
+    [CHIMA_BLEND_REPLACE] = &blend_replace_rgba8,
+    [CHIMA_BLEND_OVER] = &blend_over_rgba8_avx2,
+    [CHIMA_BLEND_PREMUL_OVER] = &blend_premul_over_rgba8_avx2,
+    [CHIMA_BLEND_ADD] = &blend_add_rgba8_avx2,
+  };
+  const chima_bitfield cpu = chima__cpu_features();
+  if (cpu & CHIMA_CPU_FLAG_AVX2) {
+    return avx2[mode];
+  }
+  if (cpu & CHIMA_CPU_FLAG_SSE2) {
+    return sse2[mode];
+  }
+#endif
+  return scalar[mode];
+}
+
+typedef void (*PFN_blend_rgbaf)(chima_f32* dst, const chima_f32* src, chima_size count);
+
+/*
+ * 16U and 32F images are blended as RGBA floats, using the same operators without saturation
+ * (except for alpha in the additive mode). 16U values are rounded and clamped when stored, 32F
+ * values are kept as they are. The SIMD kernels do the same operations in the same order, so
+ * their output matches the scalar kernels.
+ */
+
+static void blend_over_rgbaf_scalar(chima_f32* dst, const chima_f32* src, chima_size count) {
+  for (chima_size i = 0; i < count; ++i, dst += 4, src += 4) {
+    const chima_f32 sa = src[3];
+    const chima_f32 t = dst[3] * (1.f - sa);
+    const chima_f32 oa = sa + t;
+    for (chima_u32 c = 0; c < 3; ++c) {
+      const chima_f32 num = src[c] * sa + dst[c] * t;
+      dst[c] = oa > 0.f ? num / oa : 0.f;
+    }
+    dst[3] = oa;
+  }
+}
+
+static void blend_premul_over_rgbaf_scalar(chima_f32* dst, const chima_f32* src,
+                                           chima_size count) {
+  for (chima_size i = 0; i < count; ++i, dst += 4, src += 4) {
+    const chima_f32 isa = 1.f - src[3];
+    for (chima_u32 c = 0; c < 4; ++c) {
+      dst[c] = src[c] + dst[c] * isa;
+    }
+  }
+}
+
+static void blend_add_rgbaf_scalar(chima_f32* dst, const chima_f32* src, chima_size count) {
+  for (chima_size i = 0; i < count; ++i, dst += 4, src += 4) {
+    const chima_f32 sa = src[3];
+    for (chima_u32 c = 0; c < 3; ++c) {
+      dst[c] = dst[c] + src[c] * sa;
+    }
+    const chima_f32 oa = dst[3] + sa * 1.f;
+    dst[3] = oa < 1.f ? oa : 1.f;
+  }
+}
+
+static void blend_replace_rgbaf(chima_f32* dst, const chima_f32* src, chima_size count) {
+  memcpy(dst, src, count * 4 * sizeof(chima_f32));
+}
+
+#ifdef CHIMA_X86_SIMD
+CHIMA_TARGET("sse2")
+static void blend_over_rgbaf_sse2(chima_f32* dst, const chima_f32* src, chima_size count) {
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 alpha_mask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+  for (chima_size i = 0; i < count; ++i, dst += 4, src += 4) {
+    const __m128 s = _mm_loadu_ps(src);
+    const __m128 d = _mm_loadu_ps(dst);
+    const __m128 sa = _mm_shuffle_ps(s, s, 0xFF);
+    const __m128 t = _mm_mul_ps(_mm_shuffle_ps(d, d, 0xFF), _mm_sub_ps(one, sa));
+    const __m128 oa = _mm_add_ps(sa, t);
+    const __m128 num = _mm_add_ps(_mm_mul_ps(s, sa), _mm_mul_ps(d, t));
+    const __m128 c = _mm_and_ps(_mm_div_ps(num, oa), _mm_cmpgt_ps(oa, zero));
+    _mm_storeu_ps(dst, _mm_or_ps(_mm_andnot_ps(alpha_mask, c), _mm_and_ps(alpha_mask, oa)));
+  }
+}
+
+CHIMA_TARGET("sse2")
+static void blend_premul_over_rgbaf_sse2(chima_f32* dst, const chima_f32* src,
+                                         chima_size count) {
+  const __m128 one = _mm_set1_ps(1.f);
+  for (chima_size i = 0; i < count; ++i, dst += 4, src += 4) {
+    const __m128 s = _mm_loadu_ps(src);
+    const __m128 isa = _mm_sub_ps(one, _mm_shuffle_ps(s, s, 0xFF));
+    _mm_storeu_ps(dst, _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(dst), isa)));
+  }
+}
+
+CHIMA_TARGET("sse2")
+static void blend_add_rgbaf_sse2(chima_f32* dst, const chima_f32* src, chima_size count) {
+  const __m128 alpha_mask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+  const __m128 one_alpha = _mm_and_ps(alpha_mask, _mm_set1_ps(1.f));
+  const __m128 limit = _mm_set_ps(1.f, __builtin_inff(), __builtin_inff(), __builtin_inff());
+  for (chima_size i = 0; i < count; ++i, dst += 4, src += 4) {
+    const __m128 s = _mm_loadu_ps(src);
+    const __m128 m = _mm_or_ps(_mm_andnot_ps(alpha_mask, _mm_shuffle_ps(s, s, 0xFF)), one_alpha);
+    const __m128 o = _mm_add_ps(_mm_loadu_ps(dst), _mm_mul_ps(s, m));
+    _mm_storeu_ps(dst, _mm_min_ps(o, limit));
+  }
+}
+
+CHIMA_TARGET("avx2")
+static void blend_over_rgbaf_avx2(chima_f32* dst, const chima_f32* src, chima_size count) {
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 zero = _mm256_setzero_ps();
+  chima_size i = 0;
+  for (; i + 2 <= count; i += 2, dst += 8, src += 8) {
+    const __m256 s = _mm256_loadu_ps(src);
+    const __m256 d = _mm256_loadu_ps(dst);
+    const __m256 sa = _mm256_permute_ps(s, 0xFF);
+    const __m256 t = _mm256_mul_ps(_mm256_permute_ps(d, 0xFF), _mm256_sub_ps(one, sa));
+    const __m256 oa = _mm256_add_ps(sa, t);
+    const __m256 num = _mm256_add_ps(_mm256_mul_ps(s, sa), _mm256_mul_ps(d, t));
+    const __m256 c =
+      _mm256_and_ps(_mm256_div_ps(num, oa), _mm256_cmp_ps(oa, zero, _CMP_GT_OQ));
+    _mm256_storeu_ps(dst, _mm256_blend_ps(c, oa, 0x88));
+  }
+  blend_over_rgbaf_sse2(dst, src, count - i);
+}
+
+CHIMA_TARGET("avx2")
+static void blend_premul_over_rgbaf_avx2(chima_f32* dst, const chima_f32* src,
+                                         chima_size count) {
+  const __m256 one = _mm256_set1_ps(1.f);
+  chima_size i = 0;
+  for (; i + 2 <= count; i += 2, dst += 8, src += 8) {
+    const __m256 s = _mm256_loadu_ps(src);
+    const __m256 isa = _mm256_sub_ps(one, _mm256_permute_ps(s, 0xFF));
+    _mm256_storeu_ps(dst, _mm256_add_ps(s, _mm256_mul_ps(_mm256_loadu_ps(dst), isa)));
+  }
+  blend_premul_over_rgbaf_sse2(dst, src, count - i);
+}
+
+CHIMA_TARGET("avx2")
+static void blend_add_rgbaf_avx2(chima_f32* dst, const chima_f32* src, chima_size count) {
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 inf = _mm256_set1_ps(__builtin_inff());
+  const __m256 limit = _mm256_blend_ps(inf, one, 0x88);
+  chima_size i = 0;
+  for (; i + 2 <= count; i += 2, dst += 8, src += 8) {
+    const __m256 s = _mm256_loadu_ps(src);
+    const __m256 m = _mm256_blend_ps(_mm256_permute_ps(s, 0xFF), one, 0x88);
+    const __m256 o = _mm256_add_ps(_mm256_loadu_ps(dst), _mm256_mul_ps(s, m));
+    _mm256_storeu_ps(dst, _mm256_min_ps(o, limit));
+  }
+  blend_add_rgbaf_sse2(dst, src, count - i);
+}
+#endif
+
+static PFN_blend_rgbaf select_blend_rgbaf(chima_blend_mode mode) {
+  static const PFN_blend_rgbaf scalar[] = {
+    [CHIMA_BLEND_REPLACE] = &blend_replace_rgbaf,
+    [CHIMA_BLEND_OVER] = &blend_over_rgbaf_scalar,
+    [CHIMA_BLEND_PREMUL_OVER] = &blend_premul_over_rgbaf_scalar,
+    [CHIMA_BLEND_ADD] = &blend_add_rgbaf_scalar,
+  };
+  CHIMA_STATIC_ASSERT(CHIMA_ARRAY_SIZE(scalar) == _CHIMA_BLEND_COUNT);
+#ifdef CHIMA_X86_SIMD
+  static const PFN_blend_rgbaf sse2[] = {
+    [CHIMA_BLEND_REPLACE] = &blend_replace_rgbaf,
+    [CHIMA_BLEND_OVER] = &blend_over_rgbaf_sse2,
+    [CHIMA_BLEND_PREMUL_OVER] = &blend_premul_over_rgbaf_sse2,
+    [CHIMA_BLEND_ADD] = &blend_add_rgbaf_sse2,
+  };
+  static const PFN_blend_rgbaf avx2[] = {
+    [CHIMA_BLEND_REPLACE] = &blend_replace_rgbaf,
+    [CHIMA_BLEND_OVER] = &blend_over_rgbaf_avx2,
+    [CHIMA_BLEND_PREMUL_OVER] = &blend_premul_over_rgbaf_avx2,
+    [CHIMA_BLEND_ADD] = &blend_add_rgbaf_avx2,
+  };
+  const chima_bitfield cpu = chima__cpu_features();
+  if (cpu & CHIMA_CPU_FLAG_AVX2) {
+    return avx2[mode];
+  }
+  if (cpu & CHIMA_CPU_FLAG_SSE2) {
+    return sse2[mode];
+  }
+#endif
+  return scalar[mode];
+}
+
+// Same luma weights used by stb_image for channel conversion
+static inline chima_u8 compute_y(chima_u32 r, chima_u32 g, chima_u32 b) {
+  return (chima_u8)((r * 77 + g * 150 + b * 29) >> 8);
+}
+
+static void load_rgba8(chima_u8* out, const chima_u8* in, chima_u32 ch, chima_size count) {
+  switch (ch) {
+    case 1: {
+      for (chima_size i = 0; i < count; ++i, out += 4, in += 1) {
+        out[0] = out[1] = out[2] = in[0];
+        out[3] = 0xFF;
+      }
+    } break;
+    case 2: {
+      for (chima_size i = 0; i < count; ++i, out += 4, in += 2) {
+        out[0] = out[1] = out[2] = in[0];
+        out[3] = in[1];
+      }
+    } break;
+    case 3: {
+      for (chima_size i = 0; i < count; ++i, out += 4, in += 3) {
+        out[0] = in[0];
+        out[1] = in[1];
+        out[2] = in[2];
+        out[3] = 0xFF;
+      }
+    } break;
+    case 4: {
+      memcpy(out, in, count * 4);
+    } break;
+    default:
+      CHIMA_UNREACHABLE();
+  }
+}
+
+static void store_rgba8(chima_u8* out, const chima_u8* in, chima_u32 ch, chima_size count) {
+  switch (ch) {
+    case 1: {
+      for (chima_size i = 0; i < count; ++i, out += 1, in += 4) {
+        out[0] = compute_y(in[0], in[1], in[2]);
+      }
+    } break;
+    case 2: {
+      for (chima_size i = 0; i < count; ++i, out += 2, in += 4) {
+        out[0] = compute_y(in[0], in[1], in[2]);
+        out[1] = in[3];
+      }
+    } break;
+    case 3: {
+      for (chima_size i = 0; i < count; ++i, out += 3, in += 4) {
+        out[0] = in[0];
+        out[1] = in[1];
+        out[2] = in[2];
+      }
+    } break;
+    case 4: {
+      memcpy(out, in, count * 4);
+    } break;
+    default:
+      CHIMA_UNREACHABLE();
+  }
+}
+
+static void composite_row_rgba8(PFN_blend_rgba8 blend, chima_u8* dst, chima_u32 dst_ch,
+                                const chima_u8* src, chima_u32 src_ch, chima_size count) {
+  const chima_bool replace = (blend == &blend_replace_rgba8);
+  if (replace && dst_ch == src_ch) {
+    memcpy(dst, src, count * dst_ch);
+    return;
+  }
+  if (dst_ch == 4 && src_ch == 4) {
+    blend(dst, src, count);
+    return;
+  }
+
+  _Alignas(32) chima_u8 dst_buf[COMPOSITE_CHUNK * 4];
+  _Alignas(32) chima_u8 src_buf[COMPOSITE_CHUNK * 4];
+  while (count) {
+    const chima_size n = count < COMPOSITE_CHUNK ? count : COMPOSITE_CHUNK;
+    const chima_u8* src_px = src;
+    if (src_ch != 4) {
+      load_rgba8(src_buf, src, src_ch, n);
+      src_px = src_buf;
+    }
+    if (dst_ch == 4) {
+      blend(dst, src_px, n);
+    } else if (replace) {
+      store_rgba8(dst, src_px, dst_ch, n);
+    } else {
+      load_rgba8(dst_buf, dst, dst_ch, n);
+      blend(dst_buf, src_px, n);
+      store_rgba8(dst, dst_buf, dst_ch, n);
+    }
+    dst += n * dst_ch;
+    src += n * src_ch;
+    count -= n;
+  }
+}
+
+// Gray conversion for float pixels, using the same weights
+static inline chima_f32 compute_yf(chima_f32 r, chima_f32 g, chima_f32 b) {
+  return (r * 77.f + g * 150.f + b * 29.f) * (1.f / 256.f);
+}
+
+static void load_rgbaf_f32(chima_f32* out, const chima_f32* in, chima_u32 ch,
+                           chima_size count) {
+  switch (ch) {
+    case 1: {
+      for (chima_size i = 0; i < count; ++i, out += 4, in += 1) {
+        out[0] = out[1] = out[2] = in[0];
+        out[3] = 1.f;
+      }
+    } break;
+    case 2: {
+      for (chima_size i = 0; i < count; ++i, out += 4, in += 2) {
+        out[0] = out[1] = out[2] = in[0];
+        out[3] = in[1];
+      }
+    } break;
+    case 3: {
+      for (chima_size i = 0; i < count; ++i, out += 4, in += 3) {
+        out[0] = in[0];
+        out[1] = in[1];
+        out[2] = in[2];
+        out[3] = 1.f;
+      }
+    } break;
+    case 4: {
+      memcpy(out, in, count * 4 * sizeof(chima_f32));
+    } break;
+    default:
+      CHIMA_UNREACHABLE();
+  }
+}
+
+static void store_rgbaf_f32(chima_f32* out, const chima_f32* in, chima_u32 ch,
+                            chima_size count) {
+  switch (ch) {
+    case 1: {
+      for (chima_size i = 0; i < count; ++i, out += 1, in += 4) {
+        out[0] = compute_yf(in[0], in[1], in[2]);
+      }
+    } break;
+    case 2: {
+      for (chima_size i = 0; i < count; ++i, out += 2, in += 4) {
+        out[0] = compute_yf(in[0], in[1], in[2]);
+        out[1] = in[3];
+      }
+    } break;
+    case 3: {
+      for (chima_size i = 0; i < count; ++i, out += 3, in += 4) {
+        out[0] = in[0];
+        out[1] = in[1];
+        out[2] = in[2];
+      }
+    } break;
+    case 4: {
+      memcpy(out, in, count * 4 * sizeof(chima_f32));
+    } break;
+    default:
+      CHIMA_UNREACHABLE();
+  }
+}
+
+#define U16_TO_F32 (1.f / 65535.f)
+
+static inline chima_u16 f32_to_u16(chima_f32 v) {
+  v = v * 65535.f + .5f;
+  v = v > 0.f ? v : 0.f;
+  v = v < 65535.f ? v : 65535.f;
+  return (chima_u16)v;
+}
+
+#ifdef CHIMA_X86_SIMD
+CHIMA_TARGET("sse2")
+static chima_size load_rgbaf_u16x4_sse2(chima_f32* out, const chima_u16* in, chima_size count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 scale = _mm_set1_ps(U16_TO_F32);
+  chima_size i = 0;
+  for (; i + 2 <= count; i += 2, out += 8, in += 8) {
+    const __m128i px = _mm_loadu_si128((const __m128i*)in);
+    _mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(px, zero)), scale));
+    _mm_storeu_ps(out + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(px, zero)), scale));
+  }
+  return i;
+}
+
+CHIMA_TARGET("sse2")
+static chima_size store_rgbaf_u16x4_sse2(chima_u16* out, const chima_f32* in, chima_size count) {
+  const __m128 scale = _mm_set1_ps(65535.f);
+  const __m128 half = _mm_set1_ps(.5f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128i bias = _mm_set1_epi32(32768);
+  chima_size i = 0;
+  for (; i + 2 <= count; i += 2, out += 8, in += 8) {
+    __m128 lo = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in), scale), half);
+    __m128 hi = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + 4), scale), half);
+    lo = _mm_min_ps(_mm_max_ps(lo, zero), scale);
+    hi = _mm_min_ps(_mm_max_ps(hi, zero), scale);
+    // No unsigned 32 -> 16 pack in SSE2, bias to signed range and flip the sign bit back
+    const __m128i lo_i = _mm_sub_epi32(_mm_cvttps_epi32(lo), bias);
+    const __m128i hi_i = _mm_sub_epi32(_mm_cvttps_epi32(hi), bias);
+    const __m128i px = _mm_xor_si128(_mm_packs_epi32(lo_i, hi_i), _mm_set1_epi16((short)0x8000));
+    _mm_storeu_si128((__m128i*)out, px);
+  }
+  return i;
+}
+#endif
+
+static void load_rgbaf_u16(chima_f32* out, const chima_u16* in, chima_u32 ch, chima_size count) {
+  switch (ch) {
+    case 1: {
+      for (chima_size i = 0; i < count; ++i, out += 4, in += 1) {
+        out[0] = out[1] = out[2] = in[0] * U16_TO_F32;
+        out[3] = 1.f;
+      }
+    } break;
+    case 2: {
+      for (chima_size i = 0; i < count; ++i, out += 4, in += 2) {
+        out[0] = out[1] = out[2] = in[0] * U16_TO_F32;
+        out[3] = in[1] * U16_TO_F32;
+      }
+    } break;
+    case 3: {
+      for (chima_size i = 0; i < count; ++i, out += 4, in += 3) {
+        out[0] = in[0] * U16_TO_F32;
+        out[1] = in[1] * U16_TO_F32;
+        out[2] = in[2] * U16_TO_F32;
+        out[3] = 1.f;
+      }
+    } break;
+    case 4: {
+      chima_size i = 0;
+#ifdef CHIMA_X86_SIMD
+      if (chima__cpu_features() & CHIMA_CPU_FLAG_SSE2) {
+        i = load_rgbaf_u16x4_sse2(out, in, count);
+      }
+#endif
+      for (out += i * 4, in += i * 4; i < count; ++i, out += 4, in += 4) {
+        for (chima_u32 c = 0; c < 4; ++c) {
+          out[c] = in[c] * U16_TO_F32;
+        }
+      }
+    } break;
+    default:
+      CHIMA_UNREACHABLE();
+  }
+}
+
+static void store_rgbaf_u16(chima_u16* out, const chima_f32* in, chima_u32 ch,
+                            chima_size count) {
+  switch (ch) {
+    case 1: {
+      for (chima_size i = 0; i < count; ++i, out += 1, in += 4) {
+        out[0] = f32_to_u16(compute_yf(in[0], in[1], in[2]));
+      }
+    } break;
+    case 2: {
+      for (chima_size i = 0; i < count; ++i, out += 2, in += 4) {
+        out[0] = f32_to_u16(compute_yf(in[0], in[1], in[2]));
+        out[1] = f32_to_u16(in[3]);
+      }
+    } break;
+    case 3: {
+      for (chima_size i = 0; i < count; ++i, out += 3, in += 4) {
+        out[0] = f32_to_u16(in[0]);
+        out[1] = f32_to_u16(in[1]);
+        out[2] = f32_to_u16(in[2]);
+      }
+    } break;
+    case 4: {
+      chima_size i = 0;
+#ifdef CHIMA_X86_SIMD
+      if (chima__cpu_features() & CHIMA_CPU_FLAG_SSE2) {
+        i = store_rgbaf_u16x4_sse2(out, in, count);
+      }
+#endif
+      for (out += i * 4, in += i * 4; i < count; ++i, out += 4, in += 4) {
+        for (chima_u32 c = 0; c < 4; ++c) {
+          out[c] = f32_to_u16(in[c]);
+        }
+      }
+    } break;
+    default:
+      CHIMA_UNREACHABLE();
+  }
+}
+
+static void load_rgbaf(chima_f32* out, const void* in, chima_image_depth depth, chima_u32 ch,
+                       chima_size count) {
+  if (depth == CHIMA_DEPTH_16U) {
+    load_rgbaf_u16(out, in, ch, count);
+  } else {
+    load_rgbaf_f32(out, in, ch, count);
+  }
+}
+
+static void store_rgbaf(void* out, const chima_f32* in, chima_image_depth depth, chima_u32 ch,
+                        chima_size count) {
+  if (depth == CHIMA_DEPTH_16U) {
+    store_rgbaf_u16(out, in, ch, count);
+  } else {
+    store_rgbaf_f32(out, in, ch, count);
+  }
+}
+
+static void composite_row_rgbaf(PFN_blend_rgbaf blend, chima_image_depth depth, void* dst,
+                                chima_u32 dst_ch, const void* src, chima_u32 src_ch,
+                                chima_size count) {
+  const chima_bool replace = (blend == &blend_replace_rgbaf);
+  const chima_size depth_sz = chima__depth_size(depth);
+  if (replace && dst_ch == src_ch) {
+    memcpy(dst, src, count * dst_ch * depth_sz);
+    return;
+  }
+  if (depth == CHIMA_DEPTH_32F && dst_ch == 4 && src_ch == 4) {
+    blend(dst, src, count);
+    return;
+  }
+
+  _Alignas(32) chima_f32 dst_buf[COMPOSITE_CHUNK * 4];
+  _Alignas(32) chima_f32 src_buf[COMPOSITE_CHUNK * 4];
+  chima_u8* dst_px = dst;
+  const chima_u8* src_px = src;
+  while (count) {
+    const chima_size n = count < COMPOSITE_CHUNK ? count : COMPOSITE_CHUNK;
+    load_rgbaf(src_buf, src_px, depth, src_ch, n);
+    if (replace) {
+      store_rgbaf(dst_px, src_buf, depth, dst_ch, n);
+    } else {
+      load_rgbaf(dst_buf, dst_px, depth, dst_ch, n);
+      blend(dst_buf, src_buf, n);
+      store_rgbaf(dst_px, dst_buf, depth, dst_ch, n);
+    }
+    dst_px += n * dst_ch * depth_sz;
+    src_px += n * src_ch * depth_sz;
+    count -= n;
+  }
+}
+
+chima_result chima_composite_image(chima_image* dst, const chima_image* src, chima_u32 xpos,
+                                   chima_u32 ypos) {
+  return chima_composite_image_ex(dst, src, xpos, ypos, CHIMA_BLEND_OVER, NULL);
+}
+
+chima_result chima_composite_image_ex(chima_image* dst, const chima_image* src, chima_u32 xpos,
+                                      chima_u32 ypos, chima_blend_mode mode,
+                                      chima_dirty_tracker dirty) {
+  if (!src) {
+    return CHIMA_INVALID_VALUE;
+  }
+  const chima_rect src_rect = {0, 0, src->extent.width, src->extent.height};
+  const chima_result ret = chima__composite_rect(dst, src, &src_rect, xpos, ypos, mode);
+  if (!ret) {
+    chima__mark_dirty(dirty, xpos, ypos, src_rect.width, src_rect.height);
+  }
+  return ret;
+}
+
+chima_result chima__composite_rect(chima_image* dst, const chima_image* src,
+                                   const chima_rect* src_rect, chima_u32 xpos, chima_u32 ypos,
+                                   chima_blend_mode mode) {
+  if (!dst || !src || !dst->data || !src->data) {
+    return CHIMA_INVALID_VALUE;
+  }
+  if (dst->channels < 1 || dst->channels > 4 || src->channels < 1 || src->channels > 4) {
+    return CHIMA_INVALID_VALUE;
+  }
+  if ((chima_u32)mode >= _CHIMA_BLEND_COUNT || (chima_u32)dst->depth >= _CHIMA_DEPTH_COUNT) {
+    return CHIMA_INVALID_VALUE;
+  }
+  if (src->depth != dst->depth) {
+    return CHIMA_UNSUPPORTED_FORMAT;
+  }
+  CHIMA_ASSERT(src_rect->x + src_rect->width <= src->extent.width &&
+               src_rect->y + src_rect->height <= src->extent.height);
+
+  const chima_size dst_w = dst->extent.width, dst_h = dst->extent.height, dst_ch = dst->channels;
+  const chima_size src_w = src_rect->width, src_h = src_rect->height, src_ch = src->channels;
+  if (xpos >= dst_w || ypos >= dst_h) {
+    return CHIMA_NO_ERROR; // Nothing to draw
+  }
+  const chima_size row_pixels = xpos + src_w > dst_w ? dst_w - xpos : src_w;
+  const chima_size rows = ypos + src_h > dst_h ? dst_h - ypos : src_h;
+
+  const chima_image_depth depth = dst->depth;
+  const chima_size depth_sz = chima__depth_size(depth);
+  const chima_size dst_stride = dst_w * dst_ch * depth_sz;
+  const chima_size src_stride = (chima_size)src->extent.width * src_ch * depth_sz;
+  chima_u8* dst_row = (chima_u8*)dst->data + ypos * dst_stride + xpos * dst_ch * depth_sz;
+  const chima_u8* src_row = (const chima_u8*)src->data + src_rect->y * src_stride +
+                            src_rect->x * src_ch * depth_sz;
+  if (depth == CHIMA_DEPTH_8U) {
+    const PFN_blend_rgba8 blend = select_blend_rgba8(mode);
+    for (chima_size row = 0; row < rows; ++row) {
+      composite_row_rgba8(blend, dst_row, dst_ch, src_row, src_ch, row_pixels);
+      dst_row += dst_stride;
+      src_row += src_stride;
+    }
+  } else {
+    const PFN_blend_rgbaf blend = select_blend_rgbaf(mode);
+    for (chima_size row = 0; row < rows; ++row) {
+      composite_row_rgbaf(blend, depth, dst_row, dst_ch, src_row, src_ch, row_pixels);
+      dst_row += dst_stride;
+      src_row += src_stride;
+    }
+  }
+
+  return CHIMA_NO_ERROR;
+}
@@ -1,8 +1,16 @@
 #include "./internal.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 const char* chima_error_string(chima_result ret) {
   switch (ret) {
     case CHIMA_NO_ERROR: return "No error";
@@ -40,9 +48,52 @@ static void* chima_realloc(void* user, void* ptr, size_t oldsz, size_t newsz) {
   return mem;
 }
 
-#define ATLAS_MAX_SIZE  16384
-#define ATLAS_INIT_SIZE 512
+void* chima__calloc(chima_context chima, chima_size count, chima_size size) {
+  if (size && count > SIZE_MAX / size) {
+    return NULL;
+  }
+  if (chima->flags & CHIMA_CTX_FLAG_DEFAULT_ALLOC) {
+    return calloc(count, size);
+  }
+  void* mem = CHIMA_MALLOC(count * size);
+  if (mem) {
+    memset(mem, 0, count * size);
+  }
+  return mem;
+}
+
+chima_bitfield chima__cpu_features(void) {
+  chima_bitfield features = CHIMA_CPU_FLAG_NONE;
+#ifdef CHIMA_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    features |= CHIMA_CPU_FLAG_SSE2;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    features |= CHIMA_CPU_FLAG_AVX2;
+  }
+#endif
+  return features;
+}
+
+uint64_t chima__time_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (uint64_t)((double)count.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+#define ATLAS_INIT_SIZE 1
+#define ATLAS_MULTIPLE  1
+#define ATLAS_BLOCK     1
 #define ATLAS_GROW_FAC  2.0f
+#define THREAD_COUNT    1
 
 chima_result chima_create_context(chima_context* chima,
                                             const chima_alloc* alloc) {
@@ -51,9 +102,11 @@ chima_result chima_create_context(chima_context* chima,
   }
 
   chima_alloc alloc_funcs;
+  chima_bitfield flags = CHIMA_CTX_FLAG_NONE;
   if (alloc && alloc->malloc && alloc->realloc && alloc->free) {
     alloc_funcs = *alloc;
   } else {
+    flags |= CHIMA_CTX_FLAG_DEFAULT_ALLOC;
     alloc_funcs.user = NULL;
     alloc_funcs.malloc = &chima_malloc;
     alloc_funcs.free = &chima_free;
@@ -74,8 +127,14 @@ chima_result chima_create_context(chima_context* chima,
   ctx->mem_alloc = alloc_funcs.malloc;
   ctx->mem_realloc = alloc_funcs.realloc;
   ctx->mem_free = alloc_funcs.free;
+  ctx->flags = flags;
   ctx->atlas_grow_fac = ATLAS_GROW_FAC;
   ctx->atlas_initial = ATLAS_INIT_SIZE;
+  ctx->atlas_multiple = ATLAS_MULTIPLE;
+  ctx->atlas_block = ATLAS_BLOCK;
+  ctx->atlas_max_size = CHIMA_ATLAS_MAX_SIZE;
+  ctx->thread_count = THREAD_COUNT;
+  ctx->packer_type = CHIMA_PACKER_SKYLINE_BL;
 
   (*chima) = ctx;
   return CHIMA_NO_ERROR;
@@ -85,6 +144,7 @@ void chima_destroy_context(chima_context chima) {
   if (!chima) {
     return;
   }
+  chima__destroy_thread_pool(chima);
   void* user = chima->mem_user;
   PFN_chima_free mem_free = chima->mem_free;
   CHIMA_ASSERT(mem_free);
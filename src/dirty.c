@@ -0,0 +1,161 @@
+#include "./internal.h"
+
+#include <string.h>
+
+/*
+ * Dirty region tracking.
+ *
+ * Trackers live apart from the images they cover, so images stay plain data. Every write given
+ * a tracker marks the rect it touched. Marks covered by an older rect are dropped, and older
+ * rects covered by the new mark are replaced, so repeated writes to the same place don't pile up.
+ * The list has a fixed size: when it is full, the new mark is merged with the rect whose bounds
+ * grow the least, so marking never allocates or fails.
+ *
+ * Flushing merges the rects whose bounds cost less area than uploading them separately, then
+ * hands the list to the user and starts a new one.
+ */
+
+#define DIRTY_MAX_RECTS 32
+
+// Per rect overhead of an upload, in texels, used to decide when merging two rects pays off
+#define DIRTY_RECT_COST 1024
+
+typedef struct chima_dirty_tracker_ {
+  chima_context chima;
+  chima_extent2d extent;
+  chima_rect rects[DIRTY_MAX_RECTS];
+  chima_size count;
+  chima_rect flushed[DIRTY_MAX_RECTS];
+} chima_dirty_tracker_;
+
+static uint64_t rect_area(const chima_rect* rect) {
+  return (uint64_t)rect->width * rect->height;
+}
+
+static chima_rect rect_union(const chima_rect* a, const chima_rect* b) {
+  const chima_u32 x = CHIMA_MIN(a->x, b->x), y = CHIMA_MIN(a->y, b->y);
+  const chima_u32 x_end = CHIMA_MAX(a->x + a->width, b->x + b->width);
+  const chima_u32 y_end = CHIMA_MAX(a->y + a->height, b->y + b->height);
+  const chima_rect out = {x, y, x_end - x, y_end - y};
+  return out;
+}
+
+static uint64_t rect_overlap(const chima_rect* a, const chima_rect* b) {
+  const chima_u32 x = CHIMA_MAX(a->x, b->x), y = CHIMA_MAX(a->y, b->y);
+  const chima_u32 x_end = CHIMA_MIN(a->x + a->width, b->x + b->width);
+  const chima_u32 y_end = CHIMA_MIN(a->y + a->height, b->y + b->height);
+  if (x >= x_end || y >= y_end) {
+    return 0;
+  }
+  return (uint64_t)(x_end - x) * (y_end - y);
+}
+
+static chima_bool rect_contains(const chima_rect* a, const chima_rect* b) {
+  return b->x >= a->x && b->y >= a->y && b->x + b->width <= a->x + a->width &&
+         b->y + b->height <= a->y + a->height;
+}
+
+chima_result chima_create_dirty_tracker(chima_context chima, chima_dirty_tracker* tracker,
+                                        const chima_image* image) {
+  if (!chima || !tracker || !image) {
+    return CHIMA_INVALID_VALUE;
+  }
+  chima_dirty_tracker dirty = CHIMA_MALLOC(sizeof(chima_dirty_tracker_));
+  if (!dirty) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  memset(dirty, 0, sizeof(*dirty));
+  dirty->chima = chima;
+  dirty->extent = image->extent;
+  *tracker = dirty;
+
+  return CHIMA_NO_ERROR;
+}
+
+void chima_destroy_dirty_tracker(chima_dirty_tracker tracker) {
+  if (!tracker) {
+    return;
+  }
+  chima_context chima = tracker->chima;
+  CHIMA_ASSERT(chima);
+  memset(tracker, 0, sizeof(*tracker));
+  CHIMA_FREE(tracker);
+}
+
+void chima__mark_dirty(chima_dirty_tracker dirty, chima_u32 x, chima_u32 y, chima_u32 width,
+                       chima_u32 height) {
+  if (!dirty || x >= dirty->extent.width || y >= dirty->extent.height) {
+    return;
+  }
+  chima_rect mark = {x, y, CHIMA_MIN(width, dirty->extent.width - x),
+                     CHIMA_MIN(height, dirty->extent.height - y)};
+  if (!mark.width || !mark.height) {
+    return;
+  }
+
+  chima_size kept = 0;
+  for (chima_size i = 0; i < dirty->count; ++i) {
+    if (rect_contains(dirty->rects + i, &mark)) {
+      return;
+    }
+    if (!rect_contains(&mark, dirty->rects + i)) {
+      dirty->rects[kept++] = dirty->rects[i];
+    }
+  }
+  dirty->count = kept;
+  if (dirty->count == DIRTY_MAX_RECTS) {
+    chima_size best = 0;
+    uint64_t best_area = UINT64_MAX;
+    for (chima_size i = 0; i < dirty->count; ++i) {
+      const chima_rect merged = rect_union(dirty->rects + i, &mark);
+      const uint64_t area = rect_area(&merged) - rect_area(dirty->rects + i);
+      if (area < best_area) {
+        best = i;
+        best_area = area;
+      }
+    }
+    mark = rect_union(dirty->rects + best, &mark);
+    dirty->rects[best] = dirty->rects[--dirty->count];
+  }
+  dirty->rects[dirty->count++] = mark;
+}
+
+chima_result chima_dirty_tracker_mark(chima_dirty_tracker tracker, chima_rect rect) {
+  if (!tracker) {
+    return CHIMA_INVALID_VALUE;
+  }
+  chima__mark_dirty(tracker, rect.x, rect.y, rect.width, rect.height);
+  return CHIMA_NO_ERROR;
+}
+
+chima_result chima_dirty_tracker_flush(chima_dirty_tracker tracker, const chima_rect** rects,
+                                       chima_size* rect_count) {
+  if (!tracker || !rects || !rect_count) {
+    return CHIMA_INVALID_VALUE;
+  }
+  chima_rect* out = tracker->flushed;
+  chima_size count = tracker->count;
+  memcpy(out, tracker->rects, count * sizeof(chima_rect));
+  tracker->count = 0;
+
+  // Merge pairs while the bounds cost less than the texels plus overhead of both rects
+  chima_bool merged = CHIMA_TRUE;
+  while (merged) {
+    merged = CHIMA_FALSE;
+    for (chima_size i = 0; i < count; ++i) {
+      for (chima_size j = i + 1; j < count; ++j) {
+        const chima_rect bounds = rect_union(out + i, out + j);
+        const uint64_t separate = rect_area(out + i) + rect_area(out + j) -
+                                  rect_overlap(out + i, out + j) + DIRTY_RECT_COST;
+        if (rect_area(&bounds) <= separate) {
+          out[i] = bounds;
+          out[j--] = out[--count];
+          merged = CHIMA_TRUE;
+        }
+      }
+    }
+  }
+  *rects = out;
+  *rect_count = count;
+  return CHIMA_NO_ERROR;
+}
@@ -0,0 +1,732 @@
+#include "./internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Dynamic atlas, a fixed size atlas image where sprites come and go at runtime.
+ *
+ * Space is handed out by a shelf allocator. The atlas is cut in horizontal shelves stacked from
+ * the top, each one with a sorted list of free spans. A sprite takes the left side of the
+ * smallest span it fits in, on the shelf that wastes the least height, and gives the span back
+ * when removed, so no other sprite ever moves. Shelves left empty merge with their empty
+ * neighbours, and the last one returns its height to the free area at the bottom, so the space
+ * can be cut again for sprites of a different height.
+ *
+ * Live sprites are also kept in a LRU list, touched on insertion and by the user. When allowed,
+ * insertions that don't fit evict a run of neighbouring sprites on one shelf, picking the run
+ * whose most recently used sprite is the oldest, and the one covering the least area on a tie.
+ * Evicting from the global least recently used end instead frees scattered holes that are too
+ * small for the insertion, emptying most of the atlas before a big enough span opens up. Runs
+ * keep the atlas mostly full and evict far fewer sprites, at the cost of sometimes dropping a
+ * sprite more recent than the global least recently used one. Only when no shelf is tall enough
+ * are sprites evicted from the least recently used end, until shelves merge.
+ */
+
+#define DYN_SHELF_ALIGN 8 // New shelves get their height rounded up to a multiple of this
+
+// Sprite handle: the slot index plus one in the low bits, the slot generation in the high bits
+#define DYN_SLOT_BITS 20
+#define DYN_SLOT_MASK ((1u << DYN_SLOT_BITS) - 1)
+#define DYN_GEN_MASK  ((1u << (32 - DYN_SLOT_BITS)) - 1)
+#define DYN_NIL       0xFFFFFFFFu
+
+typedef struct dyn_span {
+  chima_u32 x, width;
+} dyn_span;
+
+typedef struct dyn_shelf {
+  chima_u32 y, height;
+  chima_u32 sprite_count;
+  dyn_span* spans; // Free spans, sorted by x and never adjacent
+  chima_u32 span_count, span_cap;
+} dyn_shelf;
+
+typedef struct dyn_slot {
+  chima_rect rect;
+  chima_u32 gen;
+  chima_u32 prev, next; // LRU neighbours while live, `next` links the free slots otherwise
+  uint64_t stamp;       // Last use, higher is more recent
+  chima_bool live;
+} dyn_slot;
+
+// Live sprite seen by the eviction search
+typedef struct dyn_victim {
+  chima_u32 x, y, end; // Padded horizontal extent
+  chima_u32 slot;
+} dyn_victim;
+
+typedef struct chima_dyn_atlas_ {
+  chima_context chima;
+  chima_image image;
+  chima_dirty_tracker dirty;
+  chima_u32 padding;
+  chima_u8 bg_texel[4 * sizeof(chima_f32)];
+  chima_size texel_size;
+  chima_u32 width, height; // Allocator area, the image extent plus padding
+  dyn_shelf* shelves;      // Sorted by y, covering [0, shelf_end) without gaps
+  chima_u32 shelf_count, shelf_cap;
+  chima_u32 shelf_end;
+  dyn_slot* slots;
+  chima_u32 slot_count, slot_cap;
+  chima_u32 free_slot;
+  chima_u32 lru_head, lru_tail; // Most and least recently used
+  uint64_t tick;
+  dyn_victim* victims; // Scratch for the eviction search
+  chima_u32 victim_cap;
+  chima_size sprite_count;
+  PFN_chima_dyn_evict evict_callback;
+  void* evict_user;
+} chima_dyn_atlas_;
+
+static chima_result grow_array(chima_context chima, void** array, chima_u32* cap,
+                               chima_u32 count, chima_size elem_size) {
+  if (count <= *cap) {
+    return CHIMA_NO_ERROR;
+  }
+  chima_u32 new_cap = *cap ? *cap : 8;
+  while (new_cap < count) {
+    new_cap *= 2;
+  }
+  void* mem = CHIMA_REALLOC(*array, *cap * elem_size, new_cap * elem_size);
+  if (!mem) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  *array = mem;
+  *cap = new_cap;
+  return CHIMA_NO_ERROR;
+}
+
+chima_result chima_create_dyn_atlas(chima_context chima, chima_dyn_atlas* atlas, chima_u32 width,
+                                    chima_u32 height, chima_u32 channels, chima_image_depth depth,
+                                    chima_u32 padding, chima_color background_color) {
+  if (!chima || !atlas || !width || !height || width > CHIMA_ATLAS_MAX_SIZE ||
+      height > CHIMA_ATLAS_MAX_SIZE || padding > CHIMA_ATLAS_MAX_SIZE) {
+    return CHIMA_INVALID_VALUE;
+  }
+  chima_dyn_atlas_* dyn = CHIMA_MALLOC(sizeof(chima_dyn_atlas_));
+  if (!dyn) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  memset(dyn, 0, sizeof(*dyn));
+  chima_result ret = chima_gen_blank_image(chima, &dyn->image, width, height, channels, depth,
+                                           background_color);
+  if (ret != CHIMA_NO_ERROR) {
+    CHIMA_FREE(dyn);
+    return ret;
+  }
+  ret = chima_create_dirty_tracker(chima, &dyn->dirty, &dyn->image);
+  if (ret != CHIMA_NO_ERROR) {
+    chima_destroy_image(chima, &dyn->image);
+    CHIMA_FREE(dyn);
+    return ret;
+  }
+  dyn->chima = chima;
+  dyn->padding = padding;
+  dyn->texel_size = chima__color_texel(background_color, dyn->image.channels, depth,
+                                       dyn->bg_texel);
+  // The padding of the sprites touching the right and bottom borders falls outside of the image
+  dyn->width = width + padding;
+  dyn->height = height + padding;
+  dyn->free_slot = DYN_NIL;
+  dyn->lru_head = dyn->lru_tail = DYN_NIL;
+  (*atlas) = dyn;
+
+  return CHIMA_NO_ERROR;
+}
+
+static void shelf_reset(dyn_shelf* shelf, chima_u32 width) {
+  CHIMA_ASSERT(shelf->span_cap);
+  shelf->sprite_count = 0;
+  shelf->spans[0].x = 0;
+  shelf->spans[0].width = width;
+  shelf->span_count = 1;
+}
+
+// Inserts an empty shelf at `idx`
+static chima_result shelf_insert(chima_dyn_atlas atlas, chima_u32 idx, chima_u32 y,
+                                 chima_u32 height) {
+  chima_context chima = atlas->chima;
+  chima_result ret = grow_array(chima, (void**)&atlas->shelves, &atlas->shelf_cap,
+                                atlas->shelf_count + 1, sizeof(dyn_shelf));
+  if (ret != CHIMA_NO_ERROR) {
+    return ret;
+  }
+  dyn_shelf shelf;
+  memset(&shelf, 0, sizeof(shelf));
+  ret = grow_array(chima, (void**)&shelf.spans, &shelf.span_cap, 1, sizeof(dyn_span));
+  if (ret != CHIMA_NO_ERROR) {
+    return ret;
+  }
+  shelf.y = y;
+  shelf.height = height;
+  shelf_reset(&shelf, atlas->width);
+  memmove(atlas->shelves + idx + 1, atlas->shelves + idx,
+          (atlas->shelf_count - idx) * sizeof(dyn_shelf));
+  atlas->shelves[idx] = shelf;
+  ++atlas->shelf_count;
+  return CHIMA_NO_ERROR;
+}
+
+static void shelf_erase(chima_dyn_atlas atlas, chima_u32 idx) {
+  chima_context chima = atlas->chima;
+  CHIMA_FREE(atlas->shelves[idx].spans);
+  memmove(atlas->shelves + idx, atlas->shelves + idx + 1,
+          (atlas->shelf_count - idx - 1) * sizeof(dyn_shelf));
+  --atlas->shelf_count;
+}
+
+// Index of the smallest free span of at least `width`, or `DYN_NIL`
+static chima_u32 shelf_find_span(const dyn_shelf* shelf, chima_u32 width) {
+  chima_u32 best = DYN_NIL;
+  for (chima_u32 i = 0; i < shelf->span_count; ++i) {
+    const chima_u32 span_width = shelf->spans[i].width;
+    if (span_width >= width && (best == DYN_NIL || span_width < shelf->spans[best].width)) {
+      best = i;
+      if (span_width == width) {
+        break;
+      }
+    }
+  }
+  return best;
+}
+
+static chima_u32 shelf_take_span(dyn_shelf* shelf, chima_u32 span_idx, chima_u32 width) {
+  dyn_span* span = shelf->spans + span_idx;
+  const chima_u32 x = span->x;
+  span->x += width;
+  span->width -= width;
+  if (!span->width) {
+    memmove(span, span + 1, (shelf->span_count - span_idx - 1) * sizeof(dyn_span));
+    --shelf->span_count;
+  }
+  ++shelf->sprite_count;
+  return x;
+}
+
+static chima_result shelf_free_span(chima_dyn_atlas atlas, dyn_shelf* shelf, chima_u32 x,
+                                    chima_u32 width) {
+  CHIMA_ASSERT(shelf->sprite_count);
+  if (shelf->sprite_count == 1) {
+    shelf_reset(shelf, atlas->width);
+    return CHIMA_NO_ERROR;
+  }
+
+  chima_u32 idx = 0;
+  while (idx < shelf->span_count && shelf->spans[idx].x < x) {
+    ++idx;
+  }
+  const chima_bool merge_prev = idx > 0 &&
+                                shelf->spans[idx - 1].x + shelf->spans[idx - 1].width == x;
+  const chima_bool merge_next = idx < shelf->span_count && x + width == shelf->spans[idx].x;
+  if (merge_prev && merge_next) {
+    shelf->spans[idx - 1].width += width + shelf->spans[idx].width;
+    memmove(shelf->spans + idx, shelf->spans + idx + 1,
+            (shelf->span_count - idx - 1) * sizeof(dyn_span));
+    --shelf->span_count;
+  } else if (merge_prev) {
+    shelf->spans[idx - 1].width += width;
+  } else if (merge_next) {
+    shelf->spans[idx].x = x;
+    shelf->spans[idx].width += width;
+  } else {
+    chima_context chima = atlas->chima;
+    chima_result ret = grow_array(chima, (void**)&shelf->spans, &shelf->span_cap,
+                                  shelf->span_count + 1, sizeof(dyn_span));
+    if (ret != CHIMA_NO_ERROR) {
+      return ret;
+    }
+    memmove(shelf->spans + idx + 1, shelf->spans + idx,
+            (shelf->span_count - idx) * sizeof(dyn_span));
+    shelf->spans[idx].x = x;
+    shelf->spans[idx].width = width;
+    ++shelf->span_count;
+  }
+  --shelf->sprite_count;
+  return CHIMA_NO_ERROR;
+}
+
+// Merges the empty shelf at `idx` with its empty neighbours, and gives the height of the last
+// shelf back to the free area if it ends up empty
+static void shelf_collapse(chima_dyn_atlas atlas, chima_u32 idx) {
+  dyn_shelf* shelves = atlas->shelves;
+  if (idx + 1 < atlas->shelf_count && !shelves[idx + 1].sprite_count) {
+    shelves[idx].height += shelves[idx + 1].height;
+    shelf_erase(atlas, idx + 1);
+  }
+  if (idx > 0 && !shelves[idx - 1].sprite_count) {
+    shelves[idx - 1].height += shelves[idx].height;
+    shelf_erase(atlas, idx);
+    --idx;
+  }
+  if (idx + 1 == atlas->shelf_count) {
+    atlas->shelf_end = shelves[idx].y;
+    shelf_erase(atlas, idx);
+  }
+}
+
+// Extra height a shelf can have for a sprite of `height`, at most half again as tall as a new
+// shelf would be
+static chima_u32 shelf_max_waste(chima_u32 height) {
+  const chima_u32 fit_height = (height + DYN_SHELF_ALIGN - 1) / DYN_SHELF_ALIGN * DYN_SHELF_ALIGN;
+  return fit_height / 2 + fit_height - height;
+}
+
+static chima_u32 shelf_height(chima_dyn_atlas atlas, chima_u32 height) {
+  const chima_u32 aligned = (height + DYN_SHELF_ALIGN - 1) / DYN_SHELF_ALIGN * DYN_SHELF_ALIGN;
+  return CHIMA_MIN(aligned, atlas->height - atlas->shelf_end);
+}
+
+// Finds a place for a `width` x `height` area, padding included. Returns `CHIMA_PACKING_FAILED`
+// if there is no room left.
+static chima_result dyn_alloc(chima_dyn_atlas atlas, chima_u32 width, chima_u32 height,
+                              chima_u32* xpos, chima_u32* ypos) {
+  // A shelf at most half again as tall as a new one would be, wasting the least height
+  const chima_u32 fit_height = (height + DYN_SHELF_ALIGN - 1) / DYN_SHELF_ALIGN * DYN_SHELF_ALIGN;
+  const chima_u32 max_waste = shelf_max_waste(height);
+  chima_u32 best = DYN_NIL, best_span = DYN_NIL, best_waste = 0;
+  chima_u32 empty = DYN_NIL, loose = DYN_NIL, loose_span = DYN_NIL;
+  for (chima_u32 i = 0; i < atlas->shelf_count; ++i) {
+    const dyn_shelf* shelf = atlas->shelves + i;
+    if (shelf->height < height) {
+      continue;
+    }
+    const chima_u32 waste = shelf->height - height;
+    if (!shelf->sprite_count) {
+      if (empty == DYN_NIL || shelf->height < atlas->shelves[empty].height) {
+        empty = i;
+      }
+      continue;
+    }
+    const chima_u32 span = shelf_find_span(shelf, width);
+    if (span == DYN_NIL) {
+      continue;
+    }
+    if (waste <= max_waste && (best == DYN_NIL || waste < best_waste)) {
+      best = i;
+      best_span = span;
+      best_waste = waste;
+    }
+    if (loose == DYN_NIL || shelf->height < atlas->shelves[loose].height) {
+      loose = i;
+      loose_span = span;
+    }
+  }
+
+  chima_result ret;
+  if (best == DYN_NIL && empty != DYN_NIL && atlas->shelves[empty].height - height <= max_waste) {
+    best = empty;
+    best_span = 0;
+  }
+  if (best == DYN_NIL && shelf_height(atlas, height) >= height) {
+    // Open a new shelf in the free area
+    ret = shelf_insert(atlas, atlas->shelf_count, atlas->shelf_end, shelf_height(atlas, height));
+    if (ret != CHIMA_NO_ERROR) {
+      return ret;
+    }
+    best = atlas->shelf_count - 1;
+    best_span = 0;
+    atlas->shelf_end += atlas->shelves[best].height;
+  }
+  if (best == DYN_NIL && empty != DYN_NIL) {
+    // Cut the empty shelf, leaving the rest as another empty shelf below
+    const dyn_shelf* shelf = atlas->shelves + empty;
+    const chima_u32 cut = CHIMA_MIN(fit_height, shelf->height);
+    if (shelf->height - cut >= DYN_SHELF_ALIGN) {
+      ret = shelf_insert(atlas, empty + 1, shelf->y + cut, shelf->height - cut);
+      if (ret != CHIMA_NO_ERROR) {
+        return ret;
+      }
+      atlas->shelves[empty].height = cut;
+    }
+    best = empty;
+    best_span = 0;
+  }
+  if (best == DYN_NIL) {
+    best = loose;
+    best_span = loose_span;
+  }
+  if (best == DYN_NIL) {
+    return CHIMA_PACKING_FAILED;
+  }
+
+  dyn_shelf* shelf = atlas->shelves + best;
+  *xpos = shelf_take_span(shelf, best_span, width);
+  *ypos = shelf->y;
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result dyn_free(chima_dyn_atlas atlas, const chima_rect* rect) {
+  // Shelves are sorted by y
+  chima_u32 lo = 0, hi = atlas->shelf_count;
+  while (hi - lo > 1) {
+    const chima_u32 mid = (lo + hi) / 2;
+    if (atlas->shelves[mid].y <= rect->y) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  CHIMA_ASSERT(lo < atlas->shelf_count && atlas->shelves[lo].y == rect->y);
+  dyn_shelf* shelf = atlas->shelves + lo;
+  chima_result ret = shelf_free_span(atlas, shelf, rect->x, rect->width + atlas->padding);
+  if (ret != CHIMA_NO_ERROR) {
+    return ret;
+  }
+  if (!shelf->sprite_count) {
+    shelf_collapse(atlas, lo);
+  }
+  return CHIMA_NO_ERROR;
+}
+
+// Paints the rect and its padding with the background color, clipped to the image
+static void dyn_clear(chima_dyn_atlas atlas, const chima_rect* rect) {
+  if (!atlas->texel_size) {
+    return;
+  }
+  const chima_image* image = &atlas->image;
+  const chima_size width = CHIMA_MIN(rect->width + atlas->padding, image->extent.width - rect->x);
+  const chima_size y_end = CHIMA_MIN(rect->y + rect->height + atlas->padding,
+                                     image->extent.height);
+  const chima_size stride = image->extent.width * atlas->texel_size;
+  chima_u8* row = (chima_u8*)image->data + rect->y * stride + rect->x * atlas->texel_size;
+  for (chima_size y = rect->y; y < y_end; ++y, row += stride) {
+    chima__fill_texels(row, width, atlas->bg_texel, atlas->texel_size);
+  }
+  chima__mark_dirty(atlas->dirty, rect->x, rect->y, (chima_u32)width,
+                    (chima_u32)(y_end - rect->y));
+}
+
+static void lru_unlink(chima_dyn_atlas atlas, chima_u32 idx) {
+  dyn_slot* slot = atlas->slots + idx;
+  if (slot->prev != DYN_NIL) {
+    atlas->slots[slot->prev].next = slot->next;
+  } else {
+    atlas->lru_head = slot->next;
+  }
+  if (slot->next != DYN_NIL) {
+    atlas->slots[slot->next].prev = slot->prev;
+  } else {
+    atlas->lru_tail = slot->prev;
+  }
+}
+
+static void lru_push(chima_dyn_atlas atlas, chima_u32 idx) {
+  dyn_slot* slot = atlas->slots + idx;
+  slot->prev = DYN_NIL;
+  slot->next = atlas->lru_head;
+  slot->stamp = ++atlas->tick;
+  if (atlas->lru_head != DYN_NIL) {
+    atlas->slots[atlas->lru_head].prev = idx;
+  } else {
+    atlas->lru_tail = idx;
+  }
+  atlas->lru_head = idx;
+}
+
+static chima_dyn_sprite slot_handle(chima_dyn_atlas atlas, chima_u32 idx) {
+  return ((atlas->slots[idx].gen & DYN_GEN_MASK) << DYN_SLOT_BITS) | (idx + 1);
+}
+
+// Slot index of a live sprite, or `DYN_NIL`
+static chima_u32 slot_find(chima_dyn_atlas atlas, chima_dyn_sprite sprite) {
+  const chima_u32 idx = (sprite & DYN_SLOT_MASK) - 1;
+  if (idx >= atlas->slot_count || !atlas->slots[idx].live ||
+      (atlas->slots[idx].gen & DYN_GEN_MASK) != sprite >> DYN_SLOT_BITS) {
+    return DYN_NIL;
+  }
+  return idx;
+}
+
+static chima_result slot_release(chima_dyn_atlas atlas, chima_u32 idx) {
+  dyn_slot* slot = atlas->slots + idx;
+  chima_result ret = dyn_free(atlas, &slot->rect);
+  if (ret != CHIMA_NO_ERROR) {
+    return ret;
+  }
+  dyn_clear(atlas, &slot->rect);
+  lru_unlink(atlas, idx);
+  slot->live = CHIMA_FALSE;
+  ++slot->gen;
+  slot->next = atlas->free_slot;
+  atlas->free_slot = idx;
+  --atlas->sprite_count;
+  return CHIMA_NO_ERROR;
+}
+
+static int victim_cmp(const void* a, const void* b) {
+  const dyn_victim* va = a;
+  const dyn_victim* vb = b;
+  if (va->y != vb->y) {
+    return va->y < vb->y ? -1 : 1;
+  }
+  return va->x < vb->x ? -1 : va->x > vb->x;
+}
+
+// Finds the run of neighbouring sprites on a shelf to evict for a `width` x `height` area,
+// padding included. `*count` is left at 0 if no shelf is tall enough.
+static chima_result dyn_pick_victims(chima_dyn_atlas atlas, chima_u32 width, chima_u32 height,
+                                     chima_u32* first, chima_u32* count) {
+  *first = *count = 0;
+  chima_result ret = grow_array(atlas->chima, (void**)&atlas->victims, &atlas->victim_cap,
+                                (chima_u32)atlas->sprite_count, sizeof(dyn_victim));
+  if (ret != CHIMA_NO_ERROR) {
+    return ret;
+  }
+  dyn_victim* victims = atlas->victims;
+  chima_u32 victim_count = 0;
+  for (chima_u32 i = 0; i < atlas->slot_count; ++i) {
+    const dyn_slot* slot = atlas->slots + i;
+    if (!slot->live) {
+      continue;
+    }
+    dyn_victim* victim = victims + victim_count++;
+    victim->x = slot->rect.x;
+    victim->y = slot->rect.y;
+    victim->end = slot->rect.x + slot->rect.width + atlas->padding;
+    victim->slot = i;
+  }
+  qsort(victims, victim_count, sizeof(dyn_victim), &victim_cmp);
+
+  const chima_u32 max_waste = shelf_max_waste(height);
+  chima_bool best_loose = CHIMA_TRUE;
+  uint64_t best_stamp = 0;
+  uint64_t best_area = 0;
+  chima_u32 shelf_first = 0;
+  for (chima_u32 s = 0; s < atlas->shelf_count; ++s) {
+    const dyn_shelf* shelf = atlas->shelves + s;
+    // Shelves are sorted by y, like the victims
+    while (shelf_first < victim_count && victims[shelf_first].y < shelf->y) {
+      ++shelf_first;
+    }
+    chima_u32 shelf_end = shelf_first;
+    while (shelf_end < victim_count && victims[shelf_end].y == shelf->y) {
+      ++shelf_end;
+    }
+    if (shelf->height < height) {
+      continue;
+    }
+    const chima_bool loose = shelf->height - height > max_waste;
+    if (*count && loose && !best_loose) {
+      continue;
+    }
+    // Evicting [i, j) frees everything between the sprites around the run
+    for (chima_u32 i = shelf_first; i < shelf_end; ++i) {
+      const chima_u32 start = i > shelf_first ? victims[i - 1].end : 0;
+      uint64_t stamp = 0;
+      uint64_t area = 0;
+      chima_u32 j = i;
+      while (j < shelf_end) {
+        const dyn_slot* slot = atlas->slots + victims[j].slot;
+        stamp = CHIMA_MAX(stamp, slot->stamp);
+        area += (uint64_t)slot->rect.width * slot->rect.height;
+        ++j;
+        const chima_u32 stop = j < shelf_end ? victims[j].x : atlas->width;
+        if (stop - start >= width) {
+          break;
+        }
+      }
+      const chima_u32 stop = j < shelf_end ? victims[j].x : atlas->width;
+      if (stop - start < width) {
+        break; // Runs starting further right are even shorter
+      }
+      const chima_bool better = !*count || (best_loose && !loose) ||
+                                (best_loose == loose && (stamp < best_stamp ||
+                                                         (stamp == best_stamp &&
+                                                          area < best_area)));
+      if (better) {
+        *first = i;
+        *count = j - i;
+        best_loose = loose;
+        best_stamp = stamp;
+        best_area = area;
+      }
+    }
+  }
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result dyn_evict(chima_dyn_atlas atlas, chima_u32 idx) {
+  const chima_dyn_sprite handle = slot_handle(atlas, idx);
+  const chima_rect rect = atlas->slots[idx].rect;
+  chima_result ret = slot_release(atlas, idx);
+  if (ret != CHIMA_NO_ERROR) {
+    return ret;
+  }
+  if (atlas->evict_callback) {
+    atlas->evict_callback(atlas->evict_user, handle, &rect);
+  }
+  return CHIMA_NO_ERROR;
+}
+
+chima_result chima_dyn_atlas_insert(chima_dyn_atlas atlas, const chima_image* image,
+                                    chima_bool evict, chima_dyn_sprite* sprite,
+                                    chima_rect* rect) {
+  if (!atlas || !image || !image->data || !sprite) {
+    return CHIMA_INVALID_VALUE;
+  }
+  if (image->depth != atlas->image.depth) {
+    return CHIMA_UNSUPPORTED_FORMAT;
+  }
+  chima_context chima = atlas->chima;
+  const chima_u32 width = image->extent.width + atlas->padding;
+  const chima_u32 height = image->extent.height + atlas->padding;
+  if (!image->extent.width || !image->extent.height || width > atlas->width ||
+      height > atlas->height) {
+    return CHIMA_PACKING_FAILED; // Wouldn't fit even in an empty atlas
+  }
+
+  // Reserve the slot first, so nothing is evicted for an insertion that can't finish
+  chima_u32 idx = atlas->free_slot;
+  if (idx == DYN_NIL) {
+    if (atlas->slot_count == DYN_SLOT_MASK) {
+      return CHIMA_ALLOC_FAILURE;
+    }
+    chima_result ret = grow_array(chima, (void**)&atlas->slots, &atlas->slot_cap,
+                                  atlas->slot_count + 1, sizeof(dyn_slot));
+    if (ret != CHIMA_NO_ERROR) {
+      return ret;
+    }
+    idx = atlas->slot_count++;
+    memset(atlas->slots + idx, 0, sizeof(dyn_slot));
+    atlas->slots[idx].next = atlas->free_slot;
+    atlas->free_slot = idx;
+  }
+
+  chima_u32 xpos, ypos;
+  chima_result ret;
+  while ((ret = dyn_alloc(atlas, width, height, &xpos, &ypos)) == CHIMA_PACKING_FAILED) {
+    // An empty atlas fits anything that passed the size check
+    CHIMA_ASSERT(atlas->lru_tail != DYN_NIL);
+    if (!evict) {
+      return CHIMA_PACKING_FAILED;
+    }
+    chima_u32 first, count;
+    ret = dyn_pick_victims(atlas, width, height, &first, &count);
+    if (ret != CHIMA_NO_ERROR) {
+      return ret;
+    }
+    if (!count) {
+      ret = dyn_evict(atlas, atlas->lru_tail);
+    }
+    for (chima_u32 i = first; i < first + count && ret == CHIMA_NO_ERROR; ++i) {
+      ret = dyn_evict(atlas, atlas->victims[i].slot);
+    }
+    if (ret != CHIMA_NO_ERROR) {
+      return ret;
+    }
+  }
+  if (ret != CHIMA_NO_ERROR) {
+    return ret;
+  }
+
+  // Releasing the victims may have pushed other free slots in front
+  if (atlas->free_slot == idx) {
+    atlas->free_slot = atlas->slots[idx].next;
+  } else {
+    chima_u32 prev = atlas->free_slot;
+    while (atlas->slots[prev].next != idx) {
+      prev = atlas->slots[prev].next;
+    }
+    atlas->slots[prev].next = atlas->slots[idx].next;
+  }
+  dyn_slot* slot = atlas->slots + idx;
+  slot->rect.x = xpos;
+  slot->rect.y = ypos;
+  slot->rect.width = image->extent.width;
+  slot->rect.height = image->extent.height;
+  slot->live = CHIMA_TRUE;
+  lru_push(atlas, idx);
+  ++atlas->sprite_count;
+
+  const chima_rect src_rect = {0, 0, image->extent.width, image->extent.height};
+  ret = chima__composite_rect(&atlas->image, image, &src_rect, xpos, ypos, CHIMA_BLEND_REPLACE);
+  if (ret != CHIMA_NO_ERROR) {
+    slot_release(atlas, idx);
+    return ret;
+  }
+  chima__mark_dirty(atlas->dirty, xpos, ypos, src_rect.width, src_rect.height);
+  *sprite = slot_handle(atlas, idx);
+  if (rect) {
+    *rect = slot->rect;
+  }
+  return CHIMA_NO_ERROR;
+}
+
+chima_result chima_dyn_atlas_remove(chima_dyn_atlas atlas, chima_dyn_sprite sprite) {
+  if (!atlas) {
+    return CHIMA_INVALID_VALUE;
+  }
+  const chima_u32 idx = slot_find(atlas, sprite);
+  if (idx == DYN_NIL) {
+    return CHIMA_INVALID_VALUE;
+  }
+  return slot_release(atlas, idx);
+}
+
+chima_result chima_dyn_atlas_touch(chima_dyn_atlas atlas, chima_dyn_sprite sprite) {
+  if (!atlas) {
+    return CHIMA_INVALID_VALUE;
+  }
+  const chima_u32 idx = slot_find(atlas, sprite);
+  if (idx == DYN_NIL) {
+    return CHIMA_INVALID_VALUE;
+  }
+  if (atlas->lru_head != idx) {
+    lru_unlink(atlas, idx);
+    lru_push(atlas, idx);
+  }
+  return CHIMA_NO_ERROR;
+}
+
+chima_result chima_dyn_atlas_get_rect(chima_dyn_atlas atlas, chima_dyn_sprite sprite,
+                                      chima_rect* rect) {
+  if (!atlas || !rect) {
+    return CHIMA_INVALID_VALUE;
+  }
+  const chima_u32 idx = slot_find(atlas, sprite);
+  if (idx == DYN_NIL) {
+    return CHIMA_INVALID_VALUE;
+  }
+  *rect = atlas->slots[idx].rect;
+  return CHIMA_NO_ERROR;
+}
+
+chima_size chima_dyn_atlas_sprite_count(chima_dyn_atlas atlas) {
+  return atlas ? atlas->sprite_count : 0;
+}
+
+const chima_image* chima_dyn_atlas_image(chima_dyn_atlas atlas) {
+  return atlas ? &atlas->image : NULL;
+}
+
+chima_dirty_tracker chima_dyn_atlas_dirty_tracker(chima_dyn_atlas atlas) {
+  return atlas ? atlas->dirty : NULL;
+}
+
+void chima_dyn_atlas_set_evict_callback(chima_dyn_atlas atlas, PFN_chima_dyn_evict callback,
+                                        void* user) {
+  if (!atlas) {
+    return;
+  }
+  atlas->evict_callback = callback;
+  atlas->evict_user = user;
+}
+
+void chima_destroy_dyn_atlas(chima_dyn_atlas atlas) {
+  if (!atlas) {
+    return;
+  }
+  chima_context chima = atlas->chima;
+  CHIMA_ASSERT(chima);
+  for (chima_u32 i = 0; i < atlas->shelf_count; ++i) {
+    CHIMA_FREE(atlas->shelves[i].spans);
+  }
+  CHIMA_FREE(atlas->shelves);
+  CHIMA_FREE(atlas->slots);
+  CHIMA_FREE(atlas->victims);
+  chima_destroy_dirty_tracker(atlas->dirty);
+  chima_destroy_image(chima, &atlas->image);
+  memset(atlas, 0, sizeof(*atlas));
+  CHIMA_FREE(atlas);
+}
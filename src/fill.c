@@ -0,0 +1,149 @@
+#include "./internal.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef CHIMA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/*
+ * Image filling.
+ *
+ * A color is converted once to a texel of the image format, and then broadcast as a pattern
+ * block that holds a whole number of texels. Every texel size (1 to 4 components of 1, 2 or 4
+ * bytes) divides `FILL_PATTERN_SIZE`, so the pattern can be stored back to back without
+ * breaking any texel.
+ *
+ * Non temporal stores were tried for big fills, but freshly allocated pages are already in cache
+ * after the kernel clears them on the first fault, so plain stores are faster.
+ */
+
+#define FILL_PATTERN_SIZE 192
+
+CHIMA_STATIC_ASSERT(FILL_PATTERN_SIZE % 32 == 0 && FILL_PATTERN_SIZE % 3 == 0);
+
+chima_size chima__color_texel(chima_color color, chima_u32 channels, chima_image_depth depth,
+                              chima_u8* texel) {
+  const chima_f32 comps[] = {
+    CHIMA_CLAMP(color.r, 0.f, 1.f),
+    CHIMA_CLAMP(color.g, 0.f, 1.f),
+    CHIMA_CLAMP(color.b, 0.f, 1.f),
+    CHIMA_CLAMP(color.a, 0.f, 1.f),
+  };
+  CHIMA_ASSERT(channels >= 1 && channels <= 4);
+  switch (depth) {
+    case CHIMA_DEPTH_8U: {
+      for (chima_u32 i = 0; i < channels; ++i) {
+        texel[i] = (chima_u8)floorf(comps[i] * 0xFF);
+      }
+    } break;
+    case CHIMA_DEPTH_16U: {
+      for (chima_u32 i = 0; i < channels; ++i) {
+        const chima_u16 comp = (chima_u16)floorf(comps[i] * 0xFFFF);
+        memcpy(texel + i * sizeof(comp), &comp, sizeof(comp));
+      }
+    } break;
+    case CHIMA_DEPTH_32F: {
+      memcpy(texel, comps, channels * sizeof(chima_f32));
+    } break;
+    default:
+      return 0;
+  }
+  return channels * chima__depth_size(depth);
+}
+
+#ifdef CHIMA_X86_SIMD
+CHIMA_TARGET("sse2")
+static chima_size fill_pattern_sse2(chima_u8* dst, chima_size bytes, const chima_u8* pattern) {
+  __m128i block[FILL_PATTERN_SIZE / 16];
+  for (chima_size i = 0; i < CHIMA_ARRAY_SIZE(block); ++i) {
+    block[i] = _mm_load_si128((const __m128i*)pattern + i);
+  }
+  chima_size done = 0;
+  for (; done + FILL_PATTERN_SIZE <= bytes; done += FILL_PATTERN_SIZE) {
+    for (chima_size i = 0; i < CHIMA_ARRAY_SIZE(block); ++i) {
+      _mm_store_si128((__m128i*)(dst + done) + i, block[i]);
+    }
+  }
+  return done;
+}
+
+CHIMA_TARGET("avx2")
+static chima_size fill_pattern_avx2(chima_u8* dst, chima_size bytes, const chima_u8* pattern) {
+  __m256i block[FILL_PATTERN_SIZE / 32];
+  for (chima_size i = 0; i < CHIMA_ARRAY_SIZE(block); ++i) {
+    block[i] = _mm256_load_si256((const __m256i*)pattern + i);
+  }
+  chima_size done = 0;
+  for (; done + FILL_PATTERN_SIZE <= bytes; done += FILL_PATTERN_SIZE) {
+    for (chima_size i = 0; i < CHIMA_ARRAY_SIZE(block); ++i) {
+      _mm256_store_si256((__m256i*)(dst + done) + i, block[i]);
+    }
+  }
+  return done;
+}
+#endif
+
+void chima__fill_texels(void* dst, chima_size count, const chima_u8* texel,
+                        chima_size texel_size) {
+  chima_u8* out = dst;
+  chima_size bytes = count * texel_size;
+  chima_bool uniform = CHIMA_TRUE;
+  for (chima_size i = 1; i < texel_size; ++i) {
+    uniform = uniform && texel[i] == texel[0];
+  }
+  if (uniform) {
+    memset(out, texel[0], bytes);
+    return;
+  }
+
+  // Copy single bytes until the output is aligned for the vector stores, the pattern starts
+  // wherever the head stopped inside of a texel.
+  chima_size head = (chima_size)(-(uintptr_t)out & 31);
+  head = head < bytes ? head : bytes;
+  for (chima_size i = 0; i < head; ++i) {
+    out[i] = texel[i % texel_size];
+  }
+  out += head;
+  bytes -= head;
+
+  _Alignas(32) chima_u8 pattern[FILL_PATTERN_SIZE];
+  for (chima_size i = 0; i < FILL_PATTERN_SIZE; ++i) {
+    pattern[i] = texel[(head + i) % texel_size];
+  }
+
+  chima_size done = 0;
+#ifdef CHIMA_X86_SIMD
+  const chima_bitfield cpu = chima__cpu_features();
+  if (cpu & CHIMA_CPU_FLAG_AVX2) {
+    done = fill_pattern_avx2(out, bytes, pattern);
+  } else if (cpu & CHIMA_CPU_FLAG_SSE2) {
+    done = fill_pattern_sse2(out, bytes, pattern);
+  }
+#endif
+  for (; done + FILL_PATTERN_SIZE <= bytes; done += FILL_PATTERN_SIZE) {
+    memcpy(out + done, pattern, FILL_PATTERN_SIZE);
+  }
+  memcpy(out + done, pattern, bytes - done);
+}
+
+chima_result chima_fill_image(chima_image* image, chima_color color, chima_dirty_tracker dirty) {
+  if (!image || !image->data) {
+    return CHIMA_INVALID_VALUE;
+  }
+  if (image->channels < 1 || image->channels > 4) {
+    return CHIMA_INVALID_VALUE;
+  }
+
+  chima_u8 texel[4 * sizeof(chima_f32)];
+  const chima_size texel_size = chima__color_texel(color, image->channels, image->depth, texel);
+  if (!texel_size) {
+    return CHIMA_INVALID_VALUE;
+  }
+  const chima_size count = (chima_size)image->extent.width * image->extent.height;
+  chima__fill_texels(image->data, count, texel, texel_size);
+  chima__mark_dirty(dirty, 0, 0, image->extent.width, image->extent.height);
+  return CHIMA_NO_ERROR;
+}
@@ -0,0 +1,680 @@
+#include "./internal.h"
+
+#include <string.h>
+
+#ifdef CHIMA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/*
+ * GIF animation loading.
+ *
+ * The file is scanned once to find where every frame starts, skipping the LZW data, and to
+ * track the state carried from frame to frame (palette transparency, disposal flags, delays).
+ * The LZW streams are then decoded on every thread, each one to palette indices in the arena
+ * slot of its own frame. A last sequential pass applies the disposal of the previous frame and
+ * draws the indices over it, which only touches every texel a few times.
+ *
+ * The output matches the stb_image GIF loader, quirks included: the first frame fills its
+ * undrawn texels with the background color in BGR order, transparent texels are never drawn,
+ * and corrupt data ends the animation at the last good frame.
+ */
+
+#define GIF_MAX_CODES 8192
+
+typedef struct gif_reader {
+  const chima_u8* data;
+  chima_size size;
+  chima_size pos;
+} gif_reader;
+
+// Past the end, reads return 0 like stb_image does
+static chima_u8 gif_get8(gif_reader* r) {
+  return r->pos < r->size ? r->data[r->pos++] : 0;
+}
+
+static chima_u32 gif_get16(gif_reader* r) {
+  const chima_u32 lo = gif_get8(r);
+  return lo | ((chima_u32)gif_get8(r) << 8);
+}
+
+static void gif_skip(gif_reader* r, chima_size count) {
+  r->pos = count < r->size - r->pos ? r->pos + count : r->size;
+}
+
+/*
+ * Animations live in a single block starting with the image array, so freeing `images` frees
+ * the whole animation:
+ *
+ *   [chima_image x n][chima_u32 x n][pad][frame 0 .. frame n-1]
+ *
+ * The arrays are sized for every frame in the file, frames dropped later only leave unused
+ * entries behind.
+ */
+#define ANIM_FRAME_ALIGN 16
+
+static chima_size anim_frames_offset(chima_size frame_count) {
+  const chima_size size = frame_count * (sizeof(chima_image) + sizeof(chima_u32));
+  return (size + ANIM_FRAME_ALIGN - 1) / ANIM_FRAME_ALIGN * ANIM_FRAME_ALIGN;
+}
+
+typedef struct gif_frame {
+  chima_size raster; // Offset of the LZW code size byte
+  chima_u32 x, y, width, height;
+  chima_u32 delay;
+  chima_u8 eflags;
+  chima_bool interlaced;
+  chima_bool global; // Uses the global palette
+  chima_bool bg_transparent; // A control extension after the first frame hid the background
+  chima_size count; // Decoded indices, in drawing order
+  chima_u8 palette[256][4]; // RGBA
+} gif_frame;
+
+typedef struct gif_file {
+  chima_u32 width, height;
+  chima_u8 flags;
+  chima_u8 bgindex;
+  chima_u8 palette[256][4]; // Global palette, RGBA with the transparency of the last frame
+  gif_frame* frames;
+  chima_size frame_count, frame_cap;
+} gif_file;
+
+static void gif_parse_palette(gif_reader* r, chima_u8 pal[256][4], chima_u32 count,
+                              int32_t transparent) {
+  for (chima_u32 i = 0; i < count; ++i) {
+    pal[i][0] = gif_get8(r);
+    pal[i][1] = gif_get8(r);
+    pal[i][2] = gif_get8(r);
+    pal[i][3] = (int32_t)i == transparent ? 0 : 255;
+  }
+}
+
+static chima_result gif_push_frame(chima_context chima, gif_file* gif, gif_frame** frame) {
+  if (gif->frame_count == gif->frame_cap) {
+    const chima_size cap = gif->frame_cap ? 2 * gif->frame_cap : 16;
+    gif_frame* frames = CHIMA_REALLOC(gif->frames, gif->frame_cap * sizeof(gif_frame),
+                                      cap * sizeof(gif_frame));
+    if (!frames) {
+      return CHIMA_ALLOC_FAILURE;
+    }
+    gif->frames = frames;
+    gif->frame_cap = cap;
+  }
+  *frame = &gif->frames[gif->frame_count++];
+  memset(*frame, 0, sizeof(**frame));
+  return CHIMA_NO_ERROR;
+}
+
+// Skips a chain of data sub-blocks, up to and including the empty one
+static void gif_skip_blocks(gif_reader* r) {
+  chima_u8 len;
+  while ((len = gif_get8(r)) != 0) {
+    gif_skip(r, len);
+  }
+}
+
+/*
+ * Finds every frame and the state it is decoded with. Anything stb_image would fail on ends
+ * the frame list there. Returns an error only if no frame can be loaded.
+ */
+static chima_result gif_scan(chima_context chima, gif_reader* r, gif_file* gif) {
+  if (gif_get8(r) != 'G' || gif_get8(r) != 'I' || gif_get8(r) != 'F' || gif_get8(r) != '8') {
+    return CHIMA_UNSUPPORTED_FORMAT;
+  }
+  const chima_u8 version = gif_get8(r);
+  if ((version != '7' && version != '9') || gif_get8(r) != 'a') {
+    return CHIMA_UNSUPPORTED_FORMAT;
+  }
+  gif->width = gif_get16(r);
+  gif->height = gif_get16(r);
+  gif->flags = gif_get8(r);
+  gif->bgindex = gif_get8(r);
+  gif_get8(r); // Aspect ratio
+  if (!gif->width || !gif->height) {
+    return CHIMA_IMAGE_PARSE_FAILURE;
+  }
+  if (gif->flags & 0x80) {
+    gif_parse_palette(r, gif->palette, 2u << (gif->flags & 7), -1);
+  }
+
+  int32_t transparent = -1;
+  chima_u8 eflags = 0;
+  chima_u32 delay = 0;
+  chima_bool bg_transparent = CHIMA_FALSE;
+  for (;;) {
+    const chima_u8 tag = gif_get8(r);
+    if (tag == 0x2C) {
+      // Image descriptor
+      const chima_u32 x = gif_get16(r), y = gif_get16(r);
+      const chima_u32 w = gif_get16(r), h = gif_get16(r);
+      if (x + w > gif->width || y + h > gif->height) {
+        break;
+      }
+      const chima_u8 lflags = gif_get8(r);
+      if (!(lflags & 0x80) && !(gif->flags & 0x80)) {
+        break; // Missing color table
+      }
+      gif_frame* frame;
+      const chima_result ret = gif_push_frame(chima, gif, &frame);
+      if (ret) {
+        return ret;
+      }
+      frame->x = x;
+      frame->y = y;
+      frame->width = w;
+      frame->height = h;
+      frame->delay = delay;
+      frame->eflags = eflags;
+      frame->interlaced = (lflags & 0x40) != 0;
+      frame->global = !(lflags & 0x80);
+      frame->bg_transparent = bg_transparent;
+      if (lflags & 0x80) {
+        gif_parse_palette(r, frame->palette, 2u << (lflags & 7),
+                          (eflags & 0x01) ? transparent : -1);
+      } else {
+        memcpy(frame->palette, gif->palette, sizeof(frame->palette));
+      }
+      frame->raster = r->pos;
+      if (gif_get8(r) > 12) {
+        --gif->frame_count;
+        break;
+      }
+      gif_skip_blocks(r);
+    } else if (tag == 0x21) {
+      // Extension, only the graphic control one matters
+      if (gif_get8(r) == 0xF9) {
+        const chima_u8 len = gif_get8(r);
+        if (len != 4) {
+          // stb_image skips the block but not its terminator, which is then read as a tag
+          gif_skip(r, len);
+          continue;
+        }
+        eflags = gif_get8(r);
+        delay = 10 * gif_get16(r); // 1/100th of a second to ms
+        if (transparent >= 0) {
+          gif->palette[transparent][3] = 255;
+        }
+        if (eflags & 0x01) {
+          transparent = gif_get8(r);
+          gif->palette[transparent][3] = 0;
+          bg_transparent |= gif->frame_count > 0 && transparent == gif->bgindex;
+        } else {
+          gif_skip(r, 1);
+          transparent = -1;
+        }
+      }
+      gif_skip_blocks(r);
+    } else {
+      break; // Trailer, or an unknown block
+    }
+  }
+  return gif->frame_count ? CHIMA_NO_ERROR : CHIMA_IMAGE_PARSE_FAILURE;
+}
+
+/*
+ * Sub-block data read through a 64 bit buffer, refilled with up to 7 bytes at once. Past the
+ * end of the data, bytes read as 0, which also ends the sub-block chain.
+ */
+typedef struct gif_bits {
+  const chima_u8* data;
+  chima_size size;
+  chima_size pos;
+  chima_u32 block; // Bytes left in the current sub-block
+  chima_bool end;  // Found the empty sub-block
+  uint64_t bits;
+  chima_u32 count;
+} gif_bits;
+
+static void gif_refill(gif_bits* b) {
+  while (b->count <= 55) {
+    if (!b->block) {
+      if (b->end) {
+        return;
+      }
+      b->block = b->pos < b->size ? b->data[b->pos++] : 0;
+      if (!b->block) {
+        b->end = CHIMA_TRUE;
+        return;
+      }
+    }
+    chima_u32 n = (63 - b->count) >> 3;
+    n = n < b->block ? n : b->block;
+    uint64_t word = 0;
+    if (b->size - b->pos >= sizeof(word)) {
+      memcpy(&word, b->data + b->pos, sizeof(word)); // Little endian
+      word &= ((uint64_t)1 << (8 * n)) - 1;
+      b->pos += n;
+    } else {
+      for (chima_u32 i = 0; i < n; ++i) {
+        word |= (uint64_t)(b->pos < b->size ? b->data[b->pos++] : 0) << (8 * i);
+      }
+    }
+    b->bits |= word << b->count;
+    b->count += 8 * n;
+    b->block -= n;
+  }
+}
+
+/*
+ * Every string is the string of an older code plus one index, so it is already in the output
+ * where that code was drawn. Entries keep that position and are drawn by copying the run, only
+ * the last index comes from the table.
+ */
+typedef struct gif_lzw_entry {
+  chima_u32 pos;
+  chima_u16 len;
+  chima_u8 first;
+  chima_u8 suffix;
+} gif_lzw_entry;
+
+// Copies in 8 byte chunks, `dst` must have room for `len` rounded up to 8
+static void gif_copy_run(chima_u8* dst, const chima_u8* src, chima_size len) {
+  for (chima_size i = 0; i < len; i += 8) {
+    uint64_t chunk;
+    memcpy(&chunk, src + i, sizeof(chunk));
+    memcpy(dst + i, &chunk, sizeof(chunk));
+  }
+}
+
+/*
+ * Decodes the LZW stream at `pos` to at most `max_count` palette indices, in drawing order.
+ * Returns the number of indices decoded, stopping at the end code, the end of the data, or the
+ * first invalid code. `ok` is cleared on invalid codes.
+ */
+static chima_size gif_decode_lzw(const chima_u8* data, chima_size size, chima_size pos,
+                                 chima_u8* out, chima_size max_count, chima_bool* ok) {
+  gif_lzw_entry codes[GIF_MAX_CODES];
+  const chima_u32 lzw_cs = pos < size ? data[pos++] : 0;
+  const int32_t clear = 1 << lzw_cs;
+  int32_t codesize = (int32_t)lzw_cs + 1;
+  int32_t codemask = (1 << codesize) - 1;
+  for (int32_t i = 0; i < clear; ++i) {
+    codes[i].pos = 0;
+    codes[i].len = 1;
+    codes[i].first = (chima_u8)i;
+    codes[i].suffix = (chima_u8)i;
+  }
+  int32_t avail = clear + 2, oldcode = -1;
+  chima_bool first = CHIMA_TRUE;
+  gif_bits b = {data, size, pos, 0, CHIMA_FALSE, 0, 0};
+  chima_size count = 0, last = 0;
+  *ok = CHIMA_TRUE;
+
+  for (;;) {
+    if (b.count < (chima_u32)codesize) {
+      gif_refill(&b);
+      if (b.count < (chima_u32)codesize) {
+        return count;
+      }
+    }
+    const int32_t code = (int32_t)(b.bits & (uint64_t)codemask);
+    b.bits >>= codesize;
+    b.count -= (chima_u32)codesize;
+    if (code == clear) {
+      codesize = (int32_t)lzw_cs + 1;
+      codemask = (1 << codesize) - 1;
+      avail = clear + 2;
+      oldcode = -1;
+      first = CHIMA_FALSE;
+    } else if (code == clear + 1) {
+      return count; // End code
+    } else if (code <= avail && !first) {
+      if (oldcode >= 0) {
+        gif_lzw_entry* p = &codes[avail++];
+        if (avail > GIF_MAX_CODES) {
+          *ok = CHIMA_FALSE;
+          return count;
+        }
+        // The string of `oldcode` followed by the first index of `code`, which is drawn next
+        p->pos = (chima_u32)last;
+        p->len = codes[oldcode].len + 1;
+        p->first = codes[oldcode].first;
+        p->suffix = codes[code].first; // The new entry itself if `code` is the one just added
+      } else if (code == avail) {
+        *ok = CHIMA_FALSE;
+        return count;
+      }
+
+      // Past the end, codes are still checked but no longer drawn
+      const gif_lzw_entry* e = &codes[code];
+      if (count + e->len + 8 <= max_count) {
+        gif_copy_run(out + count, out + e->pos, e->len - 1u);
+        out[count + e->len - 1] = e->suffix;
+      } else if (count < max_count) {
+        const chima_size n = CHIMA_MIN((chima_size)e->len - 1, max_count - count);
+        memcpy(out + count, out + e->pos, n);
+        if (count + e->len <= max_count) {
+          out[count + e->len - 1] = e->suffix;
+        }
+      }
+      last = count < max_count ? count : 0;
+      count += e->len;
+
+      if ((avail & codemask) == 0 && avail <= 0x0FFF) {
+        ++codesize;
+        codemask = (1 << codesize) - 1;
+      }
+      oldcode = code;
+    } else {
+      *ok = CHIMA_FALSE;
+      return count;
+    }
+  }
+}
+
+typedef struct gif_decode_job {
+  const chima_u8* data;
+  chima_size size;
+  gif_frame* frames;
+  chima_u8* arena;
+  chima_size frame_size;
+  chima_size index_offset; // Indices go at the end of each frame slot
+  chima_bool* valid;
+} gif_decode_job;
+
+static chima_result gif_decode_frame(void* user, chima_size idx) {
+  const gif_decode_job* job = user;
+  gif_frame* frame = &job->frames[idx];
+  const chima_size max_count = (chima_size)frame->width * frame->height;
+  chima_u8* out = job->arena + idx * job->frame_size + job->index_offset;
+  const chima_size count =
+    gif_decode_lzw(job->data, job->size, frame->raster, out, max_count, &job->valid[idx]);
+  frame->count = count < max_count ? count : max_count;
+  return CHIMA_NO_ERROR;
+}
+
+// Canvas row of each drawn row of an interlaced frame
+static void gif_interlace_rows(chima_u32* rows, chima_u32 height) {
+  static const chima_u32 start[4] = {0, 4, 2, 1};
+  static const chima_u32 step[4] = {8, 8, 4, 2};
+  chima_u32 n = 0;
+  for (chima_u32 pass = 0; pass < 4; ++pass) {
+    for (chima_u32 y = start[pass]; y < height; y += step[pass]) {
+      rows[n++] = y;
+    }
+  }
+}
+
+/*
+ * Draws `count` palette indices over a canvas row. Colors are RGBA packed in little endian, and
+ * only colors with an alpha over 128 are drawn. The SIMD kernels produce the exact same bytes.
+ */
+typedef void (*PFN_gif_draw_row)(chima_u8* dst, const chima_u8* src, chima_size count,
+                                 const chima_u32* palette);
+
+static void gif_draw_row_scalar(chima_u8* dst, const chima_u8* src, chima_size count,
+                                const chima_u32* palette) {
+  for (chima_size i = 0; i < count; ++i) {
+    const chima_u32 c = palette[src[i]];
+    if ((c >> 24) > 128) {
+      memcpy(dst + 4 * i, &c, sizeof(c));
+    }
+  }
+}
+
+#ifdef CHIMA_X86_SIMD
+CHIMA_TARGET("sse2")
+static void gif_draw_row_sse2(chima_u8* dst, const chima_u8* src, chima_size count,
+                              const chima_u32* palette) {
+  const __m128i threshold = _mm_set1_epi32(128);
+  chima_size i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i c = _mm_setr_epi32((int)palette[src[i]], (int)palette[src[i + 1]],
+                                     (int)palette[src[i + 2]], (int)palette[src[i + 3]]);
+    const __m128i opaque = _mm_cmpgt_epi32(_mm_srli_epi32(c, 24), threshold);
+    __m128i* out = (__m128i*)(dst + 4 * i);
+    const __m128i d = _mm_loadu_si128(out);
+    _mm_storeu_si128(out, _mm_or_si128(_mm_and_si128(opaque, c), _mm_andnot_si128(opaque, d)));
+  }
+  gif_draw_row_scalar(dst + 4 * i, src + i, count - i, palette);
+}
+
+CHIMA_TARGET("avx2")
+static void gif_draw_row_avx2(chima_u8* dst, const chima_u8* src, chima_size count,
+                              const chima_u32* palette) {
+  const __m256i threshold = _mm256_set1_epi32(128);
+  chima_size i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+    const __m256i c = _mm256_i32gather_epi32((const int*)palette, idx, 4);
+    const __m256i opaque = _mm256_cmpgt_epi32(_mm256_srli_epi32(c, 24), threshold);
+    _mm256_maskstore_epi32((int*)(dst + 4 * i), opaque, c);
+  }
+  gif_draw_row_sse2(dst + 4 * i, src + i, count - i, palette);
+}
+#endif
+
+static PFN_gif_draw_row select_draw_row(void) {
+#ifdef CHIMA_X86_SIMD
+  const chima_bitfield cpu = chima__cpu_features();
+  if (cpu & CHIMA_CPU_FLAG_AVX2) {
+    return &gif_draw_row_avx2;
+  }
+  if (cpu & CHIMA_CPU_FLAG_SSE2) {
+    return &gif_draw_row_sse2;
+  }
+#endif
+  return &gif_draw_row_scalar;
+}
+
+static chima_u32 gif_dispose(const gif_frame* frame) {
+  return (frame->eflags & 0x1C) >> 2;
+}
+
+// Compares the texels of two canvases inside a frame rect
+static chima_bool gif_rect_equal(const gif_file* gif, const chima_u8* a, const chima_u8* b,
+                                 const gif_frame* rect) {
+  for (chima_u32 y = rect->y; y < rect->y + rect->height; ++y) {
+    const chima_size base = 4 * ((chima_size)y * gif->width + rect->x);
+    if (memcmp(a + base, b + base, 4 * (chima_size)rect->width) != 0) {
+      return CHIMA_FALSE;
+    }
+  }
+  return CHIMA_TRUE;
+}
+
+/*
+ * Draws every frame over the previous one, in order. `canvas` is the frame slot, `background`
+ * holds what the frame covers before drawing it, and `history` marks the texels it drew. A
+ * frame only draws inside its rect, so both are only kept there.
+ *
+ * If `merge` is set, a frame equal to the previous one is dropped and its delay added to the
+ * previous one, the next frame is drawn in its slot. Returns the number of frames kept, the
+ * delay of slot `i` is left in `gif->frames[i]`.
+ */
+static chima_size gif_compose(gif_file* gif, chima_u8* arena, chima_size frame_size,
+                              chima_size index_offset, chima_size frame_count,
+                              chima_u8* background, chima_u8* history, chima_u8* indices,
+                              chima_u32* rows, chima_bool merge) {
+  const chima_size texels = (chima_size)gif->width * gif->height;
+  const PFN_gif_draw_row draw_row = select_draw_row();
+  chima_bool bg_opaque = CHIMA_FALSE;
+  chima_size kept = 0;
+  for (chima_size f = 0; f < frame_count; ++f) {
+    const gif_frame* frame = &gif->frames[f];
+    // Slot `kept` is at or before slot `f`, whose indices are still there
+    chima_u8* canvas = arena + kept * frame_size;
+    memcpy(indices, arena + f * frame_size + index_offset, frame->count);
+    if (!f) {
+      memset(canvas, 0, 4 * texels);
+      memset(history, 0, texels);
+    } else {
+      memcpy(canvas, canvas - frame_size, 4 * texels);
+      const gif_frame* prev = &gif->frames[f - 1];
+      const chima_u32 dispose = gif_dispose(prev);
+      for (chima_u32 y = prev->y; y < prev->y + prev->height; ++y) {
+        const chima_size base = (chima_size)y * gif->width + prev->x;
+        if (dispose == 2 || dispose == 3) {
+          // Without the frame from two back, "previous" disposal falls back to the background
+          for (chima_size i = base; i < base + prev->width; ++i) {
+            if (history[i]) {
+              memcpy(canvas + 4 * i, background + 4 * i, 4);
+            }
+          }
+        }
+        memset(history + base, 0, prev->width);
+      }
+    }
+    const chima_u32 dispose = gif_dispose(frame);
+    if (dispose == 2 || dispose == 3) {
+      for (chima_u32 y = frame->y; y < frame->y + frame->height; ++y) {
+        const chima_size base = 4 * ((chima_size)y * gif->width + frame->x);
+        memcpy(background + base, canvas + base, 4 * (chima_size)frame->width);
+      }
+    }
+
+    chima_u8 colors[256][4];
+    memcpy(colors, frame->palette, sizeof(colors));
+    // Filling the first frame leaves the background entry opaque until a control extension
+    // makes it transparent again
+    if (bg_opaque && frame->global && !frame->bg_transparent) {
+      colors[gif->bgindex][3] = 255;
+    }
+    chima_u32 palette[256];
+    memcpy(palette, colors, sizeof(palette));
+
+    if (frame->interlaced) {
+      gif_interlace_rows(rows, frame->height);
+    }
+    const chima_u32 width = frame->width;
+    for (chima_size row = 0; width && row * width < frame->count; ++row) {
+      const chima_u32 y = frame->y + (frame->interlaced ? rows[row] : (chima_u32)row);
+      const chima_size base = (chima_size)y * gif->width + frame->x;
+      const chima_u8* src = indices + row * width;
+      const chima_size n =
+        frame->count - row * width < width ? frame->count - row * width : width;
+      memset(history + base, 1, n);
+      draw_row(canvas + 4 * base, src, n, palette);
+    }
+
+    if (!f && gif->bgindex > 0) {
+      for (chima_size i = 0; i < texels; ++i) {
+        if (!history[i]) {
+          // stb_image copies its palette entry as is, which is stored in BGR order
+          const chima_u8* c = gif->palette[gif->bgindex];
+          chima_u8* texel = canvas + 4 * i;
+          texel[0] = c[2];
+          texel[1] = c[1];
+          texel[2] = c[0];
+          texel[3] = 255;
+          bg_opaque = CHIMA_TRUE;
+        }
+      }
+    }
+
+    // Only the rects of this frame and the previous one can differ from the previous canvas
+    if (merge && f && gif_rect_equal(gif, canvas, canvas - frame_size, &gif->frames[f - 1]) &&
+        gif_rect_equal(gif, canvas, canvas - frame_size, frame)) {
+      gif->frames[kept - 1].delay += frame->delay;
+    } else {
+      gif->frames[kept++].delay = frame->delay;
+    }
+  }
+  return kept;
+}
+
+chima_result chima__load_gif(chima_context chima, chima_image_anim* anim, const chima_u8* data,
+                             chima_size size) {
+  gif_file gif;
+  memset(&gif, 0, sizeof(gif));
+  gif_reader r = {data, size, 0};
+  chima_result ret = gif_scan(chima, &r, &gif);
+  if (ret) {
+    goto free_frames;
+  }
+
+  const chima_size texels = (chima_size)gif.width * gif.height;
+  const chima_size frame_size = 4 * texels;
+  if (frame_size / 4 != texels ||
+      (SIZE_MAX - ANIM_FRAME_ALIGN) / (frame_size + sizeof(chima_image) + sizeof(chima_u32)) <
+        gif.frame_count) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_frames;
+  }
+  chima_size frame_count = gif.frame_count;
+  const chima_size frames_offset = anim_frames_offset(frame_count);
+  const chima_size arena_size = frames_offset + frame_count * frame_size;
+  chima_u8* arena = CHIMA_MALLOC(arena_size);
+  if (!arena) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_frames;
+  }
+  // Scratch for the composition, and the validity of each decoded frame
+  chima_u8* scratch = CHIMA_MALLOC(gif.height * sizeof(chima_u32) +
+                                   frame_count * sizeof(chima_bool) + 6 * texels);
+  if (!scratch) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_arena;
+  }
+  chima_u32* rows = (chima_u32*)scratch;
+  chima_bool* valid = (chima_bool*)(rows + gif.height);
+  chima_u8* background = (chima_u8*)(valid + frame_count);
+  chima_u8* history = background + frame_size;
+  chima_u8* indices = history + texels;
+
+  gif_decode_job job;
+  job.data = data;
+  job.size = size;
+  job.frames = gif.frames;
+  job.arena = arena + frames_offset;
+  job.frame_size = frame_size;
+  job.index_offset = frame_size - texels;
+  job.valid = valid;
+  ret = chima__parallel_for(chima, frame_count, &gif_decode_frame, &job);
+  if (ret) {
+    goto free_scratch;
+  }
+  // A corrupt frame ends the animation
+  for (chima_size f = 0; f < frame_count; ++f) {
+    if (!valid[f]) {
+      frame_count = f;
+      break;
+    }
+  }
+  if (!frame_count) {
+    ret = CHIMA_IMAGE_PARSE_FAILURE;
+    goto free_scratch;
+  }
+  frame_count = gif_compose(&gif, arena + frames_offset, frame_size, job.index_offset,
+                            frame_count, background, history, indices, rows,
+                            (chima->flags & CHIMA_CTX_FLAG_ANIM_MERGE_FRAMES) != 0);
+
+  // Dropped frames were at the end of the block
+  const chima_size final_size = frames_offset + frame_count * frame_size;
+  if (final_size < arena_size) {
+    // Shrinking can't fail, keep the bigger block if the allocator can't move it
+    chima_u8* mem = CHIMA_REALLOC(arena, arena_size, final_size);
+    if (mem) {
+      arena = mem;
+    }
+  }
+  chima_image* images = (chima_image*)arena;
+  chima_u32* frametimes = (chima_u32*)(images + frame_count);
+  memset(images, 0, frame_count * sizeof(chima_image));
+  for (chima_size f = 0; f < frame_count; ++f) {
+    images[f].data = arena + frames_offset + f * frame_size;
+    images[f].extent.width = gif.width;
+    images[f].extent.height = gif.height;
+    images[f].channels = 4;
+    images[f].depth = CHIMA_DEPTH_8U;
+    frametimes[f] = gif.frames[f].delay;
+  }
+
+  memset(anim, 0, sizeof(chima_image_anim));
+  anim->images = images;
+  anim->frametimes = frametimes;
+  anim->image_count = frame_count;
+  arena = NULL;
+
+free_scratch:
+  CHIMA_FREE(scratch);
+free_arena:
+  if (arena) {
+    CHIMA_FREE(arena);
+  }
+free_frames:
+  if (gif.frames) {
+    CHIMA_FREE(gif.frames);
+  }
+  return ret;
+}
@@ -0,0 +1,140 @@
+#include "./internal.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef CHIMA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/*
+ * Content hashing.
+ *
+ * The data is read in 64 byte stripes of 8 64 bit lanes, accumulated like XXH3:
+ *   dk = d ^ (key[l] + stripe * HASH_STEP)
+ *   acc[l ^ 1] += d
+ *   acc[l] += lo32(dk) * hi32(dk)
+ * Only a 32x32->64 multiply is needed per lane, so every lane pair fits a `pmuludq`. Adding the
+ * stripe index to the key makes the products depend on the stripe position. The tail is padded
+ * with zeros to a full stripe, and the size is mixed in when finalizing.
+ *
+ * The hash is only meant for finding duplicates in memory (equal hashes are always compared
+ * byte by byte), but the SIMD kernels produce the same value as the scalar one anyway.
+ */
+
+#define HASH_STRIPE 64
+#define HASH_LANES  8
+#define HASH_STEP   0x9E3779B97F4A7C15ull
+#define HASH_PRIME  0x165667919E3779F9ull
+
+static const uint64_t hash_keys[HASH_LANES] = {
+  0xBE4BA423396CFEB8ull, 0x1CAD21F72C81017Cull, 0xDB979083E96DD4DEull, 0x1F67B3B7A4A44072ull,
+  0x78E5C0CC4EE679CBull, 0x2172FFCC7DD05A82ull, 0x8E2443F7744608B8ull, 0x4C263A81E69035E0ull,
+};
+
+static void hash_stripes_scalar(uint64_t* acc, const chima_u8* data, chima_size first,
+                                chima_size count) {
+  for (chima_size s = 0; s < count; ++s) {
+    const uint64_t step = (first + s) * HASH_STEP;
+    for (chima_u32 l = 0; l < HASH_LANES; ++l) {
+      uint64_t d;
+      memcpy(&d, data + s * HASH_STRIPE + l * sizeof(d), sizeof(d));
+      const uint64_t dk = d ^ (hash_keys[l] + step);
+      acc[l ^ 1] += d;
+      acc[l] += (dk & 0xFFFFFFFFull) * (dk >> 32);
+    }
+  }
+}
+
+#ifdef CHIMA_X86_SIMD
+CHIMA_TARGET("sse2")
+static void hash_stripes_sse2(uint64_t* acc, const chima_u8* data, chima_size first,
+                              chima_size count) {
+  __m128i vacc[HASH_LANES / 2], vkey[HASH_LANES / 2];
+  for (chima_u32 i = 0; i < HASH_LANES / 2; ++i) {
+    vacc[i] = _mm_loadu_si128((const __m128i*)acc + i);
+    vkey[i] = _mm_add_epi64(_mm_loadu_si128((const __m128i*)hash_keys + i),
+                            _mm_set1_epi64x((long long)(first * HASH_STEP)));
+  }
+  const __m128i vstep = _mm_set1_epi64x((long long)HASH_STEP);
+  for (chima_size s = 0; s < count; ++s) {
+    const __m128i* stripe = (const __m128i*)(data + s * HASH_STRIPE);
+    for (chima_u32 i = 0; i < HASH_LANES / 2; ++i) {
+      const __m128i d = _mm_loadu_si128(stripe + i);
+      const __m128i dk = _mm_xor_si128(d, vkey[i]);
+      const __m128i prod = _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32));
+      const __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+      vacc[i] = _mm_add_epi64(vacc[i], _mm_add_epi64(prod, swapped));
+      vkey[i] = _mm_add_epi64(vkey[i], vstep);
+    }
+  }
+  for (chima_u32 i = 0; i < HASH_LANES / 2; ++i) {
+    _mm_storeu_si128((__m128i*)acc + i, vacc[i]);
+  }
+}
+
+CHIMA_TARGET("avx2")
+static void hash_stripes_avx2(uint64_t* acc, const chima_u8* data, chima_size first,
+                              chima_size count) {
+  __m256i vacc[HASH_LANES / 4], vkey[HASH_LANES / 4];
+  for (chima_u32 i = 0; i < HASH_LANES / 4; ++i) {
+    vacc[i] = _mm256_loadu_si256((const __m256i*)acc + i);
+    vkey[i] = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)hash_keys + i),
+                               _mm256_set1_epi64x((long long)(first * HASH_STEP)));
+  }
+  const __m256i vstep = _mm256_set1_epi64x((long long)HASH_STEP);
+  for (chima_size s = 0; s < count; ++s) {
+    const __m256i* stripe = (const __m256i*)(data + s * HASH_STRIPE);
+    for (chima_u32 i = 0; i < HASH_LANES / 4; ++i) {
+      const __m256i d = _mm256_loadu_si256(stripe + i);
+      const __m256i dk = _mm256_xor_si256(d, vkey[i]);
+      const __m256i prod = _mm256_mul_epu32(dk, _mm256_srli_epi64(dk, 32));
+      const __m256i swapped = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+      vacc[i] = _mm256_add_epi64(vacc[i], _mm256_add_epi64(prod, swapped));
+      vkey[i] = _mm256_add_epi64(vkey[i], vstep);
+    }
+  }
+  for (chima_u32 i = 0; i < HASH_LANES / 4; ++i) {
+    _mm256_storeu_si256((__m256i*)acc + i, vacc[i]);
+  }
+}
+#endif
+
+static uint64_t hash_avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= HASH_PRIME;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t chima__hash_bytes(const void* data, chima_size size) {
+  const chima_u8* bytes = data;
+  uint64_t acc[HASH_LANES] = {0};
+  const chima_size stripes = size / HASH_STRIPE;
+
+#ifdef CHIMA_X86_SIMD
+  const chima_bitfield cpu = chima__cpu_features();
+  if (cpu & CHIMA_CPU_FLAG_AVX2) {
+    hash_stripes_avx2(acc, bytes, 0, stripes);
+  } else if (cpu & CHIMA_CPU_FLAG_SSE2) {
+    hash_stripes_sse2(acc, bytes, 0, stripes);
+  } else
+#endif
+  {
+    hash_stripes_scalar(acc, bytes, 0, stripes);
+  }
+
+  const chima_size tail = size - stripes * HASH_STRIPE;
+  if (tail) {
+    chima_u8 last[HASH_STRIPE] = {0};
+    memcpy(last, bytes + stripes * HASH_STRIPE, tail);
+    hash_stripes_scalar(acc, last, stripes, 1);
+  }
+
+  uint64_t h = (uint64_t)size * HASH_STEP;
+  for (chima_u32 l = 0; l < HASH_LANES; ++l) {
+    h = (h ^ hash_avalanche(acc[l] ^ hash_keys[l])) * HASH_PRIME;
+    h = (h << 31) | (h >> 33);
+  }
+  return hash_avalanche(h);
+}
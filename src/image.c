@@ -1,5 +1,7 @@
 #include "./internal.h"
 
+#include <math.h>
+
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_STATIC
 #define STBI_NO_FAILURE_STRINGS
@@ -13,10 +15,6 @@
 #define STB_IMAGE_WRITE_STATIC
 #include "./stb/stb_image_write.h"
 
-#define STB_RECT_PACK_IMPLEMENTATION
-#define STBRP_STATIC
-#include "./stb/stb_rect_pack.h"
-
 chima_u32 chima_set_atlas_initial(chima_context chima, chima_u32 initial) {
   CHIMA_ASSERT(chima != NULL && "Invalid chima context");
   CHIMA_ASSERT(initial > 0 && "Invalid atlas initial size");
@@ -33,6 +31,120 @@ chima_f32 chima_set_atlas_factor(chima_context chima, chima_f32 factor) {
   return old;
 }
 
+chima_u32 chima_set_thread_count(chima_context chima, chima_u32 count) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_u32 old = chima->thread_count;
+  if (count != old) {
+    chima__destroy_thread_pool(chima); // Restarted with the new count when needed
+  }
+  chima->thread_count = count;
+  return old;
+}
+
+chima_bool chima_set_atlas_pow2(chima_context chima, chima_bool pow2) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_bool old = (chima->flags & CHIMA_CTX_FLAG_ATLAS_POW2) != 0;
+  chima->flags = CHIMA_SET_FLAG(pow2, chima->flags, CHIMA_CTX_FLAG_ATLAS_POW2);
+  return old;
+}
+
+chima_bool chima_set_atlas_non_square(chima_context chima, chima_bool non_square) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_bool old = (chima->flags & CHIMA_CTX_FLAG_ATLAS_NON_SQUARE) != 0;
+  chima->flags = CHIMA_SET_FLAG(non_square, chima->flags, CHIMA_CTX_FLAG_ATLAS_NON_SQUARE);
+  return old;
+}
+
+chima_u32 chima_set_atlas_multiple(chima_context chima, chima_u32 multiple) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  CHIMA_ASSERT(multiple > 0 && "Invalid atlas size multiple");
+  chima_u32 old = chima->atlas_multiple;
+  chima->atlas_multiple = multiple;
+  return old;
+}
+
+chima_packer_type chima_set_atlas_packer(chima_context chima, chima_packer_type type) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  CHIMA_ASSERT(type >= 0 && type < _CHIMA_PACKER_COUNT && "Invalid packer type");
+  chima_packer_type old = chima->packer_type;
+  chima->packer_type = type;
+  return old;
+}
+
+chima_packer chima_set_custom_packer(chima_context chima, chima_packer packer) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_packer old = chima->packer_custom;
+  chima->packer_custom = packer;
+  return old;
+}
+
+chima_result chima_get_atlas_stats(chima_context chima, chima_atlas_stats* stats) {
+  if (!chima || !stats) {
+    return CHIMA_INVALID_VALUE;
+  }
+  *stats = chima->atlas_stats;
+  return CHIMA_NO_ERROR;
+}
+
+chima_u32 chima_set_atlas_max_size(chima_context chima, chima_u32 size) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  CHIMA_ASSERT(size > 0 && "Invalid atlas max size");
+  chima_u32 old = chima->atlas_max_size;
+  chima->atlas_max_size = size < CHIMA_ATLAS_MAX_SIZE ? size : CHIMA_ATLAS_MAX_SIZE;
+  return old;
+}
+
+chima_bitfield chima_set_atlas_best_of(chima_context chima, chima_bitfield packers) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  CHIMA_ASSERT(packers < (1u << _CHIMA_PACKER_COUNT) && "Invalid packer flags");
+  chima_bitfield old = chima->packer_best_of;
+  chima->packer_best_of = packers;
+  return old;
+}
+
+chima_bool chima_set_sprite_trim(chima_context chima, chima_bool trim) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_bool old = (chima->flags & CHIMA_CTX_FLAG_SPRITE_TRIM) != 0;
+  chima->flags = CHIMA_SET_FLAG(trim, chima->flags, CHIMA_CTX_FLAG_SPRITE_TRIM);
+  return old;
+}
+
+chima_bool chima_set_atlas_group_anims(chima_context chima, chima_bool group) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_bool old = (chima->flags & CHIMA_CTX_FLAG_ATLAS_GROUP_ANIMS) != 0;
+  chima->flags = CHIMA_SET_FLAG(group, chima->flags, CHIMA_CTX_FLAG_ATLAS_GROUP_ANIMS);
+  return old;
+}
+
+chima_bool chima_set_atlas_rotation(chima_context chima, chima_bool rotate) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_bool old = (chima->flags & CHIMA_CTX_FLAG_ATLAS_ROTATE) != 0;
+  chima->flags = CHIMA_SET_FLAG(rotate, chima->flags, CHIMA_CTX_FLAG_ATLAS_ROTATE);
+  return old;
+}
+
+chima_u32 chima_set_atlas_block_size(chima_context chima, chima_u32 block) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  CHIMA_ASSERT(block > 0 && "Invalid atlas block size");
+  chima_u32 old = chima->atlas_block;
+  chima->atlas_block = block;
+  return old;
+}
+
+chima_u32 chima_set_atlas_extrude(chima_context chima, chima_u32 extrude) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_u32 old = chima->atlas_extrude;
+  chima->atlas_extrude = extrude;
+  return old;
+}
+
+chima_u32 chima_set_atlas_bleed(chima_context chima, chima_u32 radius) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_u32 old = chima->atlas_bleed;
+  chima->atlas_bleed = CHIMA_MIN(radius, CHIMA_BLEED_MAX_RADIUS);
+  return old;
+}
+
 chima_bool chima_set_flip_y(chima_context chima, chima_bool flip_y) {
   CHIMA_ASSERT(chima != NULL && "Invalid chima context");
   chima_bool old = chima->flags & CHIMA_CTX_FLAG_FLIP_Y;
@@ -40,68 +152,70 @@ chima_bool chima_set_flip_y(chima_context chima, chima_bool flip_y) {
   return old;
 }
 
+chima_bool chima_set_anim_merge_frames(chima_context chima, chima_bool merge) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_bool old = (chima->flags & CHIMA_CTX_FLAG_ANIM_MERGE_FRAMES) != 0;
+  chima->flags = CHIMA_SET_FLAG(merge, chima->flags, CHIMA_CTX_FLAG_ANIM_MERGE_FRAMES);
+  return old;
+}
+
+chima_bool chima_set_sheet_map_file(chima_context chima, chima_bool map) {
+  CHIMA_ASSERT(chima != NULL && "Invalid chima context");
+  chima_bool old = (chima->flags & CHIMA_CTX_FLAG_SHEET_MAP_FILE) != 0;
+  chima->flags = CHIMA_SET_FLAG(map, chima->flags, CHIMA_CTX_FLAG_SHEET_MAP_FILE);
+  return old;
+}
+
+static chima_bool is_zero_texel(const chima_u8* texel, chima_size texel_size) {
+  for (chima_size i = 0; i < texel_size; ++i) {
+    if (texel[i]) {
+      return CHIMA_FALSE;
+    }
+  }
+  return CHIMA_TRUE;
+}
+
 chima_result chima_gen_blank_image(chima_context chima, chima_image* image, chima_u32 width,
                                    chima_u32 height, chima_u32 channels, chima_image_depth depth,
                                    chima_color background_color) {
+  return chima_gen_blank_image_ex(chima, image, width, height, channels, depth, background_color,
+                                  CHIMA_FILL_COLOR);
+}
+
+chima_result chima_gen_blank_image_ex(chima_context chima, chima_image* image, chima_u32 width,
+                                      chima_u32 height, chima_u32 channels,
+                                      chima_image_depth depth, chima_color background_color,
+                                      chima_fill_mode mode) {
   if (!chima || !image || !width || !height) {
     return CHIMA_INVALID_VALUE;
   }
+  if ((chima_u32)mode >= _CHIMA_FILL_COUNT) {
+    return CHIMA_INVALID_VALUE;
+  }
 
   channels = CHIMA_CLAMP(channels, 1, 4);
-  background_color.r = CHIMA_CLAMP(background_color.r, 0.f, 1.f);
-  background_color.g = CHIMA_CLAMP(background_color.g, 0.f, 1.f);
-  background_color.b = CHIMA_CLAMP(background_color.b, 0.f, 1.f);
-  background_color.a = CHIMA_CLAMP(background_color.a, 0.f, 1.f);
+  chima_u8 texel[4 * sizeof(chima_f32)];
+  const chima_size texel_size = chima__color_texel(background_color, channels, depth, texel);
+  if (!texel_size) {
+    return CHIMA_INVALID_VALUE;
+  }
+  const chima_bool zero = is_zero_texel(texel, texel_size);
 
   memset(image, 0, sizeof(*image));
-  chima_size image_size = (chima_size)(width * height * channels);
-  // TODO: Fill the bitmap with color in a more efficient way?
-  switch (depth) {
-    case CHIMA_DEPTH_8U: {
-      chima_u8* data = CHIMA_CALLOC(image_size, sizeof(chima_u8));
-      if (!data) {
-        return CHIMA_ALLOC_FAILURE;
-      }
-      const chima_u8 colors[] = {
-        (chima_u8)floorf(background_color.r * 0xFF),
-        (chima_u8)floorf(background_color.g * 0xFF),
-        (chima_u8)floorf(background_color.b * 0xFF),
-        (chima_u8)floorf(background_color.a * 0xFF),
-      };
-      for (chima_size pixel = 0; pixel < image_size; pixel += channels) {
-        memcpy(data + pixel, colors, channels);
-      }
-      image->data = data;
-    } break;
-    case CHIMA_DEPTH_16U: {
-      chima_u16* data = CHIMA_CALLOC(image_size, sizeof(chima_u16));
-      if (!data) {
-        return CHIMA_ALLOC_FAILURE;
-      }
-      const chima_u16 colors[] = {
-        (chima_u16)floorf(background_color.r * 0xFFFF),
-        (chima_u16)floorf(background_color.g * 0xFFFF),
-        (chima_u16)floorf(background_color.b * 0xFFFF),
-        (chima_u16)floorf(background_color.a * 0xFFFF),
-      };
-      for (chima_size pixel = 0; pixel < image_size; pixel += channels) {
-        memcpy(data + pixel, colors, channels);
-      }
-      image->data = data;
-    } break;
-    case CHIMA_DEPTH_32F: {
-      chima_f32* data = CHIMA_CALLOC(image_size, sizeof(chima_f32));
-      if (!data) {
-        return CHIMA_ALLOC_FAILURE;
-      }
-      for (chima_size pixel = 0; pixel < image_size; pixel += channels) {
-        memcpy(data + pixel, &background_color, channels);
-      }
-      image->data = data;
-    } break;
-    default:
-      return CHIMA_INVALID_VALUE;
+  const chima_size pixel_count = (chima_size)width * height;
+  void* data;
+  if (mode == CHIMA_FILL_COLOR && zero) {
+    data = CHIMA_CALLOC(pixel_count, texel_size); // Zeroed pages come for free
+  } else {
+    data = CHIMA_MALLOC(pixel_count * texel_size);
   }
+  if (!data) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  if (mode == CHIMA_FILL_COLOR && !zero) {
+    chima__fill_texels(data, pixel_count, texel, texel_size);
+  }
+  image->data = data;
   image->extent.width = width;
   image->extent.height = height;
   image->channels = channels;
@@ -110,80 +224,982 @@ chima_result chima_gen_blank_image(chima_context chima, chima_image* image, chim
   return CHIMA_NO_ERROR;
 }
 
-#define ATLAS_MAX_SIZE 16384
+#define ATLAS_SEARCH_SLACK 64 // Stop the size search once within 1/64 of the best size
+#define ATLAS_SEARCH_MISSES 2 // Non square heights tried in a row without a smaller area
+#define ATLAS_BAND_SIZE (256 * 1024) // Target bytes per band, small enough to stay in cache
+
+/*
+ * The atlas is split in horizontal bands and every sprite is bucketed in the bands it touches.
+ * Each band is a job that fills its rows with the background color and copies the rows of its
+ * sprites falling inside of it, so jobs write disjoint parts of the atlas and can run on any
+ * thread.
+ *
+ * Edge extrusion and alpha bleeding happen on the rows right after they are copied, while they
+ * are still in cache. Extruded rows above and below a sprite are copies of its first and last
+ * rows, taken again from the source image since they may belong to another band.
+ */
+typedef struct atlas_band_job {
+  chima_image* atlas;
+  const chima_rect* sprites;
+  const chima_image* images;
+  const chima_rect* src_rects; // Part of each image to copy, `NULL` for the whole image
+  const chima_u32* band_offsets; // `band_count + 1` offsets in `band_sprites`
+  const chima_u32* band_sprites;
+  chima_u32 band_height;
+  const chima_u8* texel; // Background texel, `NULL` if the atlas is already filled
+  chima_size texel_size;
+  chima_blend_mode blend;
+  chima_u32 extrude;
+  chima_u32 bleed;
+} atlas_band_job;
+
+// Copies `count` rows of sprite `idx`, starting at `sprite_row`, to the atlas rows starting at
+// `atlas_row`
+static chima_result composite_sprite_rows(const atlas_band_job* job, chima_u32 idx,
+                                          chima_u32 atlas_row, chima_u32 sprite_row,
+                                          chima_u32 count) {
+  const chima_rect* rect = &job->sprites[idx];
+  const chima_image* image = &job->images[idx];
+  chima_rect slice = {0, 0, image->extent.width, image->extent.height};
+  if (job->src_rects) {
+    slice = job->src_rects[idx];
+  }
+  const chima_rect sprite_slice = slice;
+  const chima_bool rotated = slice.width != rect->width;
+  chima_result ret;
+  if (rotated) {
+    // Rotated sprite, its rows are source columns
+    slice.x += sprite_row;
+    slice.width = count;
+    ret = chima__composite_rect_rotated(job->atlas, image, &slice, rect->x, atlas_row,
+                                        job->blend);
+  } else {
+    slice.y += sprite_row;
+    slice.height = count;
+    ret = chima__composite_rect(job->atlas, image, &slice, rect->x, atlas_row, job->blend);
+  }
+  if (ret || (!job->extrude && !job->bleed)) {
+    return ret;
+  }
 
-chima_result chima_gen_atlas_image(chima_context chima, chima_image* atlas, chima_rect* sprites,
-                                   chima_u32 padding, chima_color background_color,
-                                   const chima_image* images, chima_size image_count) {
-  if (!chima || !atlas || !sprites) {
-    return CHIMA_INVALID_VALUE;
+  const chima_size texel_size = job->atlas->channels * chima__depth_size(job->atlas->depth);
+  const chima_size stride = job->atlas->extent.width * texel_size;
+  const chima_u32 extrude = job->extrude;
+  chima_u8* row = (chima_u8*)job->atlas->data + atlas_row * stride + rect->x * texel_size;
+  for (chima_u32 i = 0; i < count; ++i, row += stride) {
+    chima__bleed_row(row, image, &sprite_slice, sprite_row + i, rotated, job->bleed);
+    if (extrude) {
+      chima_u8* last = row + (rect->width - 1) * texel_size;
+      chima__fill_texels(row - extrude * texel_size, extrude, row, texel_size);
+      chima__fill_texels(last + texel_size, extrude, last, texel_size);
+    }
+  }
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result composite_atlas_band(void* user, chima_size band) {
+  const atlas_band_job* job = user;
+  const chima_u32 band_begin = (chima_u32)band * job->band_height;
+  const chima_u32 band_end = band_begin + job->band_height;
+  if (job->texel) {
+    const chima_u32 atlas_height = job->atlas->extent.height;
+    const chima_size row_texels = job->atlas->extent.width;
+    const chima_u32 rows = (band_end < atlas_height ? band_end : atlas_height) - band_begin;
+    chima__fill_texels((chima_u8*)job->atlas->data + band_begin * row_texels * job->texel_size,
+                       rows * row_texels, job->texel, job->texel_size);
+  }
+  const chima_u32 extrude = job->extrude;
+  for (chima_u32 i = job->band_offsets[band]; i < job->band_offsets[band + 1]; ++i) {
+    const chima_u32 idx = job->band_sprites[i];
+    const chima_rect* rect = &job->sprites[idx];
+    const chima_u32 sprite_end = rect->y + rect->height;
+    const chima_u32 row_begin = CHIMA_MAX(rect->y - extrude, band_begin);
+    const chima_u32 row_end = CHIMA_MIN(sprite_end + extrude, band_end);
+    const chima_u32 core_begin = CHIMA_MAX(rect->y, row_begin);
+    const chima_u32 core_end = CHIMA_MIN(sprite_end, row_end);
+
+    chima_result ret = CHIMA_NO_ERROR;
+    for (chima_u32 row = row_begin; row < core_begin && !ret; ++row) {
+      ret = composite_sprite_rows(job, idx, row, 0, 1);
+    }
+    if (core_begin < core_end && !ret) {
+      ret = composite_sprite_rows(job, idx, core_begin, core_begin - rect->y,
+                                  core_end - core_begin);
+    }
+    for (chima_u32 row = CHIMA_MAX(sprite_end, row_begin); row < row_end && !ret; ++row) {
+      ret = composite_sprite_rows(job, idx, row, rect->height - 1, 1);
+    }
+    if (ret) {
+      return ret;
+    }
+  }
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result composite_atlas(chima_context chima, chima_image* atlas,
+                                    const chima_rect* sprites, const chima_image* images,
+                                    const chima_rect* src_rects, chima_size image_count,
+                                    const chima_u8* texel,
+                                    chima_size texel_size) {
+  const chima_size row_size =
+    (chima_size)atlas->extent.width * atlas->channels * chima__depth_size(atlas->depth);
+  chima_u32 band_height = row_size < ATLAS_BAND_SIZE ? (chima_u32)(ATLAS_BAND_SIZE / row_size) : 1;
+  chima_u32 band_count = (atlas->extent.height + band_height - 1) / band_height;
+  const chima_u32 thread_count = chima__thread_count(chima, atlas->extent.height);
+  if (band_count < thread_count * 4) {
+    // Keep enough bands around to balance the threads, even if they don't fit in cache
+    band_count = thread_count * 4 < atlas->extent.height ? thread_count * 4 : atlas->extent.height;
+    band_height = (atlas->extent.height + band_count - 1) / band_count;
+    band_count = (atlas->extent.height + band_height - 1) / band_height;
+  }
+
+  // Sprites also cover their extruded rows
+  const chima_u32 extrude = chima->atlas_extrude;
+  chima_size entry_count = 0;
+  for (chima_size i = 0; i < image_count; ++i) {
+    if (sprites[i].height) {
+      const chima_u32 first = (sprites[i].y - extrude) / band_height;
+      const chima_u32 last = (sprites[i].y + sprites[i].height + extrude - 1) / band_height;
+      entry_count += last - first + 1;
+    }
+  }
+  chima_u32* band_offsets = CHIMA_CALLOC(2 * band_count + 1 + entry_count, sizeof(chima_u32));
+  if (!band_offsets) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  chima_u32* band_cursors = band_offsets + band_count + 1;
+  chima_u32* band_sprites = band_cursors + band_count;
+
+  // Counting sort of the sprites by band, keeping the input order inside each band
+  for (chima_size i = 0; i < image_count; ++i) {
+    if (sprites[i].height) {
+      const chima_u32 first = (sprites[i].y - extrude) / band_height;
+      const chima_u32 last = (sprites[i].y + sprites[i].height + extrude - 1) / band_height;
+      for (chima_u32 band = first; band <= last; ++band) {
+        ++band_offsets[band + 1];
+      }
+    }
+  }
+  for (chima_u32 band = 0; band < band_count; ++band) {
+    band_offsets[band + 1] += band_offsets[band];
+    band_cursors[band] = band_offsets[band];
+  }
+  for (chima_size i = 0; i < image_count; ++i) {
+    if (sprites[i].height) {
+      const chima_u32 first = (sprites[i].y - extrude) / band_height;
+      const chima_u32 last = (sprites[i].y + sprites[i].height + extrude - 1) / band_height;
+      for (chima_u32 band = first; band <= last; ++band) {
+        band_sprites[band_cursors[band]++] = (chima_u32)i;
+      }
+    }
+  }
+
+  atlas_band_job job;
+  job.atlas = atlas;
+  job.sprites = sprites;
+  job.images = images;
+  job.src_rects = src_rects;
+  job.band_offsets = band_offsets;
+  job.band_sprites = band_sprites;
+  job.band_height = band_height;
+  job.texel = texel;
+  job.texel_size = texel_size;
+  // Packed rects never overlap, so sprites only blend against the background, and blending over
+  // zero texels is a copy
+  job.blend = texel ? CHIMA_BLEND_OVER : CHIMA_BLEND_REPLACE;
+  job.extrude = extrude;
+  job.bleed = chima->atlas_bleed;
+  const chima_result ret = chima__parallel_for(chima, band_count, &composite_atlas_band, &job);
+
+  CHIMA_FREE(band_offsets);
+  return ret;
+}
+
+// Non power of two sizes are multiples of both the size multiple and the block size
+static uint64_t atlas_size_step(chima_context chima) {
+  chima_u32 a = chima->atlas_multiple, b = chima->atlas_block;
+  while (b) {
+    const chima_u32 t = a % b;
+    a = b;
+    b = t;
+  }
+  return (uint64_t)chima->atlas_multiple / a * chima->atlas_block;
+}
+
+// Candidate atlas sizes are indexed, so the search works the same for every size rule
+static chima_u32 atlas_candidate_size(chima_context chima, chima_u32 idx) {
+  if (chima->flags & CHIMA_CTX_FLAG_ATLAS_POW2) {
+    return idx < 31 ? 1u << idx : chima->atlas_max_size + 1;
+  }
+  const uint64_t size = (uint64_t)idx * atlas_size_step(chima);
+  return size <= chima->atlas_max_size ? (chima_u32)size : chima->atlas_max_size + 1;
+}
+
+// Index of the smallest candidate >= `size`
+static chima_u32 atlas_candidate_idx(chima_context chima, chima_u32 size) {
+  if (chima->flags & CHIMA_CTX_FLAG_ATLAS_POW2) {
+    chima_u32 idx = 0;
+    while (idx < 31 && (1u << idx) < size) {
+      ++idx;
+    }
+    return idx;
+  }
+  const uint64_t step = atlas_size_step(chima);
+  return (chima_u32)((size + step - 1) / step);
+}
+
+// Index of the biggest candidate that fits in the maximum atlas size
+static chima_u32 atlas_max_candidate_idx(chima_context chima) {
+  chima_u32 idx = atlas_candidate_idx(chima, chima->atlas_max_size);
+  if (idx && atlas_candidate_size(chima, idx) > chima->atlas_max_size) {
+    --idx;
+  }
+  return idx;
+}
+
+typedef struct atlas_pack_state {
+  chima_context chima;
+  chima__packer packer;
+  chima_rect* rects;
+  uint64_t area;
+  chima_u32 max_width, max_height;
+  chima_u32 packed_width, packed_height; // Extent of the last successful pack
+  chima_u32 pack_count;
+  chima_result error; // Sticky, any error other than a packing failure stops the search
+  chima_bool found;
+  chima_u32 width, height; // Search result
+} atlas_pack_state;
+
+static chima_bool atlas_try_pack(atlas_pack_state* state, chima_u32 width, chima_u32 height) {
+  if (state->error) {
+    return CHIMA_FALSE;
+  }
+  const chima_result ret = chima__packer_run(&state->packer, width, height, state->rects);
+  ++state->pack_count;
+  if (ret) {
+    if (ret != CHIMA_PACKING_FAILED) {
+      state->error = ret;
+    }
+    state->packed_width = state->packed_height = 0; // The rects are left in a partial layout
+    return CHIMA_FALSE;
+  }
+  state->packed_width = width;
+  state->packed_height = height;
+  return CHIMA_TRUE;
+}
+
+// Width for a candidate index. Square atlases use the same value as height.
+static chima_bool atlas_try_pack_idx(atlas_pack_state* state, chima_u32 width_idx,
+                                     chima_u32 height) {
+  const chima_u32 width = atlas_candidate_size(state->chima, width_idx);
+  return atlas_try_pack(state, width, height ? height : width);
+}
+
+/*
+ * Searches the smallest atlas width that fits every rect, starting from `min_width`. With a
+ * `height` of 0 the atlas is square. Widths grow until the rects fit, and the smallest width that
+ * fits is then binary searched between the last two tries. Every try is a full pack, so the
+ * search stops when the width is within `ATLAS_SEARCH_SLACK` of the smallest one. The rects are
+ * left packed at the returned width.
+ */
+static chima_bool atlas_search_width(atlas_pack_state* state, chima_u32 height,
+                                     chima_u32 min_width, chima_u32* out_width) {
+  chima_context chima = state->chima;
+  if (min_width > chima->atlas_max_size) {
+    return CHIMA_FALSE;
+  }
+
+  // Find a candidate that fits, `fail_idx` is the biggest one known to be too small. The area
+  // bound is usually close, so the size first grows in small steps that double on every failure.
+  chima_u32 fail_idx = atlas_candidate_idx(chima, min_width);
+  chima_u32 pass_idx = fail_idx;
+  chima_f32 grow_step = 2.f / ATLAS_SEARCH_SLACK;
+  chima_bool found = CHIMA_FALSE;
+  while (atlas_candidate_size(chima, pass_idx) <= chima->atlas_max_size) {
+    if (atlas_try_pack_idx(state, pass_idx, height)) {
+      found = CHIMA_TRUE;
+      break;
+    }
+    fail_idx = pass_idx;
+    const chima_f32 factor =
+      1.f + grow_step < chima->atlas_grow_fac ? 1.f + grow_step : chima->atlas_grow_fac;
+    grow_step *= 2.f;
+    const chima_u32 grown =
+      (chima_u32)ceilf((chima_f32)atlas_candidate_size(chima, pass_idx) * factor);
+    const chima_u32 next_idx = atlas_candidate_idx(chima, grown);
+    pass_idx = next_idx > pass_idx ? next_idx : pass_idx + 1;
+  }
+  if (!found) {
+    // The biggest allowed size wasn't tried if the growth jumped over it
+    pass_idx = atlas_max_candidate_idx(chima);
+    if (pass_idx <= fail_idx || !atlas_try_pack_idx(state, pass_idx, height)) {
+      return CHIMA_FALSE;
+    }
+  }
+
+  while (pass_idx > fail_idx + 1) {
+    const chima_u32 pass_size = atlas_candidate_size(chima, pass_idx);
+    const chima_u32 fail_size = atlas_candidate_size(chima, fail_idx);
+    if ((pass_size - fail_size) * ATLAS_SEARCH_SLACK <= pass_size) {
+      break;
+    }
+    const chima_u32 mid_idx = fail_idx + (pass_idx - fail_idx) / 2;
+    if (atlas_try_pack_idx(state, mid_idx, height)) {
+      pass_idx = mid_idx;
+    } else {
+      fail_idx = mid_idx;
+    }
+  }
+  const chima_u32 width = atlas_candidate_size(chima, pass_idx);
+  const chima_u32 packed_height = height ? height : width;
+  // The last try may have been a failure, pack again at the chosen size
+  if ((state->packed_width != width || state->packed_height != packed_height) &&
+      !atlas_try_pack(state, width, packed_height)) {
+    return CHIMA_FALSE;
+  }
+
+  *out_width = width;
+  return CHIMA_TRUE;
+}
+
+/*
+ * No atlas smaller than the total rect area or the biggest rect side can fit every rect, so the
+ * square search starts there. Non square atlases then try shorter heights (with w >= h), each
+ * one with its own width search, and keep the smallest area.
+ */
+static chima_bool atlas_search_extent(atlas_pack_state* state, chima_u32* out_width,
+                                      chima_u32* out_height) {
+  chima_context chima = state->chima;
+  chima_u32 min_side = chima->atlas_initial;
+  min_side = CHIMA_MAX(state->max_width, min_side);
+  min_side = CHIMA_MAX(state->max_height, min_side);
+  min_side = CHIMA_MAX((chima_u32)ceil(sqrt((double)state->area)), min_side);
+
+  chima_u32 best_width, best_height;
+  if (!atlas_search_width(state, 0, min_side, &best_width)) {
+    return CHIMA_FALSE;
+  }
+  best_height = best_width;
+  if (!(chima->flags & CHIMA_CTX_FLAG_ATLAS_NON_SQUARE)) {
+    *out_width = best_width;
+    *out_height = best_height;
+    return CHIMA_TRUE;
+  }
+
+  // Thinner atlases are only kept if they save more than the search slack, and the search stops
+  // once shrinking the height stops paying off
+  chima_u32 height_idx = atlas_candidate_idx(chima, best_height);
+  chima_u32 misses = 0;
+  while (misses < ATLAS_SEARCH_MISSES) {
+    // Heights shrink by 3/4, or to the previous power of two
+    const chima_u32 shrunk = (atlas_candidate_size(chima, height_idx) * 3) / 4;
+    const chima_u32 next_idx = atlas_candidate_idx(chima, shrunk);
+    height_idx = next_idx < height_idx ? next_idx : height_idx - 1;
+    const chima_u32 height = atlas_candidate_size(chima, height_idx);
+    if (!height_idx || height < state->max_height || height < chima->atlas_initial) {
+      break;
+    }
+    uint64_t min_width = (state->area + height - 1) / height;
+    min_width = CHIMA_MAX((uint64_t)state->max_width, min_width);
+    min_width = CHIMA_MAX((uint64_t)height, min_width);
+    if (min_width > chima->atlas_max_size) {
+      break;
+    }
+    chima_u32 width;
+    if (!atlas_search_width(state, height, (chima_u32)min_width, &width)) {
+      break;
+    }
+    const uint64_t best_area = (uint64_t)best_width * best_height;
+    const uint64_t area = (uint64_t)width * height;
+    if (area + best_area / ATLAS_SEARCH_SLACK < best_area) {
+      best_width = width;
+      best_height = height;
+      misses = 0;
+    } else {
+      ++misses;
+    }
+  }
+
+  if ((state->packed_width != best_width || state->packed_height != best_height) &&
+      !atlas_try_pack(state, best_width, best_height)) {
+    return CHIMA_FALSE;
+  }
+  *out_width = best_width;
+  *out_height = best_height;
+  return CHIMA_TRUE;
+}
+
+typedef struct atlas_pack_candidate {
+  chima_packer_type type;
+  chima__pack_order order;
+  chima_bool rotate;
+} atlas_pack_candidate;
+
+#define ATLAS_MAX_CANDIDATES (2 * _CHIMA_PACKER_COUNT * _CHIMA_PACK_ORDER_COUNT)
+
+// Packers and sort orders tried. Without best of N packing, only the context packer. With
+// rotation, each one is also tried without it, since rotating greedily can pack worse. The
+// custom packer is only tried once and decides by itself.
+static chima_size atlas_pack_candidates(chima_context chima, atlas_pack_candidate* candidates) {
+  const chima_bool rotate = (chima->flags & CHIMA_CTX_FLAG_ATLAS_ROTATE) != 0;
+  const chima_bitfield types =
+    chima->packer_best_of ? chima->packer_best_of : (1u << chima->packer_type);
+  chima_size count = 0;
+  for (chima_u32 type = 0; type < _CHIMA_PACKER_COUNT; ++type) {
+    if (!(types & (1u << type))) {
+      continue;
+    }
+    // Skyline sorts the rects on its own, and the custom packer gets them unsorted
+    const chima_bool sorted = type != CHIMA_PACKER_SKYLINE_BL && type != CHIMA_PACKER_CUSTOM;
+    const chima_u32 order_count = sorted && chima->packer_best_of ? _CHIMA_PACK_ORDER_COUNT : 1;
+    const chima_bool both = rotate && type != CHIMA_PACKER_CUSTOM;
+    for (chima_u32 order = 0; order < order_count; ++order) {
+      for (chima_u32 r = both ? 0 : 1; r < 2; ++r) {
+        candidates[count].type = (chima_packer_type)type;
+        candidates[count].order = (chima__pack_order)order;
+        candidates[count].rotate = rotate && r;
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
+static chima_result atlas_search_job(void* user, chima_size idx) {
+  atlas_pack_state* state = (atlas_pack_state*)user + idx;
+  state->found = atlas_search_extent(state, &state->width, &state->height);
+  return state->error;
+}
+
+/*
+ * Packs `rects` (sizes in, positions out) and finds the atlas extent. Every candidate packer runs
+ * its own size search with its own copy of the rects, on separate threads, and the layout with
+ * the smallest area wins. Ties go to the first candidate, so the result doesn't depend on the
+ * thread count.
+ */
+static chima_result atlas_pack(chima_context chima, chima_rect* rects, chima_size rect_count,
+                               chima_u32* out_width, chima_u32* out_height,
+                               chima_u32* pack_count) {
+  atlas_pack_candidate candidates[ATLAS_MAX_CANDIDATES];
+  const chima_size cand_count = atlas_pack_candidates(chima, candidates);
+  chima_result ret = CHIMA_NO_ERROR;
+
+  atlas_pack_state* states = CHIMA_CALLOC(cand_count, sizeof(atlas_pack_state));
+  if (!states) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  // The first candidate packs in place, the others in their own copy
+  chima_rect* layouts = NULL;
+  if (cand_count > 1) {
+    layouts = CHIMA_CALLOC((cand_count - 1) * rect_count, sizeof(chima_rect));
+    if (!layouts) {
+      ret = CHIMA_ALLOC_FAILURE;
+      goto free_states;
+    }
   }
+
+  // Rotated rects can lay on their long side, so only that one has to fit in the width
+  uint64_t area = 0;
+  chima_u32 max_width = 0, max_height = 0, max_long = 0, max_short = 0;
+  for (chima_size i = 0; i < rect_count; ++i) {
+    const chima_u32 w = rects[i].width, h = rects[i].height;
+    area += (uint64_t)w * h;
+    max_width = CHIMA_MAX(w, max_width);
+    max_height = CHIMA_MAX(h, max_height);
+    max_long = CHIMA_MAX(CHIMA_MAX(w, h), max_long);
+    max_short = CHIMA_MAX(CHIMA_MIN(w, h), max_short);
+  }
+
+  for (chima_size c = 0; c < cand_count; ++c) {
+    atlas_pack_state* state = &states[c];
+    state->chima = chima;
+    state->rects = c ? layouts + (c - 1) * rect_count : rects;
+    if (c) {
+      memcpy(state->rects, rects, rect_count * sizeof(chima_rect));
+    }
+    state->area = area;
+    state->max_width = candidates[c].rotate ? max_long : max_width;
+    state->max_height = candidates[c].rotate ? max_short : max_height;
+    ret = chima__packer_init(chima, &state->packer, candidates[c].type, candidates[c].order,
+                             candidates[c].rotate, state->rects, rect_count,
+                             chima->atlas_max_size);
+    if (ret) {
+      goto destroy_packers;
+    }
+  }
+
+  if (cand_count == 1) {
+    ret = atlas_search_job(states, 0);
+  } else {
+    ret = chima__parallel_for(chima, cand_count, &atlas_search_job, states);
+  }
+  if (ret) {
+    goto destroy_packers;
+  }
+
+  chima_size best = cand_count;
+  *pack_count = 0;
+  for (chima_size c = 0; c < cand_count; ++c) {
+    *pack_count += states[c].pack_count;
+    if (!states[c].found) {
+      continue;
+    }
+    const uint64_t area = (uint64_t)states[c].width * states[c].height;
+    if (best == cand_count || area < (uint64_t)states[best].width * states[best].height) {
+      best = c;
+    }
+  }
+  if (best == cand_count) {
+    ret = CHIMA_PACKING_FAILED;
+    goto destroy_packers;
+  }
+  if (best) {
+    memcpy(rects, states[best].rects, rect_count * sizeof(chima_rect));
+  }
+  *out_width = states[best].width;
+  *out_height = states[best].height;
+
+destroy_packers:
+  for (chima_size c = 0; c < cand_count; ++c) {
+    chima__packer_destroy(&states[c].packer);
+  }
+  if (layouts) {
+    CHIMA_FREE(layouts);
+  }
+free_states:
+  CHIMA_FREE(states);
+  return ret;
+}
+
+// Packs a copy of `rects` in a single pack at the biggest page size
+static chima_result atlas_probe_page(chima_context chima, const chima_rect* rects,
+                                    chima_size rect_count, chima_rect* probe,
+                                    chima_u32* pack_count) {
+  atlas_pack_candidate candidates[ATLAS_MAX_CANDIDATES];
+  atlas_pack_candidates(chima, candidates);
+  const chima_u32 size = atlas_candidate_size(chima, atlas_max_candidate_idx(chima));
+  const chima_bool rotate = (chima->flags & CHIMA_CTX_FLAG_ATLAS_ROTATE) != 0;
+  memcpy(probe, rects, rect_count * sizeof(chima_rect));
+  chima__packer packer;
+  chima_result ret = chima__packer_init(chima, &packer, candidates[0].type, candidates[0].order,
+                                        rotate, probe, rect_count, size);
+  if (ret) {
+    return ret;
+  }
+  ret = chima__packer_run(&packer, size, size, probe);
+  ++*pack_count;
+  chima__packer_destroy(&packer);
+  return ret;
+}
+
+/*
+ * Splits the rects in pages, in their input order. Each page takes the longest run of rects
+ * that fits in a single pack at the biggest page size, found by doubling the run and then
+ * bisecting, and then gets its own size search. Keeping the input order keeps the images of
+ * an animation together.
+ */
+static chima_result atlas_pack_pages(chima_context chima, chima_rect* rects,
+                                     chima_size rect_count, chima_u32* page_first,
+                                     chima_extent2d* page_extents, chima_size* page_count,
+                                     chima_u32* pack_count) {
+  chima_rect* probe = CHIMA_MALLOC(rect_count * sizeof(chima_rect));
+  if (!probe) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  chima_result ret = CHIMA_NO_ERROR;
+  chima_size first = 0, count = 0;
+  *pack_count = 0;
+  while (first < rect_count) {
+    const chima_size left = rect_count - first;
+    chima_size fit = 0, fail = left + 1;
+    for (chima_size run = 1; fit < left && run < fail;) {
+      ret = atlas_probe_page(chima, rects + first, run, probe, pack_count);
+      if (ret == CHIMA_PACKING_FAILED) {
+        fail = run;
+        break;
+      } else if (ret) {
+        goto free_probe;
+      }
+      fit = run;
+      run = run * 2 < left ? run * 2 : left;
+    }
+    if (!fit) {
+      ret = CHIMA_PACKING_FAILED; // Bigger than a page
+      goto free_probe;
+    }
+    while (fail - fit > 1) {
+      const chima_size mid = fit + (fail - fit) / 2;
+      ret = atlas_probe_page(chima, rects + first, mid, probe, pack_count);
+      if (ret == CHIMA_PACKING_FAILED) {
+        fail = mid;
+      } else if (ret) {
+        goto free_probe;
+      } else {
+        fit = mid;
+      }
+    }
+
+    chima_u32 width, height, packs;
+    ret = atlas_pack(chima, rects + first, fit, &width, &height, &packs);
+    *pack_count += packs;
+    if (ret) {
+      goto free_probe;
+    }
+    page_first[count] = (chima_u32)first;
+    page_extents[count].width = width;
+    page_extents[count].height = height;
+    ++count;
+    first += fit;
+  }
+  page_first[count] = (chima_u32)rect_count;
+  *page_count = count;
+
+free_probe:
+  CHIMA_FREE(probe);
+  return ret;
+}
+
+// Rounds a packed rect side up to the atlas block size
+static chima_u32 align_block(chima_context chima, chima_u32 size) {
+  const chima_u32 block = chima->atlas_block;
+  return (size + block - 1) / block * block;
+}
+
+/*
+ * Grouped rects are laid out in shelves, in their input order, and the bounds of the layout are
+ * packed as a single unit rect. Shelves are as wide as the square root of the group area, so
+ * units stay close to square, and a group that doesn't fit in the biggest page is split in as
+ * many units as needed. Every other rect is a unit on its own. Units keep the input order, so
+ * the pages split between them too.
+ *
+ * `offsets` gets the position of each rect inside of its unit, and its size before packing.
+ * `unit_first` gets `unit_count + 1` offsets in `rects`.
+ */
+static chima_size atlas_group_units(chima_context chima, const chima_rect* rects,
+                                    chima_size rect_count, const chima__rect_group* groups,
+                                    chima_size group_count, chima_rect* units,
+                                    chima_u32* unit_first, chima_rect* offsets) {
+  const chima_u32 limit = atlas_candidate_size(chima, atlas_max_candidate_idx(chima));
+  chima_size count = 0, group = 0;
+  for (chima_size i = 0; i < rect_count;) {
+    if (group == group_count || groups[group].first != i || groups[group].count < 2) {
+      if (group < group_count && groups[group].first == i) {
+        ++group;
+      }
+      offsets[i] = rects[i];
+      offsets[i].x = offsets[i].y = 0;
+      unit_first[count] = (chima_u32)i;
+      units[count++] = rects[i];
+      ++i;
+      continue;
+    }
+
+    const chima_size end = i + groups[group++].count;
+    uint64_t area = 0;
+    chima_u32 shelf_width = 0;
+    for (chima_size j = i; j < end; ++j) {
+      area += (uint64_t)rects[j].width * rects[j].height;
+      shelf_width = CHIMA_MAX(rects[j].width, shelf_width);
+    }
+    shelf_width = CHIMA_MAX((chima_u32)ceil(sqrt((double)area)), shelf_width);
+    shelf_width = CHIMA_MIN(limit, shelf_width);
+
+    chima_u32 x = 0, y = 0, shelf_height = 0, width = 0;
+    unit_first[count] = (chima_u32)i;
+    for (; i < end; ++i) {
+      if (x && x + rects[i].width > shelf_width) {
+        y += shelf_height;
+        x = shelf_height = 0;
+      }
+      if (y && y + rects[i].height > limit) {
+        // Too tall for a page, close this unit and start a new one
+        units[count].x = units[count].y = 0;
+        units[count].width = width;
+        units[count++].height = y;
+        unit_first[count] = (chima_u32)i;
+        y = width = 0;
+      }
+      offsets[i].x = x;
+      offsets[i].y = y;
+      offsets[i].width = rects[i].width;
+      offsets[i].height = rects[i].height;
+      x += rects[i].width;
+      width = CHIMA_MAX(x, width);
+      shelf_height = CHIMA_MAX(rects[i].height, shelf_height);
+    }
+    units[count].x = units[count].y = 0;
+    units[count].width = width;
+    units[count++].height = y + shelf_height;
+  }
+  unit_first[count] = (chima_u32)rect_count;
+  return count;
+}
+
+// Places the rects of each packed unit. A rotated unit has its layout turned 90 degrees
+// clockwise, the same way as a rotated rect, so each rect in it is rotated too.
+static void atlas_ungroup_units(const chima_rect* units, const chima_u32* unit_first,
+                                chima_size unit_count, const chima_rect* offsets,
+                                chima_rect* rects) {
+  for (chima_size u = 0; u < unit_count; ++u) {
+    const chima_rect* unit = &units[u];
+    const chima_u32 first = unit_first[u], last = unit_first[u + 1];
+    if (last - first == 1) {
+      rects[first] = *unit;
+      continue;
+    }
+    // The unrotated height of a unit is the bottom of its last shelf
+    chima_u32 height = 0;
+    for (chima_u32 i = first; i < last; ++i) {
+      height = CHIMA_MAX(offsets[i].y + offsets[i].height, height);
+    }
+    const chima_bool rotated = unit->height != height;
+    for (chima_u32 i = first; i < last; ++i) {
+      const chima_rect* off = &offsets[i];
+      if (rotated) {
+        rects[i].x = unit->x + height - off->y - off->height;
+        rects[i].y = unit->y + off->x;
+        rects[i].width = off->height;
+        rects[i].height = off->width;
+      } else {
+        rects[i].x = unit->x + off->x;
+        rects[i].y = unit->y + off->y;
+        rects[i].width = off->width;
+        rects[i].height = off->height;
+      }
+    }
+  }
+}
+
+// Packs the images in one atlas, or in as many pages as needed if `paged` is set
+static chima_result gen_atlas(chima_context chima, chima_bool paged, chima_image** pages,
+                              chima_size* page_count, chima_rect* sprites,
+                              chima_u32* sprite_pages, chima_u32 padding,
+                              chima_color background_color, const chima_image* images,
+                              const chima_rect* src_rects, chima_size image_count,
+                              const chima__rect_group* groups, chima_size group_count) {
   if (!images || !image_count) {
     return CHIMA_INVALID_VALUE;
   }
   const chima_image_depth depth = images[0].depth;
   const chima_u32 channels = images[0].channels;
+  if (channels < 1 || channels > 4) {
+    return CHIMA_INVALID_VALUE;
+  }
+  chima_u8 texel[4 * sizeof(chima_f32)];
+  const chima_size texel_size = chima__color_texel(background_color, channels, depth, texel);
+  if (!texel_size) {
+    return CHIMA_INVALID_VALUE;
+  }
+  const chima_bool zero = is_zero_texel(texel, texel_size);
   chima_result ret = CHIMA_NO_ERROR;
 
-  stbrp_rect* rects = CHIMA_CALLOC(image_count, sizeof(stbrp_rect));
+  chima_rect* rects = CHIMA_CALLOC(image_count, sizeof(chima_rect));
   if (!rects) {
     return CHIMA_ALLOC_FAILURE;
   }
+  chima_u32* page_first = CHIMA_CALLOC(image_count + 1, sizeof(chima_u32));
+  if (!page_first) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_rects;
+  }
+  chima_extent2d* page_extents = CHIMA_CALLOC(image_count, sizeof(chima_extent2d));
+  if (!page_extents) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_page_first;
+  }
 
-  memset(rects, 0, image_count * sizeof(stbrp_rect));
+  uint64_t sprite_area = 0;
   for (size_t i = 0; i < image_count; ++i) {
     if (images[i].depth != depth || images[i].channels != channels) {
       ret = CHIMA_INVALID_VALUE;
-      goto free_rects;
+      goto free_page_extents;
     }
-    rects[i].w = images[i].extent.width + padding;
-    rects[i].h = images[i].extent.height + padding;
-  }
-
-  const chima_size node_count = image_count;
-  stbrp_node* nodes = CHIMA_CALLOC(node_count, sizeof(stbrp_node));
-  if (!nodes) {
-    ret = CHIMA_ALLOC_FAILURE;
-    goto free_rects;
+    chima_extent2d extent = images[i].extent;
+    if (src_rects) {
+      extent.width = src_rects[i].width;
+      extent.height = src_rects[i].height;
+    }
+    // Empty sprites have no edges to extrude
+    const chima_u32 border = extent.width && extent.height ? 2 * chima->atlas_extrude : 0;
+    rects[i].width = align_block(chima, extent.width + border + padding);
+    rects[i].height = align_block(chima, extent.height + border + padding);
+    sprite_area += (uint64_t)extent.width * extent.height;
   }
 
-  chima_u32 atlas_size = chima->atlas_initial;
-  while (atlas_size <= ATLAS_MAX_SIZE) {
-    stbrp_context stbrp;
-    stbrp_init_target(&stbrp, atlas_size, atlas_size, nodes, node_count);
-    if (stbrp_pack_rects(&stbrp, rects, image_count)) {
-      goto copy_texels;
+  // Without groups every rect is its own unit
+  chima_rect* units = rects;
+  chima_size unit_count = image_count;
+  chima_u32* unit_first = NULL;
+  chima_rect* offsets = NULL;
+  if (group_count) {
+    units = CHIMA_CALLOC(2 * image_count, sizeof(chima_rect));
+    if (!units) {
+      ret = CHIMA_ALLOC_FAILURE;
+      goto free_page_extents;
+    }
+    offsets = units + image_count;
+    unit_first = CHIMA_CALLOC(image_count + 1, sizeof(chima_u32));
+    if (!unit_first) {
+      ret = CHIMA_ALLOC_FAILURE;
+      goto free_units;
     }
-    atlas_size = roundf(atlas_size * chima->atlas_grow_fac);
+    unit_count = atlas_group_units(chima, rects, image_count, groups, group_count, units,
+                                   unit_first, offsets);
   }
-  ret = CHIMA_PACKING_FAILED;
-  goto free_nodes;
 
-copy_texels:
-  ret =
-    chima_gen_blank_image(chima, atlas, atlas_size, atlas_size, channels, depth, background_color);
+  // Everything in one page if possible, the pages only get split when that fails
+  chima_size count = 1;
+  chima_u32 pack_count = 0;
+  const uint64_t pack_start = chima__time_ns();
+  ret = atlas_pack(chima, units, unit_count, &page_extents[0].width, &page_extents[0].height,
+                   &pack_count);
+  page_first[1] = (chima_u32)unit_count;
+  if (ret == CHIMA_PACKING_FAILED && paged) {
+    chima_u32 page_packs = 0;
+    ret = atlas_pack_pages(chima, units, unit_count, page_first, page_extents, &count,
+                           &page_packs);
+    pack_count += page_packs;
+  }
+  const uint64_t pack_time = chima__time_ns() - pack_start;
   if (ret) {
-    goto free_nodes;
+    goto free_units;
+  }
+  if (unit_first) {
+    atlas_ungroup_units(units, unit_first, unit_count, offsets, rects);
+    for (chima_size page = 0; page <= count; ++page) {
+      page_first[page] = unit_first[page_first[page]];
+    }
+  }
+  // Rects with block multiple sizes only land on block boundaries with the built-in packers,
+  // a custom packer could still misplace them. Every rect must also be inside of its page, since
+  // the compositing trusts the layout
+  for (chima_size page = 0; page < count; ++page) {
+    const chima_extent2d extent = page_extents[page];
+    for (chima_size i = page_first[page]; i < page_first[page + 1]; ++i) {
+      const chima_rect* rect = &rects[i];
+      if ((uint64_t)rect->x + rect->width > extent.width ||
+          (uint64_t)rect->y + rect->height > extent.height) {
+        ret = CHIMA_PACKING_FAILED;
+        goto free_units;
+      }
+      if (chima->atlas_block > 1 &&
+          (rect->x % chima->atlas_block || rect->y % chima->atlas_block)) {
+        ret = CHIMA_PACKING_FAILED;
+        goto free_units;
+      }
+    }
   }
 
-  for (chima_size i = 0; i < image_count; ++i) {
-    sprites[i].width = images[i].extent.width;
-    sprites[i].height = images[i].extent.height;
-    sprites[i].x = (chima_u32)rects[i].x;
-    sprites[i].y = (chima_u32)rects[i].y;
-    ret = chima_composite_image(atlas, images + i, sprites[i].x, sprites[i].y);
+  chima_image* out = CHIMA_CALLOC(count, sizeof(chima_image));
+  if (!out) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_units;
+  }
+  uint64_t page_area = 0;
+  chima_size page = 0;
+  for (; page < count; ++page) {
+    const chima_u32 first = page_first[page];
+    const chima_size sprite_count = page_first[page + 1] - first;
+    const chima_extent2d extent = page_extents[page];
+    page_area += (uint64_t)extent.width * extent.height;
+
+    // A zero background is allocated already cleared, otherwise each band fills its own rows
+    ret = chima_gen_blank_image_ex(chima, &out[page], extent.width, extent.height, channels,
+                                   depth, background_color,
+                                   zero ? CHIMA_FILL_COLOR : CHIMA_FILL_NONE);
+    if (ret) {
+      goto destroy_pages;
+    }
+    for (chima_size i = first; i < first + sprite_count; ++i) {
+      // The sizes were rounded up to whole blocks, take them from the images again. A rect that
+      // ended up square after rounding fits the sprite either way, so it is never rotated
+      chima_extent2d extent = images[i].extent;
+      if (src_rects) {
+        extent.width = src_rects[i].width;
+        extent.height = src_rects[i].height;
+      }
+      const chima_u32 extrude = extent.width && extent.height ? chima->atlas_extrude : 0;
+      const chima_bool rotated =
+        rects[i].width != align_block(chima, extent.width + 2 * extrude + padding);
+      sprites[i].width = rotated ? extent.height : extent.width;
+      sprites[i].height = rotated ? extent.width : extent.height;
+      sprites[i].x = rects[i].x + extrude;
+      sprites[i].y = rects[i].y + extrude;
+      if (sprite_pages) {
+        sprite_pages[i] = (chima_u32)page;
+      }
+    }
+    ret = composite_atlas(chima, &out[page], sprites + first, images + first,
+                          src_rects ? src_rects + first : NULL, sprite_count,
+                          zero ? NULL : texel, texel_size);
     if (ret) {
-      break; // propagate error
+      chima_destroy_image(chima, &out[page]);
+      goto destroy_pages;
     }
   }
 
-free_nodes:
-  CHIMA_FREE(nodes);
+  chima->atlas_stats.extent = page_extents[0];
+  chima->atlas_stats.page_count = (chima_u32)count;
+  chima->atlas_stats.occupancy = (chima_f32)((double)sprite_area / (double)page_area);
+  chima->atlas_stats.pack_count = pack_count;
+  chima->atlas_stats.pack_time = (chima_f32)((double)pack_time / 1e6);
+  *pages = out;
+  *page_count = count;
+  goto free_units;
+
+destroy_pages:
+  while (page-- > 0) {
+    chima_destroy_image(chima, &out[page]);
+  }
+  CHIMA_FREE(out);
+free_units:
+  if (unit_first) {
+    CHIMA_FREE(unit_first);
+  }
+  if (units != rects) {
+    CHIMA_FREE(units);
+  }
+free_page_extents:
+  CHIMA_FREE(page_extents);
+free_page_first:
+  CHIMA_FREE(page_first);
 free_rects:
   CHIMA_FREE(rects);
   return ret;
 }
 
+chima_result chima_gen_atlas_image(chima_context chima, chima_image* atlas, chima_rect* sprites,
+                                   chima_u32 padding, chima_color background_color,
+                                   const chima_image* images, chima_size image_count) {
+  if (!chima || !atlas || !sprites) {
+    return CHIMA_INVALID_VALUE;
+  }
+  chima_image* pages;
+  chima_size page_count;
+  const chima_result ret = gen_atlas(chima, CHIMA_FALSE, &pages, &page_count, sprites, NULL,
+                                     padding, background_color, images, NULL, image_count,
+                                     NULL, 0);
+  if (ret) {
+    return ret;
+  }
+  *atlas = pages[0];
+  CHIMA_FREE(pages);
+  return CHIMA_NO_ERROR;
+}
+
+chima_result chima__gen_atlas_pages(chima_context chima, chima_image** pages,
+                                    chima_size* page_count, chima_rect* sprites,
+                                    chima_u32* sprite_pages, chima_u32 padding,
+                                    chima_color background_color, const chima_image* images,
+                                    const chima_rect* src_rects, chima_size image_count,
+                                    const chima__rect_group* groups, chima_size group_count) {
+  if (!chima || !pages || !page_count || !sprites) {
+    return CHIMA_INVALID_VALUE;
+  }
+  return gen_atlas(chima, CHIMA_TRUE, pages, page_count, sprites, sprite_pages, padding,
+                   background_color, images, src_rects, image_count, groups, group_count);
+}
+
 chima_result chima_load_image_file(chima_context chima, chima_image* image, chima_image_depth d,
                                    FILE* f) {
   if (!chima || !f || !image) {
@@ -289,12 +1305,13 @@ chima_result chima_load_image_mem(chima_context chima, chima_image* image, chima
 }
 
 chima_size chima__write_atlas_file(chima_context chima, FILE* f, chima_u32 w, chima_u32 h,
-                                   chima_u32 ch, chima_image_format format, const void* data) {
+                                   chima_u32 ch, chima_image_depth depth,
+                                   chima_image_format format, const void* data) {
   chima_size wrt;
   int flip_y = (chima->flags & CHIMA_CTX_FLAG_FLIP_Y);
   switch (format) {
     case CHIMA_FILE_FORMAT_RAW: {
-      wrt = fwrite(data, w*h*ch, 1, f);
+      wrt = fwrite(data, w*h*ch*chima__depth_size(depth), 1, f);
     } break;
     case CHIMA_FILE_FORMAT_PNG: {
       chima_size stride = w*ch;
@@ -322,6 +1339,9 @@ chima_result chima_write_image_file(chima_context chima, const chima_image* imag
   if (!chima || !image || !f) {
     return CHIMA_INVALID_VALUE;
   }
+  if (image->depth != CHIMA_DEPTH_8U && format != CHIMA_FILE_FORMAT_RAW) {
+    return CHIMA_UNSUPPORTED_FORMAT; // Only RAW can hold 16U and 32F texels for now
+  }
 
   int flip_y = (chima->flags & CHIMA_CTX_FLAG_FLIP_Y);
   int wrt;
@@ -348,7 +1368,8 @@ chima_result chima_write_image_file(chima_context chima, const chima_image* imag
       break;
     }
     case CHIMA_FILE_FORMAT_RAW: {
-      wrt = fwrite(image->data, image->extent.width*image->extent.height*image->channels, 1, f);
+      const chima_size texels = image->extent.width*image->extent.height*image->channels;
+      wrt = fwrite(image->data, texels*chima__depth_size(image->depth), 1, f);
     } break;
     default:
       return CHIMA_INVALID_VALUE;
@@ -371,44 +1392,6 @@ chima_result chima_write_image(chima_context chima, const chima_image* image,
   return ret;
 }
 
-chima_result chima_composite_image(chima_image* dst, const chima_image* src, chima_u32 xpos,
-                                   chima_u32 ypos) {
-  if (!dst || !src) {
-    return CHIMA_INVALID_VALUE;
-  }
-  CHIMA_ASSERT(src->depth == CHIMA_DEPTH_8U && "TODO");
-  CHIMA_ASSERT(dst->depth == CHIMA_DEPTH_8U && "TODO");
-
-  const chima_size dst_w = dst->extent.width, dst_h = dst->extent.height, dst_ch = dst->channels;
-  chima_u8* dst_row_start = dst->data + (ypos * dst_w + xpos) * dst_ch;
-  chima_u8* dst_end = dst->data + dst_w * dst_h * dst_ch;
-
-  const chima_size src_w = src->extent.width, src_h = src->extent.height, src_ch = src->channels;
-  const chima_size src_row_pixels = xpos + src_w > dst_w ? dst_w - xpos : src_w;
-  chima_size written_rows = 0;
-
-  while (dst_row_start < dst_end && written_rows < src_h) {
-    chima_u8* src_row_start = src->data + (written_rows * src_w * src_ch);
-    for (chima_size pixel = 0; pixel < src_row_pixels; ++pixel) {
-      chima_u8* dst_pixel = dst_row_start + (pixel * dst_ch);
-      chima_u8* src_pixel = src_row_start + (pixel * src_ch);
-
-      chima_f32 src_alpha = src_ch == 4 ? (chima_f32)(src_pixel[3]) / 256.f : 1.f;
-      chima_f32 dst_alpha = dst_ch == 4 ? (chima_f32)(dst_pixel[3]) / 256.f : 1.f;
-      chima_f32 comp_alpha = src_alpha + dst_alpha * (1.f - src_alpha);
-      for (chima_u32 i = 0; i < dst_ch; ++i) {
-        chima_f32 dst_blend =
-          dst_pixel[i] * dst_alpha * (1.f - src_alpha) + src_pixel[i] * src_alpha;
-        dst_pixel[i] = (chima_u8)roundf(dst_blend / comp_alpha);
-      }
-    }
-    ++written_rows;
-    dst_row_start += dst_w * dst_ch;
-  }
-
-  return CHIMA_NO_ERROR;
-}
-
 void chima_destroy_image(chima_context chima, chima_image* image) {
   if (!image) {
     return;
@@ -417,166 +1400,366 @@ void chima_destroy_image(chima_context chima, chima_image* image) {
   memset(image, 0, sizeof(chima_image));
 }
 
-typedef struct gif_node {
-  uint32_t width;
-  uint32_t height;
-  uint32_t channels;
-  int delay;
-  void* data;
-  struct gif_node* next;
-} gif_node;
+#define ANIM_READ_CHUNK 65536
 
 chima_result chima_load_image_anim_file(chima_context chima, chima_image_anim* anim, FILE* f) {
   if (!chima || !anim || !f) {
     return CHIMA_INVALID_VALUE;
   }
 
-  stbi_user_alloc al;
-  al.user = chima->mem_user;
-  al.malloc = chima->mem_alloc;
-  al.realloc = chima->mem_realloc;
-  al.free = chima->mem_free;
-
-  stbi__context stbi;
-  stbi__start_file(&stbi, f);
-  stbi.al = &al;
+  // The frames are decoded in parallel from the whole file, read until the end of the stream
+  chima_u8* data = NULL;
+  chima_size size = 0, capacity = 0;
+  for (;;) {
+    if (size == capacity) {
+      const chima_size new_cap = capacity ? 2 * capacity : ANIM_READ_CHUNK;
+      chima_u8* mem = data ? CHIMA_REALLOC(data, capacity, new_cap) : CHIMA_MALLOC(new_cap);
+      if (!mem) {
+        if (data) {
+          CHIMA_FREE(data);
+        }
+        return CHIMA_ALLOC_FAILURE;
+      }
+      data = mem;
+      capacity = new_cap;
+    }
+    const size_t read = fread(data + size, 1, capacity - size, f);
+    size += read;
+    if (!read) {
+      break;
+    }
+  }
+  chima_result ret = CHIMA_FILE_EOF;
+  if (!ferror(f)) {
+    ret = chima__load_gif(chima, anim, data, size);
+  }
+  CHIMA_FREE(data);
+  return ret;
+}
 
-  stbi__result_info ri;
-  memset(&ri, 0, sizeof(ri));
-  ri.bits_per_channel = 8;
-  ri.channel_order = STBI_ORDER_RGB;
-  ri.num_channels = 0;
+chima_result chima_load_image_anim(chima_context chima, chima_image_anim* anim, const char* path) {
+  if (!chima || !path || !anim) {
+    return CHIMA_INVALID_VALUE;
+  }
 
-  if (!stbi__gif_test(&stbi)) {
-    return CHIMA_UNSUPPORTED_FORMAT;
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    return CHIMA_FILE_OPEN_FAILURE;
   }
+  chima_result ret = chima_load_image_anim_file(chima, anim, f);
+  fclose(f);
+  return ret;
+}
 
-  int comp = 0;
+void chima_destroy_image_anim(chima_context chima, chima_image_anim* anim) {
+  if (!anim) {
+    return;
+  }
+  if (anim->images) {
+    // The image array starts the block holding the frames and the frametimes
+    CHIMA_FREE(anim->images);
+  }
+  memset(anim, 0, sizeof(chima_image_anim));
+}
 
+/*
+ * Streaming animation decoder.
+ *
+ * Only the GIF canvas of the last decoded frame is kept. Seeking back restores the closest
+ * checkpoint before the target frame, a copy of the decoder state and the file offset taken
+ * right before decoding a frame, and decodes forward from there. Frame 0 needs no checkpoint,
+ * the decoder just starts over.
+ *
+ * Checkpoints are taken every `interval` frames while decoding past the last one. When they
+ * would exceed the memory budget, every other one is dropped and the interval doubles, so they
+ * stay evenly spread over the frames decoded so far.
+ */
+#define ANIM_MAX_CHECKPOINTS 256
+
+typedef struct anim_checkpoint {
+  chima_size frame;
+  long offset;
+  stbi__gif gif; // Followed by copies of the canvas, background and history buffers
+} anim_checkpoint;
+
+typedef struct chima_anim_decoder_ {
+  chima_context chima;
+  FILE* file;
+  chima_bool owns_file;
+  long start;
+  stbi_user_alloc al;
+  stbi__context stbi;
   stbi__gif gif;
-  memset(&gif, 0, sizeof(gif));
-  void* data = NULL;
-  uint8_t* two_back = NULL;
-  chima_result ret = CHIMA_NO_ERROR;
+  chima_image frame;
+  chima_size next_frame;
+  chima_size frame_count; // 0 until the end was reached
+  chima_bool at_end;
+  chima_size budget;
+  chima_size interval;
+  chima_size checkpoint_count;
+  anim_checkpoint* checkpoints[ANIM_MAX_CHECKPOINTS];
+} chima_anim_decoder_;
+
+static chima_size anim_canvas_texels(const chima_anim_decoder_* dec) {
+  return (chima_size)dec->gif.w * (chima_size)dec->gif.h;
+}
 
-  // https://gist.github.com/urraka/685d9a6340b26b830d49
-  gif_node head;
-  memset(&head, 0, sizeof(head));
-  chima_u32 image_count = 0;
-  gif_node* curr_node = NULL;
-  chima_bool free_images = CHIMA_FALSE;
-  while ((data = stbi__gif_load_next(&stbi, &gif, &comp, 0, two_back)) != NULL) {
-    CHIMA_ASSERT(comp);
-    if (data == &stbi) {
-      data = NULL;
-      break;
+static chima_size anim_checkpoint_size(const chima_anim_decoder_* dec) {
+  return sizeof(anim_checkpoint) + 9 * anim_canvas_texels(dec);
+}
+
+// Points the stb context at `offset` in the file
+static chima_result anim_decoder_reset(chima_anim_decoder_* dec, long offset) {
+  if (fseek(dec->file, offset, SEEK_SET)) {
+    return CHIMA_FILE_EOF;
+  }
+  stbi__start_file(&dec->stbi, dec->file);
+  dec->stbi.al = &dec->al;
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result anim_decoder_restart(chima_anim_decoder_* dec) {
+  chima_context chima = dec->chima;
+  if (dec->gif.out) {
+    CHIMA_FREE(dec->gif.out);
+    CHIMA_FREE(dec->gif.background);
+    CHIMA_FREE(dec->gif.history);
+  }
+  memset(&dec->gif, 0, sizeof(dec->gif));
+  dec->next_frame = 0;
+  dec->at_end = CHIMA_FALSE;
+  return anim_decoder_reset(dec, dec->start);
+}
+
+static chima_result anim_decoder_restore(chima_anim_decoder_* dec, const anim_checkpoint* cp) {
+  chima_context chima = dec->chima;
+  const chima_size texels = (chima_size)cp->gif.w * (chima_size)cp->gif.h;
+  if (!dec->gif.out) {
+    // Freed by a restart, the canvas size never changes so they can be allocated again
+    dec->gif.out = CHIMA_MALLOC(4 * texels);
+    dec->gif.background = CHIMA_MALLOC(4 * texels);
+    dec->gif.history = CHIMA_MALLOC(texels);
+    if (!dec->gif.out || !dec->gif.background || !dec->gif.history) {
+      CHIMA_FREE(dec->gif.out);
+      CHIMA_FREE(dec->gif.background);
+      CHIMA_FREE(dec->gif.history);
+      dec->gif.out = dec->gif.background = dec->gif.history = NULL;
+      return CHIMA_ALLOC_FAILURE;
     }
+  }
+  stbi_uc* out = dec->gif.out;
+  stbi_uc* background = dec->gif.background;
+  stbi_uc* history = dec->gif.history;
+  memcpy(&dec->gif, &cp->gif, sizeof(dec->gif));
+  const chima_u8* data = (const chima_u8*)(cp + 1);
+  memcpy(out, data, 4 * texels);
+  memcpy(background, data + 4 * texels, 4 * texels);
+  memcpy(history, data + 8 * texels, texels);
+  dec->gif.out = out;
+  dec->gif.background = background;
+  dec->gif.history = history;
+  dec->next_frame = cp->frame;
+  dec->at_end = CHIMA_FALSE;
+  return anim_decoder_reset(dec, cp->offset);
+}
 
-    if (!curr_node) {
-      curr_node = &head; // First image
-    } else {
-      gif_node* node = CHIMA_MALLOC(sizeof(gif_node));
-      if (!node) {
-        ret = CHIMA_ALLOC_FAILURE;
-        free_images = CHIMA_TRUE;
-        goto free_nodes;
+// Takes a checkpoint of the state before decoding the next frame, if it is due
+static chima_result anim_decoder_checkpoint(chima_anim_decoder_* dec) {
+  chima_context chima = dec->chima;
+  const chima_size frame = dec->next_frame;
+  if (!frame || !dec->gif.out || frame % dec->interval) {
+    return CHIMA_NO_ERROR;
+  }
+  if (dec->checkpoint_count && dec->checkpoints[dec->checkpoint_count - 1]->frame >= frame) {
+    return CHIMA_NO_ERROR;
+  }
+  const chima_size cp_size = anim_checkpoint_size(dec);
+  chima_size max_count = dec->budget / cp_size;
+  max_count = max_count < ANIM_MAX_CHECKPOINTS ? max_count : ANIM_MAX_CHECKPOINTS;
+  if (!max_count) {
+    return CHIMA_NO_ERROR;
+  }
+  if (dec->checkpoint_count == max_count) {
+    dec->interval *= 2;
+    chima_size kept = 0;
+    for (chima_size i = 0; i < dec->checkpoint_count; ++i) {
+      if (dec->checkpoints[i]->frame % dec->interval) {
+        CHIMA_FREE(dec->checkpoints[i]);
+      } else {
+        dec->checkpoints[kept++] = dec->checkpoints[i];
       }
-      memset(node, 0, sizeof(gif_node));
-      curr_node->next = node;
-      curr_node = node;
     }
-
-    chima_size image_sz = comp * gif.w * gif.h;
-    curr_node->data = CHIMA_MALLOC(image_sz);
-    if (!curr_node->data) {
-      ret = CHIMA_ALLOC_FAILURE;
-      free_images = CHIMA_TRUE;
-      goto free_nodes;
+    dec->checkpoint_count = kept;
+    if (frame % dec->interval || kept == max_count) {
+      return CHIMA_NO_ERROR;
     }
-    memcpy(curr_node->data, data, image_sz);
-    curr_node->width = gif.w;
-    curr_node->height = gif.h;
-    curr_node->channels = comp;
-    curr_node->delay = gif.delay;
+  }
 
-    ++image_count;
+  anim_checkpoint* cp = CHIMA_MALLOC(cp_size);
+  if (!cp) {
+    return CHIMA_ALLOC_FAILURE;
   }
-  CHIMA_FREE(gif.out);
-  CHIMA_FREE(gif.history);
-  CHIMA_FREE(gif.background);
+  const chima_size texels = anim_canvas_texels(dec);
+  cp->frame = frame;
+  // Part of the file may be buffered already
+  cp->offset = ftell(dec->file) - (long)(dec->stbi.img_buffer_end - dec->stbi.img_buffer);
+  memcpy(&cp->gif, &dec->gif, sizeof(cp->gif));
+  chima_u8* data = (chima_u8*)(cp + 1);
+  memcpy(data, dec->gif.out, 4 * texels);
+  memcpy(data + 4 * texels, dec->gif.background, 4 * texels);
+  memcpy(data + 8 * texels, dec->gif.history, texels);
+  dec->checkpoints[dec->checkpoint_count++] = cp;
+  return CHIMA_NO_ERROR;
+}
 
-  chima_image* images = CHIMA_CALLOC(image_count, sizeof(chima_image));
-  if (!images) {
-    ret = CHIMA_ALLOC_FAILURE;
-    free_images = CHIMA_TRUE;
-    goto free_nodes;
+static chima_result anim_decoder_decode(chima_anim_decoder_* dec) {
+  if (dec->at_end) {
+    return CHIMA_FILE_EOF;
   }
-  chima_u32* frametimes = CHIMA_CALLOC(image_count, sizeof(chima_u32));
-  if (!frametimes) {
-    ret = CHIMA_ALLOC_FAILURE;
-    free_images = CHIMA_TRUE;
-    CHIMA_FREE(images);
-    goto free_nodes;
+  const chima_result ret = anim_decoder_checkpoint(dec);
+  if (ret) {
+    return ret;
   }
-
-  memset(images, 0, image_count * sizeof(chima_image));
-  curr_node = &head;
-  size_t i = 0;
-  while (curr_node) {
-    images[i].data = curr_node->data;
-    images[i].extent.height = curr_node->height;
-    images[i].extent.width = curr_node->width;
-    images[i].channels = curr_node->channels;
-    images[i].depth = CHIMA_DEPTH_8U;
-    frametimes[i] = (chima_u32)curr_node->delay;
-    curr_node = curr_node->next;
-    ++i;
+  int comp = 0;
+  void* data = stbi__gif_load_next(&dec->stbi, &dec->gif, &comp, 0, NULL);
+  if (!data) {
+    return CHIMA_IMAGE_PARSE_FAILURE;
   }
+  if (data == &dec->stbi) {
+    dec->at_end = CHIMA_TRUE;
+    dec->frame_count = dec->next_frame;
+    return CHIMA_FILE_EOF;
+  }
+  dec->frame.data = data;
+  dec->frame.extent.width = (chima_u32)dec->gif.w;
+  dec->frame.extent.height = (chima_u32)dec->gif.h;
+  dec->frame.channels = (chima_u32)comp;
+  dec->frame.depth = CHIMA_DEPTH_8U;
+  ++dec->next_frame;
+  return CHIMA_NO_ERROR;
+}
 
-  memset(anim, 0, sizeof(chima_image_anim));
-  anim->images = images;
-  anim->frametimes = frametimes;
-  anim->image_count = image_count;
-
-free_nodes:
-  curr_node = head.next;
-  while (curr_node) {
-    gif_node* node = curr_node;
-    curr_node = node->next;
-    if (node->data && free_images) {
-      CHIMA_FREE(node->data);
-    }
-    CHIMA_FREE(node);
+static chima_result create_anim_decoder(chima_context chima, chima_anim_decoder* decoder,
+                                        FILE* f, chima_bool owns_file,
+                                        chima_size memory_budget) {
+  chima_anim_decoder_* dec = CHIMA_MALLOC(sizeof(chima_anim_decoder_));
+  if (!dec) {
+    return CHIMA_ALLOC_FAILURE;
   }
-  if (free_images) {
-    CHIMA_FREE(head.data);
+  memset(dec, 0, sizeof(*dec));
+  dec->chima = chima;
+  dec->file = f;
+  dec->start = ftell(f);
+  dec->al.user = chima->mem_user;
+  dec->al.malloc = chima->mem_alloc;
+  dec->al.realloc = chima->mem_realloc;
+  dec->al.free = chima->mem_free;
+  dec->budget = memory_budget;
+  dec->interval = 1;
+
+  chima_result ret = dec->start < 0 ? CHIMA_FILE_EOF : anim_decoder_reset(dec, dec->start);
+  if (ret) {
+    CHIMA_FREE(dec);
+    return ret;
   }
-
-  return ret;
+  if (!stbi__gif_test(&dec->stbi)) {
+    CHIMA_FREE(dec);
+    return CHIMA_UNSUPPORTED_FORMAT;
+  }
+  dec->owns_file = owns_file;
+  *decoder = dec;
+  return CHIMA_NO_ERROR;
 }
 
-chima_result chima_load_image_anim(chima_context chima, chima_image_anim* anim, const char* path) {
-  if (!chima || !path || !anim) {
+chima_result chima_create_anim_decoder_file(chima_context chima, chima_anim_decoder* decoder,
+                                            FILE* f, chima_size memory_budget) {
+  if (!chima || !decoder || !f) {
     return CHIMA_INVALID_VALUE;
   }
+  return create_anim_decoder(chima, decoder, f, CHIMA_FALSE, memory_budget);
+}
 
+chima_result chima_create_anim_decoder(chima_context chima, chima_anim_decoder* decoder,
+                                       const char* path, chima_size memory_budget) {
+  if (!chima || !decoder || !path) {
+    return CHIMA_INVALID_VALUE;
+  }
   FILE* f = fopen(path, "rb");
   if (!f) {
     return CHIMA_FILE_OPEN_FAILURE;
   }
-  chima_result ret = chima_load_image_anim_file(chima, anim, f);
-  fclose(f);
+  const chima_result ret = create_anim_decoder(chima, decoder, f, CHIMA_TRUE, memory_budget);
+  if (ret) {
+    fclose(f);
+  }
   return ret;
 }
 
-void chima_destroy_image_anim(chima_context chima, chima_image_anim* anim) {
-  if (!anim) {
+chima_result chima_anim_decoder_next(chima_anim_decoder decoder, const chima_image** frame,
+                                     chima_u32* frametime) {
+  if (!decoder || !frame) {
+    return CHIMA_INVALID_VALUE;
+  }
+  const chima_result ret = anim_decoder_decode(decoder);
+  if (ret) {
+    return ret;
+  }
+  *frame = &decoder->frame;
+  if (frametime) {
+    *frametime = (chima_u32)decoder->gif.delay;
+  }
+  return CHIMA_NO_ERROR;
+}
+
+chima_result chima_anim_decoder_seek(chima_anim_decoder decoder, chima_size frame) {
+  if (!decoder) {
+    return CHIMA_INVALID_VALUE;
+  }
+  if (decoder->frame_count && frame >= decoder->frame_count) {
+    return CHIMA_INVALID_VALUE;
+  }
+  // Closest checkpoint at or before the frame, unless the current position is closer
+  const anim_checkpoint* cp = NULL;
+  for (chima_size i = 0; i < decoder->checkpoint_count; ++i) {
+    if (decoder->checkpoints[i]->frame > frame) {
+      break;
+    }
+    cp = decoder->checkpoints[i];
+  }
+  chima_result ret = CHIMA_NO_ERROR;
+  if (frame < decoder->next_frame || (cp && cp->frame > decoder->next_frame)) {
+    ret = cp ? anim_decoder_restore(decoder, cp) : anim_decoder_restart(decoder);
+  }
+  while (!ret && decoder->next_frame < frame) {
+    ret = anim_decoder_decode(decoder);
+  }
+  return ret == CHIMA_FILE_EOF ? CHIMA_INVALID_VALUE : ret;
+}
+
+chima_size chima_anim_decoder_tell(chima_anim_decoder decoder) {
+  return decoder ? decoder->next_frame : 0;
+}
+
+chima_size chima_anim_decoder_frame_count(chima_anim_decoder decoder) {
+  return decoder ? decoder->frame_count : 0;
+}
+
+void chima_destroy_anim_decoder(chima_anim_decoder decoder) {
+  if (!decoder) {
     return;
   }
-  for (size_t i = 0; i < anim->image_count; ++i) {
-    CHIMA_FREE(anim->images[i].data);
+  chima_context chima = decoder->chima;
+  for (chima_size i = 0; i < decoder->checkpoint_count; ++i) {
+    CHIMA_FREE(decoder->checkpoints[i]);
   }
-  CHIMA_FREE(anim->images);
-  CHIMA_FREE(anim->frametimes);
-  memset(anim, 0, sizeof(chima_image_anim));
+  if (decoder->gif.out) {
+    CHIMA_FREE(decoder->gif.out);
+    CHIMA_FREE(decoder->gif.background);
+    CHIMA_FREE(decoder->gif.history);
+  }
+  if (decoder->owns_file) {
+    fclose(decoder->file);
+  }
+  memset(decoder, 0, sizeof(*decoder));
+  CHIMA_FREE(decoder);
 }
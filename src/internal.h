@@ -15,10 +15,23 @@
 
 #define CHIMA_SET_FLAG(cond_, flags_, flag_) cond_ ? (flags_ | flag_) : (flags_ & ~flag_)
 
+#define CHIMA_MAX(a_, b_) ((a_) > (b_) ? (a_) : (b_))
+#define CHIMA_MIN(a_, b_) ((a_) < (b_) ? (a_) : (b_))
+
 #define CHIMA_CLAMP(val_, min_, max_) val_ > max_ ? max_ : (val_ < min_ ? min_ : val_)
 
+#if !defined(CHIMA_DISABLE_SIMD) && (defined(__x86_64__) || defined(__i386__))
+#define CHIMA_X86_SIMD 1
+#define CHIMA_TARGET(isa_) __attribute__((target(isa_)))
+#endif
+
+#define CHIMA_ATLAS_MAX_SIZE 16384 // Upper bound of the atlas size, on both sides
+#define CHIMA_BLEED_MAX_RADIUS 16  // Upper bound of the alpha bleeding search distance
+
 static const char CHIMA_MAGIC[] = {0x89, 'C', 'H', 'I', 'M', 'A', 0x89, 'A', 'S', 'S', 'E', 'T'};
 
+typedef struct chima_thread_pool_* chima_thread_pool;
+
 // TODO: Add a scratch arena?
 typedef struct chima_context_ {
   void* mem_user;
@@ -28,6 +41,17 @@ typedef struct chima_context_ {
   chima_bitfield flags;
   chima_f32 atlas_grow_fac;
   chima_u32 atlas_initial;
+  chima_u32 atlas_multiple;
+  chima_u32 atlas_max_size;
+  chima_u32 atlas_extrude;
+  chima_u32 atlas_block;
+  chima_u32 atlas_bleed;
+  chima_u32 thread_count;
+  chima_thread_pool thread_pool; // Started on first use, see `chima__parallel_for`
+  chima_packer_type packer_type;
+  chima_packer packer_custom;
+  chima_bitfield packer_best_of;
+  chima_atlas_stats atlas_stats;
 } chima_context_;
 
 typedef enum file_asset_type {
@@ -40,12 +64,180 @@ typedef enum file_asset_type {
 typedef enum chima_ctx_flags {
   CHIMA_CTX_FLAG_NONE = 0x0000,
   CHIMA_CTX_FLAG_FLIP_Y = 0x0001,
+  CHIMA_CTX_FLAG_DEFAULT_ALLOC = 0x0002, // Using the libc allocator, calloc() is available
+  CHIMA_CTX_FLAG_ATLAS_POW2 = 0x0004,
+  CHIMA_CTX_FLAG_ATLAS_NON_SQUARE = 0x0008,
+  CHIMA_CTX_FLAG_SPRITE_TRIM = 0x0010,
+  CHIMA_CTX_FLAG_ATLAS_ROTATE = 0x0020,
+  CHIMA_CTX_FLAG_ATLAS_GROUP_ANIMS = 0x0040,
+  CHIMA_CTX_FLAG_ANIM_MERGE_FRAMES = 0x0080,
+  CHIMA_CTX_FLAG_SHEET_MAP_FILE = 0x0100,
 
   _CHIMA_CTX_FLAG_FORCE_32BIT = 0x7FFFFFFF,
 } chima_ctx_flags;
 
+typedef enum chima_cpu_flags {
+  CHIMA_CPU_FLAG_NONE = 0x0000,
+  CHIMA_CPU_FLAG_SSE2 = 0x0001,
+  CHIMA_CPU_FLAG_AVX2 = 0x0002,
+
+  _CHIMA_CPU_FLAG_FORCE_32BIT = 0x7FFFFFFF,
+} chima_cpu_flags;
+
+static inline chima_size chima__depth_size(chima_image_depth depth) {
+  switch (depth) {
+    case CHIMA_DEPTH_8U: return sizeof(chima_u8);
+    case CHIMA_DEPTH_16U: return sizeof(chima_u16);
+    case CHIMA_DEPTH_32F: return sizeof(chima_f32);
+    default: return 0;
+  }
+}
+
+// Instruction sets usable for kernel dispatch. Always `CHIMA_CPU_FLAG_NONE` if SIMD is disabled.
+chima_bitfield chima__cpu_features(void);
+
+// Job callback for `chima__parallel_for`. Runs on worker threads, must not use the context
+// allocator unless the caller documents that it has to be thread safe.
+typedef chima_result (*PFN_chima__job)(void* user, chima_size job_idx);
+
+// Number of threads `chima__parallel_for` would use for `job_count` jobs.
+chima_u32 chima__thread_count(chima_context chima, chima_size job_count);
+
+// Runs `job` for every index in [0, job_count) using the context thread count. Returns the first
+// error reported by a job, if any. The calling thread also takes jobs, the others come from the
+// context thread pool. Jobs must not call it again on the same context.
+chima_result chima__parallel_for(chima_context chima, chima_size job_count, PFN_chima__job job,
+                                 void* user);
+
+// Stops and joins the workers of the context thread pool, if it was started.
+void chima__destroy_thread_pool(chima_context chima);
+
+// Content hash of `size` bytes, for finding duplicated data. Not stable across versions.
+uint64_t chima__hash_bytes(const void* data, chima_size size);
+
+// Monotonic clock, in nanoseconds.
+uint64_t chima__time_ns(void);
+
+// Maps a whole file copy on write. Fails with `CHIMA_INVALID_FILE_FORMAT` on empty files.
+chima_result chima__map_file(chima_context chima, const char* path,
+                             chima_file_mapping* mapping);
+
+// Start and size of the mapped file.
+const chima_u8* chima__mapping_data(chima_file_mapping mapping, chima_size* size);
+
+void chima__unmap_file(chima_file_mapping mapping);
+
+// Placing order of the free rect packers, biggest first
+typedef enum chima__pack_order {
+  CHIMA_PACK_ORDER_AREA = 0,
+  CHIMA_PACK_ORDER_SIDE,
+  CHIMA_PACK_ORDER_HEIGHT,
+
+  _CHIMA_PACK_ORDER_COUNT,
+} chima__pack_order;
+
+// Rect packer state, reused by every pack of an atlas size search.
+typedef struct chima__packer {
+  chima_context chima;
+  chima_packer_type type;
+  chima_packer custom;
+  chima_size rect_count;
+  chima_bool rotate;
+  chima_extent2d* sizes; // Input rect sizes, when rotation is allowed or the packer is custom
+  chima_u32* order;      // Placing order, for the free rect packers
+  chima_rect* free_rects;
+  chima_rect* free_swap;
+  chima_size free_count, free_cap;
+  void* stb_rects;
+  void* stb_nodes;
+} chima__packer;
+
+// Prepares a packer for `rects`. Only the rect sizes are read. `order` is ignored by the skyline
+// and custom packers. `rotate` allows swapping the rect sides, custom packers are only checked
+// against it. `max_width` is the widest atlas that will be tried.
+chima_result chima__packer_init(chima_context chima, chima__packer* packer,
+                                chima_packer_type type, chima__pack_order order,
+                                chima_bool rotate, const chima_rect* rects, chima_size rect_count,
+                                chima_u32 max_width);
+
+// Places every rect inside of a `width` x `height` area, writing their positions. If rotation
+// is allowed, a rect may also get its width and height swapped. Returns
+// `CHIMA_PACKING_FAILED` if they don't fit, leaving the positions in an unspecified state.
+chima_result chima__packer_run(chima__packer* packer, chima_u32 width, chima_u32 height,
+                               chima_rect* rects);
+
+void chima__packer_destroy(chima__packer* packer);
+
+// Zeroed allocation. Uses calloc() with the default allocator, so big blocks get zero pages.
+void* chima__calloc(chima_context chima, chima_size count, chima_size size);
+
+// Converts `color` to a single texel of the given format. Returns the texel size in bytes, or
+// 0 if `depth` is invalid. `texel` must hold at least 16 bytes.
+chima_size chima__color_texel(chima_color color, chima_u32 channels, chima_image_depth depth,
+                              chima_u8* texel);
+
+// Writes `count` copies of `texel` to `dst`.
+void chima__fill_texels(void* dst, chima_size count, const chima_u8* texel,
+                        chima_size texel_size);
+
+// `chima_composite_image_ex` reading only `src_rect` from `src`, which must be inside of it.
+chima_result chima__composite_rect(chima_image* dst, const chima_image* src,
+                                   const chima_rect* src_rect, chima_u32 xpos, chima_u32 ypos,
+                                   chima_blend_mode mode);
+
+// Copies `src_rect` of `src` rotated 90 degrees clockwise, so source column `x` becomes
+// destination row `ypos + x`. Both images must have the same format, and the rotated rect must
+// fit inside of `dst`.
+chima_result chima__copy_rect_rotated(chima_image* dst, const chima_image* src,
+                                      const chima_rect* src_rect, chima_u32 xpos,
+                                      chima_u32 ypos);
+
+// `chima__copy_rect_rotated` blending the rotated texels over `dst` with `mode`.
+chima_result chima__composite_rect_rotated(chima_image* dst, const chima_image* src,
+                                           const chima_rect* src_rect, chima_u32 xpos,
+                                           chima_u32 ypos, chima_blend_mode mode);
+
+// Gives the fully transparent texels of an atlas row the color of their closest opaque texels,
+// searching up to `radius` texels away. `dst` is the first texel of sprite row `row`, copied
+// from `slice` of `src` (rotated 90 degrees clockwise if `rotated` is set). Images without alpha
+// are left as is.
+void chima__bleed_row(chima_u8* dst, const chima_image* src, const chima_rect* slice,
+                      chima_u32 row, chima_bool rotated, chima_u32 radius);
+
+// Loads every frame of the GIF file in `data`, decoding them on the context threads. The
+// animation is allocated as a single block starting at its image array.
+chima_result chima__load_gif(chima_context chima, chima_image_anim* anim, const chima_u8* data,
+                             chima_size size);
+
+// Adds a rect to the dirty region of `dirty`, clipped to the tracked image. Does nothing if
+// `dirty` is `NULL`.
+void chima__mark_dirty(chima_dirty_tracker dirty, chima_u32 x, chima_u32 y, chima_u32 width,
+                       chima_u32 height);
+
+// Bounds of the texels with a non zero alpha. Images without alpha return their full extent.
+// Returns `CHIMA_FALSE` if every texel is transparent.
+chima_bool chima__alpha_bounds(const chima_image* image, chima_rect* bounds);
+
+// Run of consecutive images packed next to each other
+typedef struct chima__rect_group {
+  chima_u32 first;
+  chima_u32 count;
+} chima__rect_group;
+
+// `chima_gen_atlas_image` packing only `src_rects` of each image (if not `NULL`), and spilling
+// over to more pages when the images don't fit in one. `pages` gets a new array of `page_count`
+// images, and `sprite_pages` (if not `NULL`) the page of each image. The images of each of the
+// `group_count` groups (sorted and disjoint) are laid out together and packed as a single rect.
+chima_result chima__gen_atlas_pages(chima_context chima, chima_image** pages,
+                                    chima_size* page_count, chima_rect* sprites,
+                                    chima_u32* sprite_pages, chima_u32 padding,
+                                    chima_color background_color, const chima_image* images,
+                                    const chima_rect* src_rects, chima_size image_count,
+                                    const chima__rect_group* groups, chima_size group_count);
+
 chima_size chima__write_atlas_file(chima_context chima, FILE* f, chima_u32 w, chima_u32 h,
-                                   chima_u32 ch, chima_image_format format, const void* data);
+                                   chima_u32 ch, chima_image_depth depth,
+                                   chima_image_format format, const void* data);
 
 #define CHIMA_MALLOC(size_) chima->mem_alloc(chima->mem_user, size_)
 
@@ -54,6 +246,6 @@ chima_size chima__write_atlas_file(chima_context chima, FILE* f, chima_u32 w, ch
 
 #define CHIMA_FREE(ptr_) chima->mem_free(chima->mem_user, ptr_)
 
-#define CHIMA_CALLOC(n_, size_) chima->mem_alloc(chima->mem_user, n_* size_)
+#define CHIMA_CALLOC(n_, size_) chima__calloc(chima, n_, size_)
 
 #endif
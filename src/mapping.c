@@ -0,0 +1,136 @@
+#include "./internal.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Read only file mappings.
+ *
+ * Files are mapped copy on write: pages that are never written stay shared with the page cache
+ * (and with every other process mapping the same file), while writes to the mapping only ever
+ * touch private copies of the pages, never the file.
+ */
+
+typedef struct chima_file_mapping_ {
+  chima_context chima;
+  chima_u8* data;
+  chima_size size;
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE map;
+#endif
+} chima_file_mapping_;
+
+#ifdef _WIN32
+static chima_result map_file(chima_file_mapping mapping, const char* path) {
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return CHIMA_FILE_OPEN_FAILURE;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart > SIZE_MAX) {
+    CloseHandle(file);
+    return CHIMA_FILE_OPEN_FAILURE;
+  }
+  if (!size.QuadPart) {
+    CloseHandle(file);
+    return CHIMA_INVALID_FILE_FORMAT; // Empty files can't be mapped
+  }
+  HANDLE map = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  if (!map) {
+    CloseHandle(file);
+    return CHIMA_FILE_OPEN_FAILURE;
+  }
+  void* data = MapViewOfFile(map, FILE_MAP_COPY, 0, 0, 0);
+  if (!data) {
+    CloseHandle(map);
+    CloseHandle(file);
+    return CHIMA_FILE_OPEN_FAILURE;
+  }
+  mapping->data = data;
+  mapping->size = (chima_size)size.QuadPart;
+  mapping->file = file;
+  mapping->map = map;
+  return CHIMA_NO_ERROR;
+}
+
+static void unmap_file(chima_file_mapping mapping) {
+  UnmapViewOfFile(mapping->data);
+  CloseHandle(mapping->map);
+  CloseHandle(mapping->file);
+}
+#else
+static chima_result map_file(chima_file_mapping mapping, const char* path) {
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return CHIMA_FILE_OPEN_FAILURE;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || (uint64_t)st.st_size > SIZE_MAX) {
+    close(fd);
+    return CHIMA_FILE_OPEN_FAILURE;
+  }
+  if (!st.st_size) {
+    close(fd);
+    return CHIMA_INVALID_FILE_FORMAT; // Empty files can't be mapped
+  }
+  // The mapping keeps its own reference to the file
+  void* data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return CHIMA_FILE_OPEN_FAILURE;
+  }
+  mapping->data = data;
+  mapping->size = (chima_size)st.st_size;
+  return CHIMA_NO_ERROR;
+}
+
+static void unmap_file(chima_file_mapping mapping) {
+  munmap(mapping->data, mapping->size);
+}
+#endif
+
+chima_result chima__map_file(chima_context chima, const char* path,
+                             chima_file_mapping* mapping) {
+  CHIMA_ASSERT(chima && path && mapping);
+  chima_file_mapping out = CHIMA_MALLOC(sizeof(chima_file_mapping_));
+  if (!out) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  memset(out, 0, sizeof(*out));
+  out->chima = chima;
+  const chima_result ret = map_file(out, path);
+  if (ret) {
+    CHIMA_FREE(out);
+    return ret;
+  }
+  *mapping = out;
+  return CHIMA_NO_ERROR;
+}
+
+const chima_u8* chima__mapping_data(chima_file_mapping mapping, chima_size* size) {
+  CHIMA_ASSERT(mapping);
+  *size = mapping->size;
+  return mapping->data;
+}
+
+void chima__unmap_file(chima_file_mapping mapping) {
+  if (!mapping) {
+    return;
+  }
+  chima_context chima = mapping->chima;
+  CHIMA_ASSERT(chima);
+  unmap_file(mapping);
+  memset(mapping, 0, sizeof(*mapping));
+  CHIMA_FREE(mapping);
+}
@@ -0,0 +1,460 @@
+#include "./internal.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STB_RECT_PACK_IMPLEMENTATION
+#define STBRP_STATIC
+#include "./stb/stb_rect_pack.h"
+
+/*
+ * Rectangle packers.
+ *
+ * Skyline bottom-left is stb_rect_pack. MaxRects and Guillotine keep a list of free rects and
+ * place the rects one by one, in a size order, in the free rect with the best score. MaxRects
+ * free rects may overlap (every maximal free area is kept), Guillotine free rects never do
+ * (each placement splits its free rect in two).
+ *
+ * The packing order only depends on the rect sizes, so it's sorted once and reused by every
+ * pack of the atlas size search.
+ *
+ * With rotation allowed, a rect may be placed with its sides swapped. MaxRects and Guillotine
+ * score both orientations in every free rect, the skyline packer lays every rect on its long
+ * side. The input sizes are kept by the packer, since every pack may swap them.
+ */
+
+#define PACKER_FREE_RECTS 256
+
+typedef struct pack_order_key {
+  uint64_t key;
+  chima_u32 idx;
+} pack_order_key;
+
+static int compare_order_keys(const void* a, const void* b) {
+  const pack_order_key* ka = a;
+  const pack_order_key* kb = b;
+  if (ka->key != kb->key) {
+    return ka->key < kb->key ? 1 : -1; // Biggest first
+  }
+  return ka->idx < kb->idx ? -1 : (ka->idx > kb->idx);
+}
+
+// Makes room for `count` free rects in both buffers
+static chima_result reserve_free_rects(chima__packer* packer, chima_size count) {
+  chima_context chima = packer->chima;
+  if (count <= packer->free_cap) {
+    return CHIMA_NO_ERROR;
+  }
+  chima_size cap = packer->free_cap;
+  while (cap < count) {
+    cap *= 2;
+  }
+  const chima_size old_size = packer->free_cap * sizeof(chima_rect);
+  chima_rect* free_rects = CHIMA_REALLOC(packer->free_rects, old_size, cap * sizeof(chima_rect));
+  if (!free_rects) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  packer->free_rects = free_rects;
+  chima_rect* free_swap = CHIMA_REALLOC(packer->free_swap, old_size, cap * sizeof(chima_rect));
+  if (!free_swap) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  packer->free_swap = free_swap;
+  packer->free_cap = cap;
+  return CHIMA_NO_ERROR;
+}
+
+static chima_bool rect_contains(const chima_rect* a, const chima_rect* b) {
+  return b->x >= a->x && b->y >= a->y && b->x + b->width <= a->x + a->width &&
+         b->y + b->height <= a->y + a->height;
+}
+
+static chima_bool rect_intersects(const chima_rect* a, const chima_rect* b) {
+  return a->x < b->x + b->width && b->x < a->x + a->width && a->y < b->y + b->height &&
+         b->y < a->y + a->height;
+}
+
+// Score of a rect placed in a free rect, lower is better
+static uint64_t maxrects_score(chima_packer_type type, const chima_rect* free_rect, chima_u32 w,
+                               chima_u32 h) {
+  const uint64_t left_w = free_rect->width - w;
+  const uint64_t left_h = free_rect->height - h;
+  const uint64_t short_side = CHIMA_MIN(left_w, left_h);
+  const uint64_t long_side = CHIMA_MAX(left_w, left_h);
+  if (type == CHIMA_PACKER_MAXRECTS_BAF) {
+    const uint64_t area_left = (uint64_t)free_rect->width * free_rect->height - (uint64_t)w * h;
+    return (area_left << 16) | CHIMA_MIN(short_side, 0xFFFF);
+  }
+  return (short_side << 16) | CHIMA_MIN(long_side, 0xFFFF);
+}
+
+// Best area fit score of a Guillotine placement, ties broken by the shortest leftover side
+static uint64_t guillotine_score(const chima_rect* free_rect, chima_u32 w, chima_u32 h) {
+  const uint64_t short_side = CHIMA_MIN(free_rect->width - w, free_rect->height - h);
+  const uint64_t area = (uint64_t)free_rect->width * free_rect->height;
+  return (area << 16) | CHIMA_MIN(short_side, 0xFFFF);
+}
+
+static void rect_rotate(chima_rect* rect) {
+  const chima_u32 w = rect->width;
+  rect->width = rect->height;
+  rect->height = w;
+}
+
+static chima_result maxrects_place(chima__packer* packer, const chima_rect* node) {
+  chima_size hits = 0;
+  for (chima_size i = 0; i < packer->free_count; ++i) {
+    hits += rect_intersects(&packer->free_rects[i], node);
+  }
+  const chima_result ret = reserve_free_rects(packer, packer->free_count + 3 * hits);
+  if (ret) {
+    return ret;
+  }
+
+  // Free rects overlapping the node are replaced by their (up to 4) parts outside of it. The
+  // untouched rects go first, the new parts after them.
+  chima_rect* out = packer->free_swap;
+  chima_size kept = 0;
+  for (chima_size i = 0; i < packer->free_count; ++i) {
+    if (!rect_intersects(&packer->free_rects[i], node)) {
+      out[kept++] = packer->free_rects[i];
+    }
+  }
+  chima_size total = kept;
+  for (chima_size i = 0; i < packer->free_count; ++i) {
+    const chima_rect f = packer->free_rects[i];
+    if (!rect_intersects(&f, node)) {
+      continue;
+    }
+    if (node->x > f.x) {
+      out[total++] = (chima_rect){f.x, f.y, node->x - f.x, f.height};
+    }
+    if (node->x + node->width < f.x + f.width) {
+      const chima_u32 x = node->x + node->width;
+      out[total++] = (chima_rect){x, f.y, f.x + f.width - x, f.height};
+    }
+    if (node->y > f.y) {
+      out[total++] = (chima_rect){f.x, f.y, f.width, node->y - f.y};
+    }
+    if (node->y + node->height < f.y + f.height) {
+      const chima_u32 y = node->y + node->height;
+      out[total++] = (chima_rect){f.x, y, f.width, f.y + f.height - y};
+    }
+  }
+
+  // The untouched rects were already maximal, so only the new parts need pruning. Redundant
+  // parts are cleared instead of removed, anything inside of them is also inside of the rect
+  // that contained them. Of two equal parts only the first one is kept.
+  for (chima_size i = kept; i < total; ++i) {
+    for (chima_size j = 0; j < total; ++j) {
+      if (j == i || !out[j].width || !rect_contains(&out[j], &out[i])) {
+        continue;
+      }
+      if (j < i || !rect_contains(&out[i], &out[j])) {
+        out[i].width = 0;
+        break;
+      }
+    }
+  }
+  chima_size count = kept;
+  for (chima_size i = kept; i < total; ++i) {
+    if (out[i].width) {
+      out[count++] = out[i];
+    }
+  }
+
+  packer->free_swap = packer->free_rects;
+  packer->free_rects = out;
+  packer->free_count = count;
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result push_free_rect(chima__packer* packer, chima_rect rect) {
+  const chima_result ret = reserve_free_rects(packer, packer->free_count + 1);
+  if (ret) {
+    return ret;
+  }
+  packer->free_rects[packer->free_count++] = rect;
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result pack_maxrects(chima__packer* packer, chima_u32 width, chima_u32 height,
+                                  chima_rect* rects) {
+  packer->free_count = 0;
+  chima_result ret = push_free_rect(packer, (chima_rect){0, 0, width, height});
+  if (ret) {
+    return ret;
+  }
+  for (chima_size n = 0; n < packer->rect_count; ++n) {
+    chima_rect* rect = &rects[packer->order[n]];
+    if (!rect->width || !rect->height) {
+      rect->x = rect->y = 0;
+      continue;
+    }
+    const chima_bool try_rotated = packer->rotate && rect->width != rect->height;
+    chima_size best = packer->free_count;
+    chima_bool best_rotated = CHIMA_FALSE;
+    uint64_t best_score = UINT64_MAX;
+    for (chima_size i = 0; i < packer->free_count; ++i) {
+      const chima_rect* f = &packer->free_rects[i];
+      if (f->width >= rect->width && f->height >= rect->height) {
+        const uint64_t score = maxrects_score(packer->type, f, rect->width, rect->height);
+        if (score < best_score) {
+          best_score = score;
+          best = i;
+          best_rotated = CHIMA_FALSE;
+        }
+      }
+      if (try_rotated && f->width >= rect->height && f->height >= rect->width) {
+        const uint64_t score = maxrects_score(packer->type, f, rect->height, rect->width);
+        if (score < best_score) {
+          best_score = score;
+          best = i;
+          best_rotated = CHIMA_TRUE;
+        }
+      }
+    }
+    if (best == packer->free_count) {
+      return CHIMA_PACKING_FAILED;
+    }
+    if (best_rotated) {
+      rect_rotate(rect);
+    }
+    rect->x = packer->free_rects[best].x;
+    rect->y = packer->free_rects[best].y;
+    ret = maxrects_place(packer, rect);
+    if (ret) {
+      return ret;
+    }
+  }
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result pack_guillotine(chima__packer* packer, chima_u32 width, chima_u32 height,
+                                    chima_rect* rects) {
+  packer->free_count = 0;
+  chima_result ret = push_free_rect(packer, (chima_rect){0, 0, width, height});
+  if (ret) {
+    return ret;
+  }
+  for (chima_size n = 0; n < packer->rect_count; ++n) {
+    chima_rect* rect = &rects[packer->order[n]];
+    if (!rect->width || !rect->height) {
+      rect->x = rect->y = 0;
+      continue;
+    }
+    // Best area fit. Both orientations fill the same free rect, the one leaving the shortest
+    // side wins.
+    const chima_bool try_rotated = packer->rotate && rect->width != rect->height;
+    chima_size best = packer->free_count;
+    chima_bool best_rotated = CHIMA_FALSE;
+    uint64_t best_score = UINT64_MAX;
+    for (chima_size i = 0; i < packer->free_count; ++i) {
+      const chima_rect* f = &packer->free_rects[i];
+      if (f->width >= rect->width && f->height >= rect->height) {
+        const uint64_t score = guillotine_score(f, rect->width, rect->height);
+        if (score < best_score) {
+          best_score = score;
+          best = i;
+          best_rotated = CHIMA_FALSE;
+        }
+      }
+      if (try_rotated && f->width >= rect->height && f->height >= rect->width) {
+        const uint64_t score = guillotine_score(f, rect->height, rect->width);
+        if (score < best_score) {
+          best_score = score;
+          best = i;
+          best_rotated = CHIMA_TRUE;
+        }
+      }
+    }
+    if (best == packer->free_count) {
+      return CHIMA_PACKING_FAILED;
+    }
+    if (best_rotated) {
+      rect_rotate(rect);
+    }
+    const chima_rect f = packer->free_rects[best];
+    packer->free_rects[best] = packer->free_rects[--packer->free_count];
+    rect->x = f.x;
+    rect->y = f.y;
+
+    // Split along the shorter leftover axis, so the bigger leftover stays in one piece
+    const chima_u32 left_w = f.width - rect->width;
+    const chima_u32 left_h = f.height - rect->height;
+    chima_rect right, bottom;
+    if (left_w < left_h) {
+      right = (chima_rect){f.x + rect->width, f.y, left_w, rect->height};
+      bottom = (chima_rect){f.x, f.y + rect->height, f.width, left_h};
+    } else {
+      right = (chima_rect){f.x + rect->width, f.y, left_w, f.height};
+      bottom = (chima_rect){f.x, f.y + rect->height, rect->width, left_h};
+    }
+    if (right.width && right.height && (ret = push_free_rect(packer, right))) {
+      return ret;
+    }
+    if (bottom.width && bottom.height && (ret = push_free_rect(packer, bottom))) {
+      return ret;
+    }
+  }
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result pack_skyline(chima__packer* packer, chima_u32 width, chima_u32 height,
+                                 chima_rect* rects) {
+  stbrp_rect* stb_rects = packer->stb_rects;
+  for (chima_size i = 0; i < packer->rect_count; ++i) {
+    if (packer->rotate && rects[i].height > rects[i].width) {
+      rect_rotate(&rects[i]);
+    }
+    stb_rects[i].w = (stbrp_coord)rects[i].width;
+    stb_rects[i].h = (stbrp_coord)rects[i].height;
+  }
+  // One node per column, so stbrp never quantizes the rect widths
+  stbrp_context stbrp;
+  stbrp_init_target(&stbrp, (int)width, (int)height, packer->stb_nodes, (int)width);
+  if (!stbrp_pack_rects(&stbrp, stb_rects, (int)packer->rect_count)) {
+    return CHIMA_PACKING_FAILED;
+  }
+  for (chima_size i = 0; i < packer->rect_count; ++i) {
+    rects[i].x = (chima_u32)stb_rects[i].x;
+    rects[i].y = (chima_u32)stb_rects[i].y;
+  }
+  return CHIMA_NO_ERROR;
+}
+
+static uint64_t pack_order_key_of(chima__pack_order order, const chima_rect* rect) {
+  const uint64_t area = (uint64_t)rect->width * rect->height;
+  const uint64_t side = CHIMA_MAX(rect->width, rect->height);
+  switch (order) {
+    case CHIMA_PACK_ORDER_SIDE: return (side << 40) | CHIMA_MIN(area, 0xFFFFFFFFFFull);
+    case CHIMA_PACK_ORDER_HEIGHT: return ((uint64_t)rect->height << 32) | rect->width;
+    default: return (area << 20) | CHIMA_MIN(side, 0xFFFFF);
+  }
+}
+
+chima_result chima__packer_init(chima_context chima, chima__packer* packer,
+                                chima_packer_type type, chima__pack_order order,
+                                chima_bool rotate, const chima_rect* rects, chima_size rect_count,
+                                chima_u32 max_width) {
+  memset(packer, 0, sizeof(*packer));
+  packer->chima = chima;
+  packer->type = type;
+  packer->custom = chima->packer_custom;
+  packer->rect_count = rect_count;
+  packer->rotate = rotate;
+  if (packer->rotate || packer->type == CHIMA_PACKER_CUSTOM) {
+    packer->sizes = CHIMA_MALLOC(rect_count * sizeof(chima_extent2d));
+    if (!packer->sizes) {
+      return CHIMA_ALLOC_FAILURE;
+    }
+    for (chima_size i = 0; i < rect_count; ++i) {
+      packer->sizes[i] = (chima_extent2d){rects[i].width, rects[i].height};
+    }
+  }
+  switch (packer->type) {
+    case CHIMA_PACKER_SKYLINE_BL: {
+      packer->stb_rects = CHIMA_CALLOC(rect_count, sizeof(stbrp_rect));
+      packer->stb_nodes = CHIMA_CALLOC(max_width, sizeof(stbrp_node));
+      if (!packer->stb_rects || !packer->stb_nodes) {
+        chima__packer_destroy(packer);
+        return CHIMA_ALLOC_FAILURE;
+      }
+    } break;
+    case CHIMA_PACKER_MAXRECTS_BSSF:
+    case CHIMA_PACKER_MAXRECTS_BAF:
+    case CHIMA_PACKER_GUILLOTINE: {
+      pack_order_key* keys = CHIMA_CALLOC(rect_count, sizeof(pack_order_key));
+      packer->order = CHIMA_CALLOC(rect_count, sizeof(chima_u32));
+      packer->free_rects = CHIMA_MALLOC(PACKER_FREE_RECTS * sizeof(chima_rect));
+      packer->free_swap = CHIMA_MALLOC(PACKER_FREE_RECTS * sizeof(chima_rect));
+      packer->free_cap = PACKER_FREE_RECTS;
+      if (!keys || !packer->order || !packer->free_rects || !packer->free_swap) {
+        CHIMA_FREE(keys);
+        chima__packer_destroy(packer);
+        return CHIMA_ALLOC_FAILURE;
+      }
+      for (chima_size i = 0; i < rect_count; ++i) {
+        keys[i].key = pack_order_key_of(order, &rects[i]);
+        keys[i].idx = (chima_u32)i;
+      }
+      qsort(keys, rect_count, sizeof(keys[0]), &compare_order_keys);
+      for (chima_size i = 0; i < rect_count; ++i) {
+        packer->order[i] = keys[i].idx;
+      }
+      CHIMA_FREE(keys);
+    } break;
+    case CHIMA_PACKER_CUSTOM: {
+      if (!packer->custom.pack) {
+        chima__packer_destroy(packer);
+        return CHIMA_INVALID_VALUE;
+      }
+    } break;
+    default:
+      chima__packer_destroy(packer);
+      return CHIMA_INVALID_VALUE;
+  }
+  return CHIMA_NO_ERROR;
+}
+
+// Custom packers are not trusted: every rect has to keep its size (or swap its sides, if
+// rotation is allowed) and fit inside of the atlas
+static chima_bool check_custom_rects(const chima__packer* packer, chima_u32 width,
+                                     chima_u32 height, const chima_rect* rects) {
+  for (chima_size i = 0; i < packer->rect_count; ++i) {
+    const chima_rect* rect = &rects[i];
+    const chima_extent2d size = packer->sizes[i];
+    const chima_bool same = rect->width == size.width && rect->height == size.height;
+    const chima_bool swapped =
+      packer->rotate && rect->width == size.height && rect->height == size.width;
+    if (!same && !swapped) {
+      return CHIMA_FALSE;
+    }
+    if ((uint64_t)rect->x + rect->width > width || (uint64_t)rect->y + rect->height > height) {
+      return CHIMA_FALSE;
+    }
+  }
+  return CHIMA_TRUE;
+}
+
+chima_result chima__packer_run(chima__packer* packer, chima_u32 width, chima_u32 height,
+                               chima_rect* rects) {
+  if (packer->sizes) {
+    for (chima_size i = 0; i < packer->rect_count; ++i) {
+      rects[i].width = packer->sizes[i].width;
+      rects[i].height = packer->sizes[i].height;
+    }
+  }
+  switch (packer->type) {
+    case CHIMA_PACKER_SKYLINE_BL:
+      return pack_skyline(packer, width, height, rects);
+    case CHIMA_PACKER_MAXRECTS_BSSF:
+    case CHIMA_PACKER_MAXRECTS_BAF:
+      return pack_maxrects(packer, width, height, rects);
+    case CHIMA_PACKER_GUILLOTINE:
+      return pack_guillotine(packer, width, height, rects);
+    case CHIMA_PACKER_CUSTOM: {
+      const chima_bool packed =
+        packer->custom.pack(packer->custom.user, width, height, rects, packer->rect_count);
+      return packed && check_custom_rects(packer, width, height, rects) ? CHIMA_NO_ERROR
+                                                                        : CHIMA_PACKING_FAILED;
+    }
+    default:
+      CHIMA_UNREACHABLE();
+  }
+}
+
+void chima__packer_destroy(chima__packer* packer) {
+  chima_context chima = packer->chima;
+  if (!chima) {
+    return;
+  }
+  CHIMA_FREE(packer->order);
+  CHIMA_FREE(packer->free_rects);
+  CHIMA_FREE(packer->free_swap);
+  CHIMA_FREE(packer->stb_rects);
+  CHIMA_FREE(packer->stb_nodes);
+  CHIMA_FREE(packer->sizes);
+  memset(packer, 0, sizeof(*packer));
+}
@@ -0,0 +1,145 @@
+#include "./internal.h"
+
+#include <string.h>
+
+/*
+ * Rotated texel copies, for sprites packed on their side.
+ *
+ * Rotating reads the source by columns, so the copy walks the destination in square blocks
+ * small enough for every source row they touch to stay in cache. Texels are copied whole, with
+ * one kernel per texel size so every copy is a fixed size move.
+ */
+
+#define ROTATE_BLOCK 32
+
+// Destination texel (x, y) comes from the source texel `y` columns right and `x` rows up of
+// `src_last`, the first texel of the last source row
+#define DEFINE_ROTATE_KERNEL(size)                                                            \
+  static void rotate_texels_##size(chima_u8* dst, chima_size dst_stride,                     \
+                                   const chima_u8* src_last, chima_size src_stride,          \
+                                   chima_size width, chima_size height) {                    \
+    for (chima_size by = 0; by < height; by += ROTATE_BLOCK) {                                \
+      const chima_size y_end = CHIMA_MIN(by + ROTATE_BLOCK, height);                          \
+      for (chima_size bx = 0; bx < width; bx += ROTATE_BLOCK) {                               \
+        const chima_size x_end = CHIMA_MIN(bx + ROTATE_BLOCK, width);                         \
+        for (chima_size y = by; y < y_end; ++y) {                                             \
+          chima_u8* out = dst + y * dst_stride;                                               \
+          const chima_u8* col = src_last + y * (size);                                        \
+          for (chima_size x = bx; x < x_end; ++x) {                                           \
+            memcpy(out + x * (size), col - x * src_stride, (size));                           \
+          }                                                                                   \
+        }                                                                                     \
+      }                                                                                       \
+    }                                                                                         \
+  }
+
+DEFINE_ROTATE_KERNEL(1)
+DEFINE_ROTATE_KERNEL(2)
+DEFINE_ROTATE_KERNEL(3)
+DEFINE_ROTATE_KERNEL(4)
+DEFINE_ROTATE_KERNEL(6)
+DEFINE_ROTATE_KERNEL(8)
+DEFINE_ROTATE_KERNEL(12)
+DEFINE_ROTATE_KERNEL(16)
+
+#undef DEFINE_ROTATE_KERNEL
+
+// Rotates a `width` by `height` block of destination texels, see the kernels
+static chima_bool rotate_texels(chima_size texel_size, chima_u8* dst, chima_size dst_stride,
+                                const chima_u8* src_last, chima_size src_stride,
+                                chima_size width, chima_size height) {
+  switch (texel_size) {
+    case 1: rotate_texels_1(dst, dst_stride, src_last, src_stride, width, height); break;
+    case 2: rotate_texels_2(dst, dst_stride, src_last, src_stride, width, height); break;
+    case 3: rotate_texels_3(dst, dst_stride, src_last, src_stride, width, height); break;
+    case 4: rotate_texels_4(dst, dst_stride, src_last, src_stride, width, height); break;
+    case 6: rotate_texels_6(dst, dst_stride, src_last, src_stride, width, height); break;
+    case 8: rotate_texels_8(dst, dst_stride, src_last, src_stride, width, height); break;
+    case 12: rotate_texels_12(dst, dst_stride, src_last, src_stride, width, height); break;
+    case 16: rotate_texels_16(dst, dst_stride, src_last, src_stride, width, height); break;
+    default: return CHIMA_FALSE;
+  }
+  return CHIMA_TRUE;
+}
+
+chima_result chima__copy_rect_rotated(chima_image* dst, const chima_image* src,
+                                      const chima_rect* src_rect, chima_u32 xpos,
+                                      chima_u32 ypos) {
+  if (!dst || !src || !dst->data || !src->data) {
+    return CHIMA_INVALID_VALUE;
+  }
+  if (src->depth != dst->depth || src->channels != dst->channels) {
+    return CHIMA_UNSUPPORTED_FORMAT;
+  }
+  CHIMA_ASSERT(src_rect->x + src_rect->width <= src->extent.width &&
+               src_rect->y + src_rect->height <= src->extent.height);
+  CHIMA_ASSERT(xpos + src_rect->height <= dst->extent.width &&
+               ypos + src_rect->width <= dst->extent.height);
+  if (!src_rect->width || !src_rect->height) {
+    return CHIMA_NO_ERROR;
+  }
+
+  const chima_size texel_size = dst->channels * chima__depth_size(dst->depth);
+  const chima_size dst_stride = dst->extent.width * texel_size;
+  const chima_size src_stride = src->extent.width * texel_size;
+  chima_u8* out = (chima_u8*)dst->data + ypos * dst_stride + xpos * texel_size;
+  const chima_u8* src_last = (const chima_u8*)src->data +
+                             (src_rect->y + src_rect->height - 1) * src_stride +
+                             src_rect->x * texel_size;
+  const chima_size width = src_rect->height, height = src_rect->width;
+  if (!rotate_texels(texel_size, out, dst_stride, src_last, src_stride, width, height)) {
+    return CHIMA_INVALID_VALUE;
+  }
+  return CHIMA_NO_ERROR;
+}
+
+chima_result chima__composite_rect_rotated(chima_image* dst, const chima_image* src,
+                                           const chima_rect* src_rect, chima_u32 xpos,
+                                           chima_u32 ypos, chima_blend_mode mode) {
+  if (mode == CHIMA_BLEND_REPLACE) {
+    return chima__copy_rect_rotated(dst, src, src_rect, xpos, ypos);
+  }
+  if (!dst || !src || !dst->data || !src->data) {
+    return CHIMA_INVALID_VALUE;
+  }
+  if (src->depth != dst->depth || src->channels != dst->channels) {
+    return CHIMA_UNSUPPORTED_FORMAT;
+  }
+  CHIMA_ASSERT(src_rect->x + src_rect->width <= src->extent.width &&
+               src_rect->y + src_rect->height <= src->extent.height);
+
+  // Each block is rotated to the stack first, then blended like an unrotated image
+  _Alignas(32) chima_u8 block[ROTATE_BLOCK * ROTATE_BLOCK * 4 * sizeof(chima_f32)];
+  const chima_size texel_size = dst->channels * chima__depth_size(dst->depth);
+  const chima_size src_stride = src->extent.width * texel_size;
+  const chima_u8* src_last = (const chima_u8*)src->data +
+                             (src_rect->y + src_rect->height - 1) * src_stride +
+                             src_rect->x * texel_size;
+  const chima_size width = src_rect->height, height = src_rect->width;
+  for (chima_size by = 0; by < height; by += ROTATE_BLOCK) {
+    const chima_size block_h = CHIMA_MIN(ROTATE_BLOCK, height - by);
+    for (chima_size bx = 0; bx < width; bx += ROTATE_BLOCK) {
+      const chima_size block_w = CHIMA_MIN(ROTATE_BLOCK, width - bx);
+      if (!rotate_texels(texel_size, block, block_w * texel_size,
+                         src_last + by * texel_size - bx * src_stride, src_stride, block_w,
+                         block_h)) {
+        return CHIMA_INVALID_VALUE;
+      }
+      chima_image rotated;
+      memset(&rotated, 0, sizeof(rotated));
+      rotated.data = block;
+      rotated.extent.width = (chima_u32)block_w;
+      rotated.extent.height = (chima_u32)block_h;
+      rotated.channels = src->channels;
+      rotated.depth = src->depth;
+      const chima_rect block_rect = {0, 0, (chima_u32)block_w, (chima_u32)block_h};
+      const chima_result ret = chima__composite_rect(dst, &rotated, &block_rect,
+                                                     xpos + (chima_u32)bx, ypos + (chima_u32)by,
+                                                     mode);
+      if (ret) {
+        return ret;
+      }
+    }
+  }
+  return CHIMA_NO_ERROR;
+}
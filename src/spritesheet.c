@@ -195,6 +195,106 @@ void chima_destroy_sheet_data(chima_sheet_data data) {
   CHIMA_FREE(data);
 }
 
+typedef struct sheet_hash_job {
+  const chima_image* images;
+  uint64_t* hashes;
+} sheet_hash_job;
+
+static chima_size sheet_image_size(const chima_image* image) {
+  return (chima_size)image->extent.width * image->extent.height * image->channels *
+         chima__depth_size(image->depth);
+}
+
+static chima_result hash_sheet_image(void* user, chima_size idx) {
+  const sheet_hash_job* job = user;
+  const chima_image* image = &job->images[idx];
+  job->hashes[idx] = image->data ? chima__hash_bytes(image->data, sheet_image_size(image)) : 0;
+  return CHIMA_NO_ERROR;
+}
+
+static chima_bool same_sheet_image(const chima_image* a, const chima_image* b) {
+  if (a->extent.width != b->extent.width || a->extent.height != b->extent.height ||
+      a->channels != b->channels || a->depth != b->depth) {
+    return CHIMA_FALSE;
+  }
+  return a->data == b->data || (a->data && b->data &&
+                                memcmp(a->data, b->data, sheet_image_size(a)) == 0);
+}
+
+/*
+ * Moves the unique images to the front of `images` (keeping their order) and writes the index of
+ * the unique copy of every image to `image_rects`. The images are hashed in parallel, and images
+ * with the same hash are compared byte by byte.
+ */
+static chima_result dedup_sheet_images(chima_context chima, chima_image* images,
+                                       chima_size image_count, chima_u32* image_rects,
+                                       chima_size* unique_count) {
+  chima_result ret = CHIMA_NO_ERROR;
+  uint64_t* hashes = CHIMA_CALLOC(image_count, sizeof(uint64_t));
+  if (!hashes) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  sheet_hash_job job;
+  job.images = images;
+  job.hashes = hashes;
+  ret = chima__parallel_for(chima, image_count, &hash_sheet_image, &job);
+  if (ret) {
+    goto free_hashes;
+  }
+
+  // Open addressing table of unique image indices plus one, 0 is an empty slot
+  chima_size table_size = 16;
+  while (table_size < image_count * 2) {
+    table_size *= 2;
+  }
+  chima_u32* table = CHIMA_CALLOC(table_size, sizeof(chima_u32));
+  if (!table) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_hashes;
+  }
+
+  chima_size count = 0;
+  for (chima_size i = 0; i < image_count; ++i) {
+    const uint64_t hash = hashes[i];
+    chima_size slot = (chima_size)hash & (table_size - 1);
+    for (;;) {
+      const chima_u32 entry = table[slot];
+      if (!entry) {
+        // New unique image, `count <= i` so the move never overwrites an unvisited image
+        images[count] = images[i];
+        hashes[count] = hash;
+        table[slot] = (chima_u32)(++count);
+        image_rects[i] = (chima_u32)(count - 1);
+        break;
+      }
+      if (hashes[entry - 1] == hash && same_sheet_image(&images[entry - 1], &images[i])) {
+        image_rects[i] = entry - 1;
+        break;
+      }
+      slot = (slot + 1) & (table_size - 1);
+    }
+  }
+  *unique_count = count;
+
+  CHIMA_FREE(table);
+free_hashes:
+  CHIMA_FREE(hashes);
+  return ret;
+}
+
+typedef struct sheet_trim_job {
+  const chima_image* images;
+  chima_rect* trims;
+} sheet_trim_job;
+
+static chima_result trim_sheet_image(void* user, chima_size idx) {
+  const sheet_trim_job* job = user;
+  if (!chima__alpha_bounds(&job->images[idx], &job->trims[idx])) {
+    memset(&job->trims[idx], 0, sizeof(chima_rect)); // Fully transparent, nothing to pack
+  }
+  return CHIMA_NO_ERROR;
+}
+
 chima_result chima_gen_spritesheet(chima_context chima, chima_spritesheet* sheet,
                                              chima_sheet_data data, chima_u32 padding,
                                              chima_color background_color) {
@@ -258,8 +358,8 @@ chima_result chima_gen_spritesheet(chima_context chima, chima_spritesheet* sheet
     // animation image, and set the appropiate indices
     chima_size anim_idx = 0;
     sheet_anim_node* anim_node = data->anim_head;
-    const chima_size anim_image_count = anim_node->anim->image_count;
     while (anim_node) {
+      const chima_size anim_image_count = anim_node->anim->image_count;
       memcpy(images+image_idx, anim_node->anim->images, anim_image_count*sizeof(images[0]));
       for (chima_size i = 0; i < anim_image_count; ++i) {
         // For animations, we generate a name using the current image index
@@ -277,18 +377,96 @@ chima_result chima_gen_spritesheet(chima_context chima, chima_spritesheet* sheet
     }
   }
 
+  // Identical images are packed once, `image_rects` maps every sprite to its unique image.
+  // `rect_pages` holds the atlas page of each unique image.
+  chima_u32* image_rects = CHIMA_CALLOC(2 * total_images, sizeof(chima_u32));
+  chima_u32* rect_pages = image_rects + total_images;
+  if (!image_rects) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_sheet_anims;
+  }
+  chima_size unique_count = 0;
+  ret = dedup_sheet_images(chima, images, total_images, image_rects, &unique_count);
+  if (ret) {
+    goto free_sheet_image_rects;
+  }
+
+  // Only the opaque part of each unique image is packed when trimming
+  chima_rect* trims = NULL;
+  if (chima->flags & CHIMA_CTX_FLAG_SPRITE_TRIM) {
+    trims = CHIMA_CALLOC(unique_count, sizeof(chima_rect));
+    if (!trims) {
+      ret = CHIMA_ALLOC_FAILURE;
+      goto free_sheet_image_rects;
+    }
+    sheet_trim_job job;
+    job.images = images;
+    job.trims = trims;
+    ret = chima__parallel_for(chima, unique_count, &trim_sheet_image, &job);
+    if (ret) {
+      goto free_sheet_trims;
+    }
+  }
+
+  // Unique images keep their order, so the frames an animation doesn't share with an earlier
+  // sprite are a single run of them
+  chima__rect_group* groups = NULL;
+  chima_size group_count = 0;
+  if ((chima->flags & CHIMA_CTX_FLAG_ATLAS_GROUP_ANIMS) && data->anim_count) {
+    groups = CHIMA_CALLOC(data->anim_count, sizeof(chima__rect_group));
+    if (!groups) {
+      ret = CHIMA_ALLOC_FAILURE;
+      goto free_sheet_trims;
+    }
+    // Anims are stored after the single images, in sprite order
+    chima_u32 seen = 0;
+    chima_size sprite = 0;
+    for (chima_size i = 0; i < data->anim_count; ++i) {
+      for (; sprite < anims[i].sprite_start; ++sprite) {
+        seen = CHIMA_MAX(image_rects[sprite] + 1, seen);
+      }
+      const chima_u32 first = seen;
+      for (; sprite < anims[i].sprite_start + anims[i].sprite_count; ++sprite) {
+        seen = CHIMA_MAX(image_rects[sprite] + 1, seen);
+      }
+      if (seen - first > 1) {
+        groups[group_count].first = first;
+        groups[group_count++].count = seen - first;
+      }
+    }
+  }
+
   memset(sheet, 0, sizeof(*sheet));
   // Once we have our images copied to a buffer, we generate an atlas
-  ret = chima_gen_atlas_image(chima, &sheet->atlas, rects, padding, background_color, images,
-                              total_images);
+  ret = chima__gen_atlas_pages(chima, &sheet->pages, &sheet->page_count, rects, rect_pages,
+                               padding, background_color, images, trims, unique_count, groups,
+                               group_count);
+  if (groups) {
+    CHIMA_FREE(groups);
+  }
   if (ret) {
-    goto free_sheet_anims;
+    goto free_sheet_trims;
   }
 
   // Now we copy all the rectangles
   for (chima_size i = 0; i < total_images; ++i) {
-    memcpy(&sprites[i].rect, rects+i, sizeof(rects[0]));
+    const chima_u32 idx = image_rects[i];
+    memcpy(&sprites[i].rect, rects+idx, sizeof(rects[0]));
+    sprites[i].page = rect_pages[idx];
+    sprites[i].source_extent = images[idx].extent;
+    chima_u32 packed_width = images[idx].extent.width;
+    if (trims) {
+      sprites[i].trim_x = trims[idx].x;
+      sprites[i].trim_y = trims[idx].y;
+      packed_width = trims[idx].width;
+    }
+    // Rotated rects have their sides swapped, square ones are never rotated
+    sprites[i].rotated = rects[idx].width != packed_width;
+  }
+  if (trims) {
+    CHIMA_FREE(trims);
   }
+  CHIMA_FREE(image_rects);
 
   sheet->sprite_count = total_images;
   sheet->anim_count = data->anim_count;
@@ -296,6 +474,12 @@ chima_result chima_gen_spritesheet(chima_context chima, chima_spritesheet* sheet
   sheet->anims = anims;
   goto sheet_exit;
 
+free_sheet_trims:
+  if (trims) {
+    CHIMA_FREE(trims);
+  }
+free_sheet_image_rects:
+  CHIMA_FREE(image_rects);
 free_sheet_anims:
   CHIMA_FREE(anims);
 free_sheet_sprites:
@@ -309,7 +493,7 @@ free_sheet_temp_images:
 
 #define CHIMA_FORMAT_MAX_SIZE 7
 #define CHIMA_SHEET_MAJ       1
-#define CHIMA_SHEET_MIN       0
+#define CHIMA_SHEET_MIN       3
 
 typedef struct chima_sprite_file_header {
   chima_u8 magic[sizeof(CHIMA_MAGIC)];
@@ -336,8 +520,27 @@ typedef struct chima_file_sprite {
   chima_u32 frametime;
   chima_u32 name_offset;
   chima_u32 name_size;
+  // Since 1.1
+  chima_u32 source_width;
+  chima_u32 source_height;
+  chima_u32 trim_x;
+  chima_u32 trim_y;
+  // Since 1.2
+  chima_u32 rotated;
+  // Since 1.3
+  chima_u32 page;
 } chima_file_sprite;
 
+// Size of a sprite record in a file, older versions have shorter records
+static chima_size file_sprite_size(chima_u8 ver_min) {
+  switch (ver_min) {
+    case 0: return offsetof(chima_file_sprite, source_width);
+    case 1: return offsetof(chima_file_sprite, rotated);
+    case 2: return offsetof(chima_file_sprite, page);
+    default: return sizeof(chima_file_sprite);
+  }
+}
+
 typedef struct chima_file_anim {
   chima_u32 sprite_idx;
   chima_u32 sprite_count;
@@ -345,6 +548,211 @@ typedef struct chima_file_anim {
   chima_u32 name_size;
 } chima_file_anim;
 
+/*
+ * Since 1.3 the header image offset points to a page table, a page count followed by one entry
+ * per page. Each page is encoded on its own in the header image format. The header image size
+ * is the size of the first page. Older files hold a single page after the names.
+ */
+typedef struct chima_file_page {
+  chima_u32 width;
+  chima_u32 height;
+  uint64_t offset; // From the start of the file
+  uint64_t size;
+} chima_file_page;
+
+static chima_result check_sheet_header(const chima_sprite_file_header* header) {
+  if (strncmp((const char*)header->magic, CHIMA_MAGIC, sizeof(CHIMA_MAGIC))) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+  if (header->file_enum != ASSET_TYPE_SPRITESHEET) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+  if (header->ver_maj != CHIMA_SHEET_MAJ || header->ver_min > CHIMA_SHEET_MIN) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+  return CHIMA_NO_ERROR;
+}
+
+static chima_bool is_raw_sheet(const chima_sprite_file_header* header) {
+  return strncmp(header->image_format, "RAW", 4) == 0;
+}
+
+static chima_result check_sheet_page(const chima_sprite_file_header* header, chima_u32 width,
+                                     chima_u32 height, size_t size) {
+  const chima_image_depth depth = (chima_image_depth)header->image_depth;
+  if ((chima_u32)depth >= _CHIMA_DEPTH_COUNT || !header->image_channels ||
+      header->image_channels > 4) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+  if (is_raw_sheet(header) &&
+      size != (size_t)width * height * header->image_channels * chima__depth_size(depth)) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+  return CHIMA_NO_ERROR;
+}
+
+// Reads a `size` bytes page at the current file position
+static chima_result read_sheet_page(chima_context chima, FILE* f,
+                                    const chima_sprite_file_header* header, chima_u32 width,
+                                    chima_u32 height, size_t size, chima_image* page) {
+  const chima_image_depth depth = (chima_image_depth)header->image_depth;
+  const chima_bool raw = is_raw_sheet(header);
+  const chima_result check = check_sheet_page(header, width, height, size);
+  if (check) {
+    return check;
+  }
+  void* data = CHIMA_MALLOC(size);
+  if (!data) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  if (fread(data, 1, size, f) != size) {
+    CHIMA_FREE(data);
+    return CHIMA_FILE_EOF;
+  }
+  if (raw) {
+    page->data = data;
+    page->extent.width = width;
+    page->extent.height = height;
+    page->channels = header->image_channels;
+    page->depth = depth;
+    return CHIMA_NO_ERROR;
+  }
+  const chima_result ret = chima_load_image_mem(chima, page, depth, data, size);
+  CHIMA_FREE(data);
+  return ret;
+}
+
+static chima_result read_sheet_pages(chima_context chima, FILE* f,
+                                     const chima_sprite_file_header* header, size_t file_sz,
+                                     chima_image** out_pages, chima_size* out_count) {
+  const size_t image_offset = (size_t)ftell(f);
+  if (header->ver_min < 3) {
+    chima_image* page = CHIMA_CALLOC(1, sizeof(chima_image));
+    if (!page) {
+      return CHIMA_ALLOC_FAILURE;
+    }
+    const chima_result ret = read_sheet_page(chima, f, header, header->image_width,
+                                             header->image_height, file_sz - image_offset, page);
+    if (ret) {
+      CHIMA_FREE(page);
+      return ret;
+    }
+    *out_pages = page;
+    *out_count = 1;
+    return CHIMA_NO_ERROR;
+  }
+
+  chima_u32 page_count;
+  if (fread(&page_count, sizeof(page_count), 1, f) != 1) {
+    return CHIMA_FILE_EOF;
+  }
+  if (!page_count || page_count > (file_sz - image_offset) / sizeof(chima_file_page)) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+  chima_file_page* fpages = CHIMA_MALLOC(page_count * sizeof(chima_file_page));
+  if (!fpages) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  chima_result ret = CHIMA_NO_ERROR;
+  if (fread(fpages, sizeof(fpages[0]), page_count, f) != page_count) {
+    ret = CHIMA_FILE_EOF;
+    goto free_fpages;
+  }
+  chima_image* pages = CHIMA_CALLOC(page_count, sizeof(chima_image));
+  if (!pages) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_fpages;
+  }
+  chima_u32 i = 0;
+  for (; i < page_count; ++i) {
+    const chima_file_page* p = &fpages[i];
+    if (p->offset > file_sz || p->size > file_sz - p->offset ||
+        fseek(f, (long)p->offset, SEEK_SET)) {
+      ret = CHIMA_INVALID_FILE_FORMAT;
+      goto destroy_pages;
+    }
+    ret = read_sheet_page(chima, f, header, p->width, p->height, (size_t)p->size, &pages[i]);
+    if (ret) {
+      goto destroy_pages;
+    }
+  }
+  *out_pages = pages;
+  *out_count = page_count;
+  goto free_fpages;
+
+destroy_pages:
+  while (i-- > 0) {
+    chima_destroy_image(chima, &pages[i]);
+  }
+  CHIMA_FREE(pages);
+free_fpages:
+  CHIMA_FREE(fpages);
+  return ret;
+}
+
+// Sprite record with the fields missing from older versions filled in
+static chima_file_sprite read_file_sprite(const chima_u8* record, chima_u8 ver_min) {
+  chima_file_sprite s;
+  memset(&s, 0, sizeof(s));
+  memcpy(&s, record, file_sprite_size(ver_min));
+  if (ver_min < 1) {
+    s.source_width = s.width;
+    s.source_height = s.height;
+  }
+  return s;
+}
+
+static chima_result copy_file_name(chima_string* name, const char* names, chima_u32 names_size,
+                                   chima_u32 offset, chima_u32 size) {
+  if (offset > names_size || size > names_size - offset || size >= CHIMA_STRING_MAX_SIZE) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+  memcpy(name->data, names + offset, size);
+  name->data[size] = '\0';
+  name->len = size;
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result sprite_from_file(chima_sprite* sprite, const chima_file_sprite* s,
+                                     const char* names, chima_u32 names_size,
+                                     chima_size page_count) {
+  if (s->page >= page_count) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+  const chima_result ret =
+    copy_file_name(&sprite->name, names, names_size, s->name_offset, s->name_size);
+  if (ret) {
+    return ret;
+  }
+  sprite->rect.height = s->height;
+  sprite->rect.width = s->width;
+  sprite->rect.y = s->y_off;
+  sprite->rect.x = s->x_off;
+  sprite->frametime = s->frametime;
+  sprite->source_extent.width = s->source_width;
+  sprite->source_extent.height = s->source_height;
+  sprite->trim_x = s->trim_x;
+  sprite->trim_y = s->trim_y;
+  sprite->rotated = s->rotated != 0;
+  sprite->page = s->page;
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result anim_from_file(chima_sprite_anim* anim, const chima_file_anim* a,
+                                   const char* names, chima_u32 names_size,
+                                   chima_size sprite_count) {
+  if (a->sprite_idx > sprite_count || a->sprite_count > sprite_count - a->sprite_idx) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+  const chima_result ret =
+    copy_file_name(&anim->name, names, names_size, a->name_offset, a->name_size);
+  if (ret) {
+    return ret;
+  }
+  anim->sprite_start = a->sprite_idx;
+  anim->sprite_count = a->sprite_count;
+  return CHIMA_NO_ERROR;
+}
 
 chima_result chima_load_spritesheet_file(chima_context chima, chima_spritesheet* sheet,
                                                    FILE* f) {
@@ -362,47 +770,42 @@ chima_result chima_load_spritesheet_file(chima_context chima, chima_spritesheet*
   if (read < 1) {
     return CHIMA_INVALID_FILE_FORMAT;
   }
-  if (strncmp((char*)header.magic, CHIMA_MAGIC, sizeof(CHIMA_MAGIC))) {
-    return CHIMA_INVALID_FILE_FORMAT;
-  }
-  if (header.file_enum != ASSET_TYPE_SPRITESHEET) {
-    return CHIMA_INVALID_FILE_FORMAT;
-  }
-  if (header.ver_maj != CHIMA_SHEET_MAJ) {
-    return CHIMA_INVALID_FILE_FORMAT;
-  }
-  if (header.ver_min != CHIMA_SHEET_MIN) {
-    return CHIMA_INVALID_FILE_FORMAT;
+  chima_result ret = check_sheet_header(&header);
+  if (ret) {
+    return ret;
   }
 
   // Assume everything else is fine...
   size_t read_offset = sizeof(header);
-  size_t read_len = header.sprite_count * sizeof(chima_file_sprite);
-  chima_file_sprite* fsprites = CHIMA_MALLOC(read_len);
+  const size_t sprite_size = file_sprite_size(header.ver_min);
+  size_t read_len = header.sprite_count * sprite_size;
+  chima_file_sprite* fsprites = CHIMA_MALLOC(header.sprite_count * sizeof(chima_file_sprite));
   if (!fsprites) {
-    fclose(f);
     return CHIMA_ALLOC_FAILURE;
   }
-  read = fread(fsprites, sizeof(fsprites[0]), header.sprite_count, f);
+  read = fread(fsprites, sprite_size, header.sprite_count, f);
   if ((chima_u32)read != header.sprite_count) {
     CHIMA_FREE(fsprites);
-    fclose(f);
     return CHIMA_FILE_EOF;
   }
   read_offset += read_len;
+  if (sprite_size < sizeof(chima_file_sprite)) {
+    // Spread the short records, from the back so none is overwritten before being moved
+    for (size_t i = header.sprite_count; i-- > 0;) {
+      fsprites[i] = read_file_sprite((chima_u8*)fsprites + i * sprite_size, header.ver_min);
+    }
+  }
 
   read_len = header.anim_count * sizeof(chima_file_anim);
   chima_file_anim* fanims = CHIMA_MALLOC(read_len);
   if (!fanims) {
     CHIMA_FREE(fsprites);
-    fclose(f);
     return CHIMA_ALLOC_FAILURE;
   }
   read = fread(fanims, sizeof(fanims[0]), header.anim_count, f);
   if ((chima_u32)read != header.anim_count) {
     CHIMA_FREE(fanims);
     CHIMA_FREE(fsprites);
-    fclose(f);
     return CHIMA_FILE_EOF;
   }
   read_offset += read_len;
@@ -412,7 +815,6 @@ chima_result chima_load_spritesheet_file(chima_context chima, chima_spritesheet*
   if (!fnames) {
     CHIMA_FREE(fanims);
     CHIMA_FREE(fsprites);
-    fclose(f);
     return CHIMA_ALLOC_FAILURE;
   }
   read = fread(fnames, sizeof(fnames[0]), header.name_size, f);
@@ -420,112 +822,310 @@ chima_result chima_load_spritesheet_file(chima_context chima, chima_spritesheet*
     CHIMA_FREE(fnames);
     CHIMA_FREE(fanims);
     CHIMA_FREE(fsprites);
-    fclose(f);
     return CHIMA_FILE_EOF;
   }
   read_offset += read_len;
 
-  read_len = file_sz - read_offset;
-  void* image_data = CHIMA_MALLOC(read_len);
-  if (!image_data) {
-    CHIMA_FREE(fnames);
-    CHIMA_FREE(fanims);
-    CHIMA_FREE(fsprites);
-    fclose(f);
-    return CHIMA_ALLOC_FAILURE;
+  chima_image* pages = NULL;
+  chima_size page_count = 0;
+  ret = read_sheet_pages(chima, f, &header, file_sz, &pages, &page_count);
+  if (ret) {
+    goto free_fnames;
   }
-  read = fread(image_data, 1, file_sz, f);
-  CHIMA_ASSERT((chima_u32)read == read_len);
-  fclose(f);
 
   chima_sprite* sprites =
     CHIMA_MALLOC(header.sprite_count * sizeof(chima_sprite));
   if (!sprites) {
-    CHIMA_FREE(fnames);
-    CHIMA_FREE(fanims);
-    CHIMA_FREE(fsprites);
-    return CHIMA_ALLOC_FAILURE;
+    ret = CHIMA_ALLOC_FAILURE;
+    goto destroy_pages;
   }
   memset(sprites, 0, header.sprite_count * sizeof(sprites[0]));
   for (size_t i = 0; i < header.sprite_count; ++i) {
-    const chima_file_sprite* s = &fsprites[i];
-    memcpy(sprites[i].name.data, fnames + s->name_offset, s->name_size);
-    sprites[i].name.len = s->name_size;
-    sprites[i].rect.height = s->height;
-    sprites[i].rect.width = s->width;
-    sprites[i].rect.y = s->y_off;
-    sprites[i].rect.x = s->x_off;
-    sprites[i].frametime = s->frametime;
+    ret = sprite_from_file(&sprites[i], &fsprites[i], fnames, header.name_size, page_count);
+    if (ret) {
+      goto free_sprites;
+    }
   }
 
   chima_sprite_anim* anims =
     CHIMA_MALLOC(header.anim_count * sizeof(chima_sprite_anim));
   if (!anims) {
-    CHIMA_FREE(sprites);
-    CHIMA_FREE(fnames);
-    CHIMA_FREE(fanims);
-    CHIMA_FREE(fsprites);
-    return CHIMA_ALLOC_FAILURE;
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_sprites;
   }
   memset(anims, 0, header.anim_count * sizeof(anims[0]));
   for (size_t i = 0; i < header.anim_count; ++i) {
-    const chima_file_anim* a = &fanims[i];
-    memcpy(anims[i].name.data, fnames + a->name_offset, a->name_size);
-    anims[i].name.len = a->name_size;
-    anims[i].sprite_start = a->sprite_idx;
-    anims[i].sprite_count = a->sprite_count;
+    ret = anim_from_file(&anims[i], &fanims[i], fnames, header.name_size, header.sprite_count);
+    if (ret) {
+      CHIMA_FREE(anims);
+      goto free_sprites;
+    }
   }
 
   memset(sheet, 0, sizeof(*sheet));
+  sheet->pages = pages;
+  sheet->page_count = page_count;
   sheet->sprite_count = header.sprite_count;
   sheet->sprites = sprites;
   sheet->anim_count = header.anim_count;
   sheet->anims = anims;
-  chima_image_depth depth = (chima_image_depth)header.image_depth;
-  if (strncmp(header.image_format, "RAW", 4) == 0) {
-    sheet->atlas.data = image_data;
-    sheet->atlas.extent.width = header.image_width;
-    sheet->atlas.extent.height = header.image_height;
-    sheet->atlas.channels = header.image_channels;
-    sheet->atlas.depth = depth;
-  } else {
-    chima_result ret =
-      chima_load_image_mem(chima, &sheet->atlas, depth, (chima_u8*)image_data, read_len);
-    CHIMA_FREE(image_data);
-    if (ret != CHIMA_NO_ERROR) {
-      CHIMA_FREE(sprites);
-      CHIMA_FREE(fnames);
-      CHIMA_FREE(fanims);
-      CHIMA_FREE(fsprites);
+  goto free_fnames;
+
+free_sprites:
+  CHIMA_FREE(sprites);
+destroy_pages:
+  for (chima_size i = 0; i < page_count; ++i) {
+    chima_destroy_image(chima, &pages[i]);
+  }
+  CHIMA_FREE(pages);
+free_fnames:
+  CHIMA_FREE(fnames);
+  CHIMA_FREE(fanims);
+  CHIMA_FREE(fsprites);
+  return ret;
+}
+
+/*
+ * Loading from memory reads every table in place, one record at a time, checking each range
+ * against the buffer first. Encoded pages are decoded straight from the buffer, and RAW pages
+ * point into it when their data is aligned for the image depth, so nothing is staged.
+ */
+
+// Whether `len` bytes at `offset` are inside of a `size` bytes buffer
+static chima_bool mem_range(chima_size size, uint64_t offset, uint64_t len) {
+  return offset <= size && len <= size - offset;
+}
+
+static chima_result load_sheet_page_mem(chima_context chima,
+                                        const chima_sprite_file_header* header,
+                                        chima_u32 width, chima_u32 height, const chima_u8* data,
+                                        chima_size size, chima_bool borrow, chima_image* page) {
+  const chima_result check = check_sheet_page(header, width, height, size);
+  if (check) {
+    return check;
+  }
+  const chima_image_depth depth = (chima_image_depth)header->image_depth;
+  if (!is_raw_sheet(header)) {
+    return chima_load_image_mem(chima, page, depth, data, size);
+  }
+  void* pixels = (void*)data;
+  if (!borrow) {
+    pixels = CHIMA_MALLOC(size);
+    if (!pixels) {
+      return CHIMA_ALLOC_FAILURE;
+    }
+    memcpy(pixels, data, size);
+  }
+  page->data = pixels;
+  page->extent.width = width;
+  page->extent.height = height;
+  page->channels = header->image_channels;
+  page->depth = depth;
+  return CHIMA_NO_ERROR;
+}
+
+static chima_result load_sheet_pages_mem(chima_context chima,
+                                         const chima_sprite_file_header* header,
+                                         const chima_u8* buffer, chima_size buffer_len,
+                                         chima_size image_offset, chima_image** out_pages,
+                                         chima_size* out_count, chima_bool* out_borrowed) {
+  const chima_bool raw = is_raw_sheet(header);
+  const chima_size align = chima__depth_size((chima_image_depth)header->image_depth);
+  if (header->ver_min < 3) {
+    chima_image* page = CHIMA_CALLOC(1, sizeof(chima_image));
+    if (!page) {
+      return CHIMA_ALLOC_FAILURE;
+    }
+    const chima_u8* data = buffer + image_offset;
+    const chima_bool borrow = raw && align && (uintptr_t)data % align == 0;
+    const chima_result ret =
+      load_sheet_page_mem(chima, header, header->image_width, header->image_height, data,
+                          buffer_len - image_offset, borrow, page);
+    if (ret) {
+      CHIMA_FREE(page);
       return ret;
     }
+    *out_pages = page;
+    *out_count = 1;
+    *out_borrowed = borrow;
+    return CHIMA_NO_ERROR;
   }
 
-  CHIMA_FREE(fsprites);
-  CHIMA_FREE(fanims);
-  CHIMA_FREE(fnames);
+  chima_u32 page_count;
+  if (!mem_range(buffer_len, image_offset, sizeof(page_count))) {
+    return CHIMA_FILE_EOF;
+  }
+  memcpy(&page_count, buffer + image_offset, sizeof(page_count));
+  const chima_size table_offset = image_offset + sizeof(page_count);
+  if (!page_count || page_count > (buffer_len - table_offset) / sizeof(chima_file_page)) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+
+  // All pages borrow the buffer or none does, so the sheet either owns its pages or not
+  chima_bool borrow = raw && align;
+  for (chima_u32 i = 0; i < page_count; ++i) {
+    chima_file_page p;
+    memcpy(&p, buffer + table_offset + i * sizeof(p), sizeof(p));
+    if (!mem_range(buffer_len, p.offset, p.size)) {
+      return CHIMA_INVALID_FILE_FORMAT;
+    }
+    borrow = borrow && (uintptr_t)(buffer + p.offset) % align == 0;
+  }
 
+  chima_image* pages = CHIMA_CALLOC(page_count, sizeof(chima_image));
+  if (!pages) {
+    return CHIMA_ALLOC_FAILURE;
+  }
+  chima_result ret = CHIMA_NO_ERROR;
+  chima_u32 i = 0;
+  for (; i < page_count; ++i) {
+    chima_file_page p;
+    memcpy(&p, buffer + table_offset + i * sizeof(p), sizeof(p));
+    ret = load_sheet_page_mem(chima, header, p.width, p.height, buffer + p.offset,
+                              (chima_size)p.size, borrow, &pages[i]);
+    if (ret) {
+      goto destroy_pages;
+    }
+  }
+  *out_pages = pages;
+  *out_count = page_count;
+  *out_borrowed = borrow;
   return CHIMA_NO_ERROR;
+
+destroy_pages:
+  while (i-- > 0) {
+    if (borrow) {
+      memset(&pages[i], 0, sizeof(pages[i]));
+    } else {
+      chima_destroy_image(chima, &pages[i]);
+    }
+  }
+  CHIMA_FREE(pages);
+  return ret;
 }
 
-chima_result chima_load_spritesheet_mem(chima_context chima,
-                                        chima_spritesheet* sheet,
-                                        const chima_u8* buffer,
-                                        chima_size buffer_len) {
-  CHIMA_UNUSED(chima);
-  CHIMA_UNUSED(sheet);
-  CHIMA_UNUSED(buffer);
-  CHIMA_UNUSED(buffer_len);
-  CHIMA_TODO();
+chima_result chima_load_spritesheet_mem(chima_context chima, chima_spritesheet* sheet,
+                                        const chima_u8* buffer, chima_size buffer_len) {
+  if (!chima || !sheet || !buffer) {
+    return CHIMA_INVALID_VALUE;
+  }
+
+  chima_sprite_file_header header;
+  if (buffer_len < sizeof(header)) {
+    return CHIMA_INVALID_FILE_FORMAT;
+  }
+  memcpy(&header, buffer, sizeof(header));
+  chima_result ret = check_sheet_header(&header);
+  if (ret) {
+    return ret;
+  }
+
+  // Tables in file order, right after the header
+  const chima_size sprite_size = file_sprite_size(header.ver_min);
+  const chima_size sprites_offset = sizeof(header);
+  if (!mem_range(buffer_len, sprites_offset, (uint64_t)header.sprite_count * sprite_size)) {
+    return CHIMA_FILE_EOF;
+  }
+  const chima_size anims_offset = sprites_offset + header.sprite_count * sprite_size;
+  if (!mem_range(buffer_len, anims_offset,
+                 (uint64_t)header.anim_count * sizeof(chima_file_anim))) {
+    return CHIMA_FILE_EOF;
+  }
+  const chima_size names_offset = anims_offset + header.anim_count * sizeof(chima_file_anim);
+  if (!mem_range(buffer_len, names_offset, header.name_size)) {
+    return CHIMA_FILE_EOF;
+  }
+  const char* names = (const char*)buffer + names_offset;
+
+  chima_image* pages = NULL;
+  chima_size page_count = 0;
+  chima_bool borrowed = CHIMA_FALSE;
+  ret = load_sheet_pages_mem(chima, &header, buffer, buffer_len, names_offset + header.name_size,
+                             &pages, &page_count, &borrowed);
+  if (ret) {
+    return ret;
+  }
+
+  chima_sprite* sprites = CHIMA_CALLOC(header.sprite_count, sizeof(chima_sprite));
+  if (!sprites) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto destroy_pages;
+  }
+  for (chima_u32 i = 0; i < header.sprite_count; ++i) {
+    const chima_file_sprite s =
+      read_file_sprite(buffer + sprites_offset + i * sprite_size, header.ver_min);
+    ret = sprite_from_file(&sprites[i], &s, names, header.name_size, page_count);
+    if (ret) {
+      goto free_sprites;
+    }
+  }
+
+  chima_sprite_anim* anims = CHIMA_CALLOC(header.anim_count, sizeof(chima_sprite_anim));
+  if (!anims) {
+    ret = CHIMA_ALLOC_FAILURE;
+    goto free_sprites;
+  }
+  for (chima_u32 i = 0; i < header.anim_count; ++i) {
+    chima_file_anim a;
+    memcpy(&a, buffer + anims_offset + i * sizeof(a), sizeof(a));
+    ret = anim_from_file(&anims[i], &a, names, header.name_size, header.sprite_count);
+    if (ret) {
+      CHIMA_FREE(anims);
+      goto free_sprites;
+    }
+  }
+
+  memset(sheet, 0, sizeof(*sheet));
+  sheet->pages = pages;
+  sheet->page_count = page_count;
+  sheet->sprite_count = header.sprite_count;
+  sheet->sprites = sprites;
+  sheet->anim_count = header.anim_count;
+  sheet->anims = anims;
+  sheet->page_source = borrowed ? buffer : NULL;
+  return CHIMA_NO_ERROR;
+
+free_sprites:
+  CHIMA_FREE(sprites);
+destroy_pages:
+  for (chima_size i = 0; i < page_count; ++i) {
+    if (!borrowed) {
+      chima_destroy_image(chima, &pages[i]);
+    }
+  }
+  CHIMA_FREE(pages);
+  return ret;
+}
+
+// The sheet keeps the mapping only if its pages point into it
+static chima_result load_spritesheet_mapped(chima_context chima, chima_spritesheet* sheet,
+                                            const char* path) {
+  chima_file_mapping mapping;
+  chima_result ret = chima__map_file(chima, path, &mapping);
+  if (ret) {
+    return ret;
+  }
+  chima_size size;
+  const chima_u8* data = chima__mapping_data(mapping, &size);
+  ret = chima_load_spritesheet_mem(chima, sheet, data, size);
+  if (ret || !sheet->page_source) {
+    chima__unmap_file(mapping);
+    return ret;
+  }
+  sheet->mapping = mapping;
+  return CHIMA_NO_ERROR;
 }
 
 chima_result chima_load_spritesheet(chima_context chima,
                                     chima_spritesheet* sheet,
                                     const char* path) {
-  if (!path) {
+  if (!chima || !sheet || !path) {
     return CHIMA_INVALID_VALUE;
   }
 
+  if (chima->flags & CHIMA_CTX_FLAG_SHEET_MAP_FILE) {
+    return load_spritesheet_mapped(chima, sheet, path);
+  }
   FILE* f = fopen(path, "rb");
   if (!f) {
     return CHIMA_FILE_OPEN_FAILURE;
@@ -537,12 +1137,15 @@ chima_result chima_load_spritesheet(chima_context chima,
 
 chima_result chima_write_spritesheet(chima_context chima, const chima_spritesheet* sheet,
                                      chima_image_format format, const char* path) {
-  if (sheet->atlas.depth != CHIMA_DEPTH_8U) {
-    format = CHIMA_FILE_FORMAT_RAW; // for now, we only support writting non u8 depths as RAW bytes
-  }
   if (!sheet || !path) {
     return CHIMA_INVALID_VALUE;
   }
+  if (!sheet->pages || !sheet->page_count) {
+    return CHIMA_INVALID_VALUE;
+  }
+  if (sheet->pages[0].depth != CHIMA_DEPTH_8U) {
+    format = CHIMA_FILE_FORMAT_RAW; // for now, we only support writting non u8 depths as RAW bytes
+  }
 
   size_t name_size = 0;
   size_t sprite_count = sheet->sprite_count;
@@ -562,9 +1165,10 @@ chima_result chima_write_spritesheet(chima_context chima, const chima_spriteshee
   header.ver_min = CHIMA_SHEET_MIN;
   header.sprite_count = (chima_u32)sprite_count;
   header.anim_count = (chima_u32)anim_count;
-  header.image_width = sheet->atlas.extent.width;
-  header.image_height = sheet->atlas.extent.height;
-  header.image_channels = sheet->atlas.channels;
+  header.image_width = sheet->pages[0].extent.width;
+  header.image_height = sheet->pages[0].extent.height;
+  header.image_channels = sheet->pages[0].channels;
+  header.image_depth = (chima_u8)sheet->pages[0].depth;
   switch (format) {
     case CHIMA_FILE_FORMAT_RAW: {
       const char format[] = "RAW";
@@ -610,6 +1214,12 @@ chima_result chima_write_spritesheet(chima_context chima, const chima_spriteshee
     sprites[i].name_offset = name_pos;
     sprites[i].name_size = s->name.len;
     sprites[i].frametime = s->frametime;
+    sprites[i].source_width = s->source_extent.width;
+    sprites[i].source_height = s->source_extent.height;
+    sprites[i].trim_x = s->trim_x;
+    sprites[i].trim_y = s->trim_y;
+    sprites[i].rotated = s->rotated ? 1 : 0;
+    sprites[i].page = s->page;
     name_pos += s->name.len;
   }
 
@@ -665,11 +1275,31 @@ chima_result chima_write_spritesheet(chima_context chima, const chima_spriteshee
   fwrite(anims, sizeof(anims[0]), anim_count, f);
   fwrite(name_data, sizeof(name_data[0]), name_size, f);
 
-  chima_u32 w = sheet->atlas.extent.width;
-  chima_u32 h = sheet->atlas.extent.height;
-  chima_u32 ch = sheet->atlas.channels;
-  void* data = sheet->atlas.data;
-  chima__write_atlas_file(chima, f, w, h, ch, format, data);
+  // The page table is written once the size of every page is known
+  const chima_u32 page_count = (chima_u32)sheet->page_count;
+  chima_file_page* pages = CHIMA_CALLOC(page_count, sizeof(chima_file_page));
+  if (!pages) {
+    fclose(f);
+    CHIMA_FREE(name_data);
+    CHIMA_FREE(sprites);
+    CHIMA_FREE(anims);
+    return CHIMA_ALLOC_FAILURE;
+  }
+  const long table_offset = ftell(f);
+  fwrite(&page_count, sizeof(page_count), 1, f);
+  fwrite(pages, sizeof(pages[0]), page_count, f);
+  for (chima_u32 i = 0; i < page_count; ++i) {
+    const chima_image* page = &sheet->pages[i];
+    pages[i].width = page->extent.width;
+    pages[i].height = page->extent.height;
+    pages[i].offset = (uint64_t)ftell(f);
+    chima__write_atlas_file(chima, f, page->extent.width, page->extent.height, page->channels,
+                            page->depth, format, page->data);
+    pages[i].size = (uint64_t)ftell(f) - pages[i].offset;
+  }
+  fseek(f, table_offset + (long)sizeof(page_count), SEEK_SET);
+  fwrite(pages, sizeof(pages[0]), page_count, f);
+  CHIMA_FREE(pages);
   fclose(f);
 
   CHIMA_FREE(name_data);
@@ -684,7 +1314,11 @@ void chima_destroy_spritesheet(chima_context chima, chima_spritesheet* sheet) {
   }
   CHIMA_FREE(sheet->anims);
   CHIMA_FREE(sheet->sprites);
-  chima_destroy_image(chima, &sheet->atlas);
+  for (chima_size i = 0; i < sheet->page_count && !sheet->page_source; ++i) {
+    chima_destroy_image(chima, &sheet->pages[i]); // Borrowed pixels belong to the buffer
+  }
+  CHIMA_FREE(sheet->pages);
+  chima__unmap_file(sheet->mapping);
   memset(sheet, 0, sizeof(chima_spritesheet));
 }
 
@@ -708,18 +1342,33 @@ chima_uv_transf chima_calc_uv_transform(chima_u32 image_width,
    * (0,sz);(0,1)                                      (sz,sz);(1,1)
   */
   chima_uv_transf out;
-  const chima_bool flip_x = (flags & CHIMA_UV_FLAG_FLIP_X);
-  const chima_bool flip_y = (flags & CHIMA_UV_FLAG_FLIP_Y);
-  const chima_f32 uv_scale_x =
-    (flip_x*-1.f + !flip_x*1.f)*(chima_f32)rect.width/(chima_f32)image_width;
-  const chima_f32 uv_off_x = (chima_f32)rect.x/(chima_f32)image_width;
-  out.x_lin = uv_scale_x;
-  out.x_con = flip_x*(1.f-uv_off_x) + !flip_x*uv_off_x;
-
-  const chima_f32 uv_scale_y = 
-    (flip_y*-1.f + !flip_y*1.f)*(chima_f32)rect.height/(chima_f32)image_height;
-  const chima_f32 uv_off_y = (chima_f32)rect.y/(chima_f32)image_height;
-  out.y_lin = uv_scale_y;
-  out.y_con = flip_y*(1.f-uv_off_y) + !flip_y*uv_off_y;
+  const chima_f32 scale_x = (chima_f32)rect.width / (chima_f32)image_width;
+  const chima_f32 scale_y = (chima_f32)rect.height / (chima_f32)image_height;
+  const chima_f32 off_x = (chima_f32)rect.x / (chima_f32)image_width;
+  const chima_f32 off_y = (chima_f32)rect.y / (chima_f32)image_height;
+  if (flags & CHIMA_UV_FLAG_ROTATED) {
+    /*
+     * The sprite was turned clockwise, its left column is the top row of the rect and its top
+     * row the right column. So the atlas u goes right to left with the sprite v, and the atlas
+     * v top to bottom with the sprite u.
+     */
+    out.x_lin = -scale_x;
+    out.x_con = off_x + scale_x;
+    out.y_lin = scale_y;
+    out.y_con = off_y;
+  } else {
+    out.x_lin = scale_x;
+    out.x_con = off_x;
+    out.y_lin = scale_y;
+    out.y_con = off_y;
+  }
+  if (flags & CHIMA_UV_FLAG_FLIP_X) {
+    out.x_lin = -out.x_lin;
+    out.x_con = 1.f - out.x_con;
+  }
+  if (flags & CHIMA_UV_FLAG_FLIP_Y) {
+    out.y_lin = -out.y_lin;
+    out.y_con = 1.f - out.y_con;
+  }
   return out;
 }
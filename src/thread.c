@@ -0,0 +1,289 @@
+#include "./internal.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Worker thread pool.
+ *
+ * The workers are started the first time a context runs jobs on more than one thread, and kept
+ * sleeping on the context between calls until it is destroyed or its thread count changes. Each
+ * call hands out one ticket per worker it wants; a worker holding a ticket takes jobs until there
+ * are none left, the same as the calling thread. Before returning, the caller withdraws the
+ * tickets nobody took and waits for the workers that did, so no worker touches a call after it
+ * is over.
+ */
+
+#define MAX_THREADS 64
+
+typedef struct parallel_state {
+  PFN_chima__job job;
+  void* user;
+  chima_size job_count;
+  atomic_size_t next_job;
+  atomic_int result;
+} parallel_state;
+
+// Every thread (including the caller) takes jobs in order until there are none left.
+static void run_jobs(parallel_state* state) {
+  for (;;) {
+    const chima_size idx = atomic_fetch_add_explicit(&state->next_job, 1, memory_order_relaxed);
+    if (idx >= state->job_count) {
+      break;
+    }
+    const chima_result ret = state->job(state->user, idx);
+    if (ret != CHIMA_NO_ERROR) {
+      int expected = CHIMA_NO_ERROR;
+      atomic_compare_exchange_strong(&state->result, &expected, (int)ret);
+    }
+  }
+}
+
+#ifdef _WIN32
+typedef HANDLE thread_handle;
+typedef SRWLOCK pool_mutex;
+typedef CONDITION_VARIABLE pool_cond;
+
+static DWORD WINAPI thread_entry(LPVOID arg);
+
+static chima_bool thread_start(thread_handle* thread, void* pool) {
+  *thread = CreateThread(NULL, 0, &thread_entry, pool, 0, NULL);
+  return *thread != NULL;
+}
+
+static void thread_join(thread_handle thread) {
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+}
+
+static chima_bool pool_sync_init(pool_mutex* mutex, pool_cond* wake, pool_cond* done) {
+  InitializeSRWLock(mutex);
+  InitializeConditionVariable(wake);
+  InitializeConditionVariable(done);
+  return CHIMA_TRUE;
+}
+
+static void pool_sync_destroy(pool_mutex* mutex, pool_cond* wake, pool_cond* done) {
+  CHIMA_UNUSED(mutex);
+  CHIMA_UNUSED(wake);
+  CHIMA_UNUSED(done);
+}
+
+static void pool_lock(pool_mutex* mutex) {
+  AcquireSRWLockExclusive(mutex);
+}
+
+static void pool_unlock(pool_mutex* mutex) {
+  ReleaseSRWLockExclusive(mutex);
+}
+
+static void pool_wait(pool_cond* cond, pool_mutex* mutex) {
+  SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+static void pool_wake_all(pool_cond* cond) {
+  WakeAllConditionVariable(cond);
+}
+
+static chima_u32 hardware_threads(void) {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (chima_u32)info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t thread_handle;
+typedef pthread_mutex_t pool_mutex;
+typedef pthread_cond_t pool_cond;
+
+static void* thread_entry(void* arg);
+
+static chima_bool thread_start(thread_handle* thread, void* pool) {
+  return pthread_create(thread, NULL, &thread_entry, pool) == 0;
+}
+
+static void thread_join(thread_handle thread) {
+  pthread_join(thread, NULL);
+}
+
+static chima_bool pool_sync_init(pool_mutex* mutex, pool_cond* wake, pool_cond* done) {
+  if (pthread_mutex_init(mutex, NULL)) {
+    return CHIMA_FALSE;
+  }
+  if (pthread_cond_init(wake, NULL)) {
+    pthread_mutex_destroy(mutex);
+    return CHIMA_FALSE;
+  }
+  if (pthread_cond_init(done, NULL)) {
+    pthread_cond_destroy(wake);
+    pthread_mutex_destroy(mutex);
+    return CHIMA_FALSE;
+  }
+  return CHIMA_TRUE;
+}
+
+static void pool_sync_destroy(pool_mutex* mutex, pool_cond* wake, pool_cond* done) {
+  pthread_cond_destroy(done);
+  pthread_cond_destroy(wake);
+  pthread_mutex_destroy(mutex);
+}
+
+static void pool_lock(pool_mutex* mutex) {
+  pthread_mutex_lock(mutex);
+}
+
+static void pool_unlock(pool_mutex* mutex) {
+  pthread_mutex_unlock(mutex);
+}
+
+static void pool_wait(pool_cond* cond, pool_mutex* mutex) {
+  pthread_cond_wait(cond, mutex);
+}
+
+static void pool_wake_all(pool_cond* cond) {
+  pthread_cond_broadcast(cond);
+}
+
+static chima_u32 hardware_threads(void) {
+  const long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (chima_u32)count : 1;
+}
+#endif
+
+typedef struct chima_thread_pool_ {
+  pool_mutex mutex;
+  pool_cond wake; // Signaled when tickets are handed out, or on shutdown
+  pool_cond done; // Signaled when the last busy worker runs out of jobs
+  parallel_state* state;
+  chima_u32 tickets;
+  chima_u32 busy;
+  chima_bool stop;
+  chima_u32 worker_count;
+  thread_handle workers[MAX_THREADS - 1];
+} chima_thread_pool_;
+
+static void worker_loop(chima_thread_pool pool) {
+  pool_lock(&pool->mutex);
+  for (;;) {
+    while (!pool->stop && !pool->tickets) {
+      pool_wait(&pool->wake, &pool->mutex);
+    }
+    if (pool->stop) {
+      break;
+    }
+    --pool->tickets;
+    ++pool->busy;
+    parallel_state* state = pool->state;
+    pool_unlock(&pool->mutex);
+
+    run_jobs(state);
+
+    pool_lock(&pool->mutex);
+    if (!--pool->busy) {
+      pool_wake_all(&pool->done);
+    }
+  }
+  pool_unlock(&pool->mutex);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI thread_entry(LPVOID arg) {
+  worker_loop(arg);
+  return 0;
+}
+#else
+static void* thread_entry(void* arg) {
+  worker_loop(arg);
+  return NULL;
+}
+#endif
+
+// Starts workers until the pool has `count`, returns how many it has. If a worker can't be
+// started, its share of the jobs is picked up by the others
+static chima_u32 reserve_workers(chima_context chima, chima_u32 count) {
+  chima_thread_pool pool = chima->thread_pool;
+  if (!pool) {
+    pool = CHIMA_MALLOC(sizeof(chima_thread_pool_));
+    if (!pool) {
+      return 0;
+    }
+    memset(pool, 0, sizeof(*pool));
+    if (!pool_sync_init(&pool->mutex, &pool->wake, &pool->done)) {
+      CHIMA_FREE(pool);
+      return 0;
+    }
+    chima->thread_pool = pool;
+  }
+  // Idle workers only wait for tickets, starting more doesn't need the lock
+  while (pool->worker_count < count && thread_start(&pool->workers[pool->worker_count], pool)) {
+    ++pool->worker_count;
+  }
+  return CHIMA_MIN(pool->worker_count, count);
+}
+
+void chima__destroy_thread_pool(chima_context chima) {
+  chima_thread_pool pool = chima->thread_pool;
+  if (!pool) {
+    return;
+  }
+  pool_lock(&pool->mutex);
+  pool->stop = CHIMA_TRUE;
+  pool_wake_all(&pool->wake);
+  pool_unlock(&pool->mutex);
+  for (chima_u32 i = 0; i < pool->worker_count; ++i) {
+    thread_join(pool->workers[i]);
+  }
+  pool_sync_destroy(&pool->mutex, &pool->wake, &pool->done);
+  CHIMA_FREE(pool);
+  chima->thread_pool = NULL;
+}
+
+chima_u32 chima__thread_count(chima_context chima, chima_size job_count) {
+  chima_u32 count = chima->thread_count ? chima->thread_count : hardware_threads();
+  count = count < MAX_THREADS ? count : MAX_THREADS;
+  return (chima_size)count < job_count ? count : (chima_u32)job_count;
+}
+
+chima_result chima__parallel_for(chima_context chima, chima_size job_count, PFN_chima__job job,
+                                 void* user) {
+  parallel_state state;
+  state.job = job;
+  state.user = user;
+  state.job_count = job_count;
+  atomic_init(&state.next_job, 0);
+  atomic_init(&state.result, CHIMA_NO_ERROR);
+
+  const chima_u32 thread_count = chima__thread_count(chima, job_count);
+  const chima_u32 workers = thread_count > 1 ? reserve_workers(chima, thread_count - 1) : 0;
+  if (!workers) {
+    run_jobs(&state);
+    return (chima_result)atomic_load(&state.result);
+  }
+
+  chima_thread_pool pool = chima->thread_pool;
+  pool_lock(&pool->mutex);
+  pool->state = &state;
+  pool->tickets = workers;
+  pool_wake_all(&pool->wake);
+  pool_unlock(&pool->mutex);
+
+  run_jobs(&state);
+
+  // Workers that didn't wake up in time have nothing left to do
+  pool_lock(&pool->mutex);
+  pool->tickets = 0;
+  while (pool->busy) {
+    pool_wait(&pool->done, &pool->mutex);
+  }
+  pool->state = NULL;
+  pool_unlock(&pool->mutex);
+
+  return (chima_result)atomic_load(&state.result);
+}
@@ -0,0 +1,200 @@
+#include "./internal.h"
+
+#include <string.h>
+
+#ifdef CHIMA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/*
+ * Transparent border trimming.
+ *
+ * Rows are scanned from the top and the bottom until one has a texel with a non zero alpha, and
+ * every row in between only searches the columns still outside of the bounds found so far, from
+ * both ends. Most rows of a sprite end up checking a few texels on each side.
+ *
+ * RGBA8 rows use SIMD kernels that test 4 or 8 alpha bytes at once, other formats are scanned
+ * one texel at a time. Images without an alpha channel are never trimmed.
+ */
+
+typedef chima_bool (*PFN_opaque_texel)(const chima_u8* texel);
+
+static chima_bool opaque_u8(const chima_u8* texel) {
+  return *texel != 0;
+}
+
+static chima_bool opaque_u16(const chima_u8* texel) {
+  chima_u16 alpha;
+  memcpy(&alpha, texel, sizeof(alpha));
+  return alpha != 0;
+}
+
+static chima_bool opaque_f32(const chima_u8* texel) {
+  chima_f32 alpha;
+  memcpy(&alpha, texel, sizeof(alpha));
+  return alpha > 0.f;
+}
+
+typedef struct trim_row_scan {
+  PFN_opaque_texel opaque;
+  chima_size texel_size;
+  chima_size alpha_offset;
+  chima_bool rgba8;
+} trim_row_scan;
+
+#ifdef CHIMA_X86_SIMD
+// Bit `4 * i + 3` of the masks is set if the alpha of texel `i` is not zero
+CHIMA_TARGET("sse2")
+static chima_u32 alpha_mask_rgba8_sse2(const chima_u8* texels) {
+  const __m128i v = _mm_loadu_si128((const __m128i*)texels);
+  const __m128i zero = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+  return ~(chima_u32)_mm_movemask_epi8(zero) & 0x8888u;
+}
+
+CHIMA_TARGET("avx2")
+static chima_u32 alpha_mask_rgba8_avx2(const chima_u8* texels) {
+  const __m256i v = _mm256_loadu_si256((const __m256i*)texels);
+  const __m256i zero = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+  return ~(chima_u32)_mm256_movemask_epi8(zero) & 0x88888888u;
+}
+
+CHIMA_TARGET("avx2")
+static chima_size first_opaque_rgba8_avx2(const chima_u8* row, chima_size begin,
+                                          chima_size end) {
+  for (; begin + 8 <= end; begin += 8) {
+    const chima_u32 mask = alpha_mask_rgba8_avx2(row + begin * 4);
+    if (mask) {
+      return begin + (chima_size)__builtin_ctz(mask) / 4;
+    }
+  }
+  return begin;
+}
+
+CHIMA_TARGET("avx2")
+static chima_size last_opaque_rgba8_avx2(const chima_u8* row, chima_size begin, chima_size end) {
+  for (; end >= begin + 8; end -= 8) {
+    const chima_u32 mask = alpha_mask_rgba8_avx2(row + (end - 8) * 4);
+    if (mask) {
+      return end - 8 + (chima_size)(31 - __builtin_clz(mask)) / 4 + 1;
+    }
+  }
+  return end;
+}
+
+CHIMA_TARGET("sse2")
+static chima_size first_opaque_rgba8_sse2(const chima_u8* row, chima_size begin,
+                                          chima_size end) {
+  for (; begin + 4 <= end; begin += 4) {
+    const chima_u32 mask = alpha_mask_rgba8_sse2(row + begin * 4);
+    if (mask) {
+      return begin + (chima_size)__builtin_ctz(mask) / 4;
+    }
+  }
+  return begin;
+}
+
+CHIMA_TARGET("sse2")
+static chima_size last_opaque_rgba8_sse2(const chima_u8* row, chima_size begin, chima_size end) {
+  for (; end >= begin + 4; end -= 4) {
+    const chima_u32 mask = alpha_mask_rgba8_sse2(row + (end - 4) * 4);
+    if (mask) {
+      return end - 4 + (chima_size)(31 - __builtin_clz(mask)) / 4 + 1;
+    }
+  }
+  return end;
+}
+#endif
+
+// Index of the first opaque texel in [begin, end), or `end`
+static chima_size first_opaque(const trim_row_scan* scan, const chima_u8* row, chima_size begin,
+                               chima_size end) {
+#ifdef CHIMA_X86_SIMD
+  if (scan->rgba8) {
+    const chima_bitfield cpu = chima__cpu_features();
+    if (cpu & CHIMA_CPU_FLAG_AVX2) {
+      begin = first_opaque_rgba8_avx2(row, begin, end);
+    } else if (cpu & CHIMA_CPU_FLAG_SSE2) {
+      begin = first_opaque_rgba8_sse2(row, begin, end);
+    }
+  }
+#endif
+  for (; begin < end; ++begin) {
+    if (scan->opaque(row + begin * scan->texel_size + scan->alpha_offset)) {
+      return begin;
+    }
+  }
+  return end;
+}
+
+// One past the last opaque texel in [begin, end), or `begin`
+static chima_size last_opaque(const trim_row_scan* scan, const chima_u8* row, chima_size begin,
+                              chima_size end) {
+#ifdef CHIMA_X86_SIMD
+  if (scan->rgba8) {
+    const chima_bitfield cpu = chima__cpu_features();
+    if (cpu & CHIMA_CPU_FLAG_AVX2) {
+      end = last_opaque_rgba8_avx2(row, begin, end);
+    } else if (cpu & CHIMA_CPU_FLAG_SSE2) {
+      end = last_opaque_rgba8_sse2(row, begin, end);
+    }
+  }
+#endif
+  for (; end > begin; --end) {
+    if (scan->opaque(row + (end - 1) * scan->texel_size + scan->alpha_offset)) {
+      return end;
+    }
+  }
+  return begin;
+}
+
+chima_bool chima__alpha_bounds(const chima_image* image, chima_rect* bounds) {
+  const chima_size width = image->extent.width, height = image->extent.height;
+  bounds->x = bounds->y = 0;
+  bounds->width = image->extent.width;
+  bounds->height = image->extent.height;
+  if (image->channels != 2 && image->channels != 4) {
+    return CHIMA_TRUE; // No alpha, nothing to trim
+  }
+
+  trim_row_scan scan;
+  const chima_size depth_size = chima__depth_size(image->depth);
+  scan.texel_size = image->channels * depth_size;
+  scan.alpha_offset = (image->channels - 1) * depth_size;
+  scan.rgba8 = image->channels == 4 && image->depth == CHIMA_DEPTH_8U;
+  switch (image->depth) {
+    case CHIMA_DEPTH_8U: scan.opaque = &opaque_u8; break;
+    case CHIMA_DEPTH_16U: scan.opaque = &opaque_u16; break;
+    case CHIMA_DEPTH_32F: scan.opaque = &opaque_f32; break;
+    default: return CHIMA_TRUE;
+  }
+  const chima_size stride = width * scan.texel_size;
+  const chima_u8* data = image->data;
+
+  chima_size top = 0, left = width;
+  for (; top < height; ++top) {
+    left = first_opaque(&scan, data + top * stride, 0, width);
+    if (left < width) {
+      break;
+    }
+  }
+  if (top == height) {
+    return CHIMA_FALSE;
+  }
+  chima_size bottom = height;
+  while (first_opaque(&scan, data + (bottom - 1) * stride, 0, width) == width) {
+    --bottom;
+  }
+
+  // Both searches return the old bound when the row adds nothing, so the bounds only grow
+  chima_size right = last_opaque(&scan, data + top * stride, left, width);
+  for (chima_size y = top + 1; y < bottom && (left > 0 || right < width); ++y) {
+    const chima_u8* row = data + y * stride;
+    left = first_opaque(&scan, row, 0, left);
+    right = last_opaque(&scan, row, right, width);
+  }
+  bounds->x = (chima_u32)left;
+  bounds->y = (chima_u32)top;
+  bounds->width = (chima_u32)(right - left);
+  bounds->height = (chima_u32)(bottom - top);
+  return CHIMA_TRUE;
+}